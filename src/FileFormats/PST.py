@@ -621,20 +621,27 @@ class PSTHeader(SimpleStruct):
 
         return result
 
-    def find_descriptors(self):
-        """ Iterates over the indexes to locate the descriptors """
-        descriptors = []
+    def find_descriptors(self, skip=()):
+        """ Iterates over the indexes to locate the descriptors.
+
+        This is a generator yielding (descriptor id, descriptor) in
+        id order. Each descriptor is only decrypted and parsed when it
+        is reached. Ids in skip (e.g. those already processed) are not
+        parsed at all.
+        """
+        skip = set(skip)
+
+        for k in sorted(self.index2_list.keys()):
+            v = self.index2_list[k]
+            if k in skip: continue
 
-        for k,v in pst.index2_list.items():
-            print v
             try:
                 key = int(v['DESC-ID1'])
-                descriptor = pst.index1_list[key]
+                descriptor = self.index1_list[key]
             except KeyError:
                 print "Cant find index 1 for 0x%X" % key
                 continue
 
-            print descriptor
             offset = int(descriptor['Offset'])
             length = int(descriptor['Size'])
             cdata = self.buffer[offset:offset+length].__str__()
@@ -649,8 +656,9 @@ class PSTHeader(SimpleStruct):
                     desc = DescriptorItem7CEC(data)
                 except RuntimeError, e:
                     print "Unable to process description %s" % e
+                    continue
 
-            print "at offset 0x%X: %s" % (offset,desc )
+            yield k, desc
 
 ## With "Compressible Encryption" the pst file is simply obfuscated
 ## using the following substitution cipher:
@@ -697,4 +705,5 @@ if __name__=="__main__":
     
     pst = PSTHeader(b)
 #    print pst
-    pst.find_descriptors()    
+    for id, desc in pst.find_descriptors():
+        print "0x%X: %s" % (id, desc)    
@@ -9,6 +9,7 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <unistd.h>
+#include <pthread.h>
 
 #include "sk.h"
 #include "list.h"
@@ -27,6 +28,9 @@
 
 static int TSK_IMG_INFO_TYPE_PYFILE_TYPE	=	0x40;
 
+/** All the images currently open by skfs objects **/
+static LIST_HEAD(shared_imgs);
+
 /** Some accounting for tracking down memleaks **/
 static int skfs_object_count=0;
 static int skfile_object_count=0;
@@ -107,6 +111,7 @@ void listdent_add_dent(TSK_FS_DENT *fs_dent, TSK_FS_DATA *fs_data, struct dentwa
     struct dentwalk *p = talloc(dentlist, struct dentwalk);
 
     p->path = talloc_strndup(p, fs_dent->name, fs_dent->name_max - 1);
+    p->children = NULL;
 
     p->type = p->id = 0;
     if(fs_data) {
@@ -240,12 +245,17 @@ static TSK_WALK_RET_ENUM
 getblocks_walk_callback(TSK_FS_INFO *fs, TSK_DADDR_T addr, char *buf, size_t size, TSK_FS_BLOCK_FLAG_ENUM flags, void *ptr) {
 
     struct block *b;
+    struct skfile_run *r;
     skfile *file = (skfile *) ptr;
+    int run_flags = (flags & TSK_FS_BLOCK_FLAG_SPARSE) ? SK_RUN_SPARSE : 0;
 
     if(size <= 0)
         return TSK_WALK_CONT;
 
-    if(!(flags & TSK_FS_BLOCK_FLAG_RES)) {
+    if(flags & TSK_FS_BLOCK_FLAG_RES)
+        file->runs_valid = 0;
+
+    if(!(flags & (TSK_FS_BLOCK_FLAG_RES | TSK_FS_BLOCK_FLAG_SPARSE))) {
         /* create a new block entry */
         b = talloc(file->blocks, struct block);
         b->addr = addr;
@@ -253,6 +263,22 @@ getblocks_walk_callback(TSK_FS_INFO *fs, TSK_DADDR_T addr, char *buf, size_t siz
         list_add_tail(&b->list, &file->blocks->list);
     }
 
+    /* extend the last run if this block follows on from it */
+    r = file->nruns ? &file->runs[file->nruns - 1] : NULL;
+    if(r && r->flags == run_flags && (r->len % fs->block_size) == 0 &&
+       (run_flags & SK_RUN_SPARSE || r->addr + r->len / fs->block_size == addr)) {
+        r->len += size;
+    } else {
+        if((file->nruns % 64) == 0)
+            file->runs = talloc_realloc(file->context, file->runs, struct skfile_run, file->nruns + 64);
+
+        r = &file->runs[file->nruns++];
+        r->offset = file->size;
+        r->addr = addr;
+        r->len = size;
+        r->flags = run_flags;
+    }
+
     file->size += size;
 
     /* add to the list */
@@ -269,9 +295,157 @@ TSK_INUM_T lookup_inode(TSK_FS_INFO *fs, char *path) {
     return ret;
 }
 
-/* callback for lookup_path */
-//static uint8_t
-TSK_WALK_RET_ENUM
+/* Used while building the inode map. The walk is depth first, so the
+ * directories above the current entry are kept on a stack with their
+ * paths (in the same form as fs_dent->path) to find the parent inode. */
+struct inode_map_build {
+    struct inode_map *map;
+    char **paths;
+    TSK_INUM_T *inodes;
+    int depth;
+    int size;
+};
+
+/* callback for inode_map_build */
+static TSK_WALK_RET_ENUM
+inode_map_cb(TSK_FS_INFO * fs, TSK_FS_DENT * fs_dent, void *ptr) {
+    struct inode_map_build *build = (struct inode_map_build *)ptr;
+    struct inode_map *map = build->map;
+    struct inode_name *entry;
+    char *path = fs_dent->path ? fs_dent->path : "";
+    size_t len;
+    int i;
+
+    if(!strcmp(fs_dent->name, ".") || !strcmp(fs_dent->name, ".."))
+        return TSK_WALK_CONT;
+
+    /* grow the arrays */
+    if(map->count == map->size) {
+        map->size = map->size ? map->size * 2 : 1024;
+        map->entries = talloc_realloc(map, map->entries, struct inode_name, map->size);
+        if(!map->entries)
+            return TSK_WALK_ERROR;
+    }
+
+    len = strlen(fs_dent->name) + 1;
+    while(map->names_len + len > map->names_size) {
+        map->names_size = map->names_size ? map->names_size * 2 : 16384;
+        map->names = talloc_realloc(map, map->names, char, map->names_size);
+        if(!map->names)
+            return TSK_WALK_ERROR;
+    }
+
+    /* find our directory on the stack */
+    for(i=build->depth-1; i>=0; i--)
+        if(!strcmp(build->paths[i], path))
+            break;
+
+    entry = &map->entries[map->count++];
+    entry->inode = fs_dent->inode;
+    entry->parent = 0;
+    entry->name = map->names_len;
+    memcpy(map->names + map->names_len, fs_dent->name, len);
+    map->names_len += len;
+
+    if(i >= 0) {
+        entry->parent = build->inodes[i];
+
+        /* the walk has left any directories above us on the stack */
+        while(build->depth > i+1)
+            talloc_free(build->paths[--build->depth]);
+    }
+
+    /* the walk will go into this directory next */
+    if(fs_dent->fsi &&
+       (fs_dent->fsi->mode & TSK_FS_INODE_MODE_FMT) == TSK_FS_INODE_MODE_DIR) {
+        if(build->depth == build->size) {
+            build->size *= 2;
+            build->paths = talloc_realloc(build, build->paths, char *, build->size);
+            build->inodes = talloc_realloc(build, build->inodes, TSK_INUM_T, build->size);
+            if(!build->paths || !build->inodes)
+                return TSK_WALK_ERROR;
+        }
+        build->paths[build->depth] = talloc_asprintf(build->paths, "%s%s/", path, fs_dent->name);
+        build->inodes[build->depth++] = fs_dent->inode;
+    }
+
+    return TSK_WALK_CONT;
+}
+
+/* Sort by inode and keep walk order within an inode. Names are added
+ * in walk order so their offset gives the order. */
+static int
+inode_name_cmp(const void *a, const void *b) {
+    const struct inode_name *x = (const struct inode_name *)a;
+    const struct inode_name *y = (const struct inode_name *)b;
+
+    if(x->inode != y->inode)
+        return x->inode < y->inode ? -1 : 1;
+    if(x->name != y->name)
+        return x->name < y->name ? -1 : 1;
+    return 0;
+}
+
+/* Walks the whole filesystem once and builds the inode map. Returns
+ * NULL if the walk fails, a partial map would give wrong answers. */
+static struct inode_map *
+inode_map_build(skfs *self) {
+    struct inode_map_build *build;
+    struct inode_map *map;
+    size_t i, j;
+
+    map = talloc_zero(self->context, struct inode_map);
+    build = talloc_zero(NULL, struct inode_map_build);
+    build->map = map;
+    build->size = 64;
+    build->paths = talloc_array(build, char *, build->size);
+    build->inodes = talloc_array(build, TSK_INUM_T, build->size);
+    build->paths[0] = talloc_strdup(build->paths, "");
+    build->inodes[0] = self->fs->root_inum;
+    build->depth = 1;
+
+    tsk_error_reset();
+    if(self->fs->dent_walk(self->fs, self->fs->root_inum,
+                           TSK_FS_DENT_FLAG_RECURSE | TSK_FS_DENT_FLAG_ALLOC,
+                           inode_map_cb, (void *)build)) {
+        tsk_error_reset();
+        talloc_free(build);
+        talloc_free(map);
+        return NULL;
+    }
+    talloc_free(build);
+
+    /* keep the first name the walk found for each inode */
+    qsort(map->entries, map->count, sizeof(struct inode_name), inode_name_cmp);
+    for(i=0, j=0; i<map->count; i++) {
+        if(j > 0 && map->entries[j-1].inode == map->entries[i].inode)
+            continue;
+        map->entries[j++] = map->entries[i];
+    }
+    map->count = j;
+
+    return map;
+}
+
+static struct inode_name *
+inode_map_find(struct inode_map *map, TSK_INUM_T inode) {
+    size_t lo = 0, hi = map->count;
+
+    while(lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+
+        if(map->entries[mid].inode < inode)
+            lo = mid + 1;
+        else if(map->entries[mid].inode > inode)
+            hi = mid;
+        else
+            return &map->entries[mid];
+    }
+    return NULL;
+}
+
+/* callback for lookup_path_walk */
+static TSK_WALK_RET_ENUM
 lookup_path_cb(TSK_FS_INFO * fs, TSK_FS_DENT * fs_dent, void *ptr) {
     struct dentwalk *dent = (struct dentwalk *)ptr;
 
@@ -282,17 +456,13 @@ lookup_path_cb(TSK_FS_INFO * fs, TSK_FS_DENT * fs_dent, void *ptr) {
     return TSK_WALK_CONT;
 }
 
-/* lookup path for inode, supply an dentwalk ptr (must be a talloc context),
- * name will be filled in */
-int lookup_path(TSK_FS_INFO *fs, struct dentwalk *dent) {
+/* Looks up a single path without the inode map. This is used on NTFS,
+ * where ntfs_find_file also finds deleted and orphan files, and if the
+ * map could not be built */
+static int
+lookup_path_walk(TSK_FS_INFO *fs, struct dentwalk *dent) {
     int flags = TSK_FS_DENT_FLAG_RECURSE | TSK_FS_DENT_FLAG_ALLOC;
 
-    /* special case, the walk won't pick this up */
-    if(dent->inode == fs->root_inum) {
-        dent->path = talloc_strdup(dent, "/");
-        return 0;
-    }
-
     /* there is a walk optimised for NTFS */
     if((fs->ftype & TSK_FS_INFO_TYPE_FS_MASK) == TSK_FS_INFO_TYPE_NTFS_TYPE) {
         if(ntfs_find_file(fs, dent->inode, 0, 0, flags, lookup_path_cb, (void *)dent))
@@ -304,6 +474,59 @@ int lookup_path(TSK_FS_INFO *fs, struct dentwalk *dent) {
     return 0;
 }
 
+/* lookup path for inode, supply an dentwalk ptr (must be a talloc context),
+ * name will be filled in (or left NULL if the inode has no name) */
+int lookup_path(skfs *self, struct dentwalk *dent) {
+    struct inode_name *entry;
+    TSK_INUM_T inode = dent->inode;
+    char *path = NULL, *tmp;
+    size_t depth = 0;
+
+    /* special case, the walk won't pick this up */
+    if(dent->inode == self->fs->root_inum) {
+        dent->path = talloc_strdup(dent, "/");
+        return 0;
+    }
+
+    if(self->inode_map_failed ||
+       (self->fs->ftype & TSK_FS_INFO_TYPE_FS_MASK) == TSK_FS_INFO_TYPE_NTFS_TYPE)
+        return lookup_path_walk(self->fs, dent);
+
+    if(!self->inode_map) {
+        self->inode_map = inode_map_build(self);
+        if(!self->inode_map) {
+            self->inode_map_failed = 1;
+            return lookup_path_walk(self->fs, dent);
+        }
+    }
+
+    /* follow the parents up to the root. The depth check guards
+     * against loops in corrupted filesystems. */
+    while(inode != self->fs->root_inum) {
+        entry = inode_map_find(self->inode_map, inode);
+        if(!entry) {
+            talloc_free(path);
+            return 0;
+        }
+
+        /* a name whose directory the map could not place, the walk
+         * may still find it */
+        if(entry->parent == 0 || depth++ > self->inode_map->count) {
+            talloc_free(path);
+            return lookup_path_walk(self->fs, dent);
+        }
+
+        tmp = talloc_asprintf(dent, "/%s%s", self->inode_map->names + entry->name,
+                              path ? path : "");
+        talloc_free(path);
+        path = tmp;
+        inode = entry->parent;
+    }
+
+    dent->path = path;
+    return 0;
+}
+
 /* parse an inode string into inode, type, id */
 int parse_inode_str(char *str, TSK_INUM_T *inode, uint32_t *type, uint32_t *id) {
     char *ptr;
@@ -326,11 +549,32 @@ void print_current_exception() {
 };
 
 /* The methods below implement an sleuthkit img interface backed by any python
- * file-like object using the python abstract object layer, though specific 
- * optimisations might be made if the object based on a pyflag "iosubsys", or
- * other C-code backed interface.
+ * file-like object using the python abstract object layer. Objects which are
+ * based on a pyflag "iosubsys" or other C-code backed interface export a
+ * struct pyimgread, which we use to read directly without the interpreter.
  */
 
+/* Read through the exported C interface */
+static ssize_t
+pyfile_read_random_c(IMG_PYFILE_INFO *pyfile_info, char *buf, size_t len,
+                     unsigned long long int tot_offset) {
+    int read;
+
+    /* The reader takes a 32 bit length and returns an int */
+    if(len > INT_MAX)
+        len = INT_MAX;
+
+    read = pyfile_info->reader->read_random(pyfile_info->reader->ctx, buf, len, tot_offset);
+    if(read < 0) {
+        tsk_errno = TSK_ERR_IMG_READ;
+        snprintf(tsk_errstr, TSK_ERRSTR_L, "pyfile_read_random - can't read %llu from %llu", (uint64_t)len, (uint64_t)tot_offset);
+        tsk_errstr2[0] = '\0';
+        return -1;
+    }
+
+    return read;
+}
+
 /* Return the size read and -1 if error */
 static ssize_t
 pyfile_read_random(TSK_IMG_INFO * img_info, TSK_OFF_T vol_offset, char *buf,
@@ -347,6 +591,9 @@ pyfile_read_random(TSK_IMG_INFO * img_info, TSK_OFF_T vol_offset, char *buf,
     IMG_PYFILE_INFO *pyfile_info = (IMG_PYFILE_INFO *) img_info;
     tot_offset = offset + vol_offset;
 
+    if(pyfile_info->reader)
+        return pyfile_read_random_c(pyfile_info, buf, len, tot_offset);
+
     /* seek to correct offset */
     res = PyObject_CallMethod(pyfile_info->fileobj, "seek", "(K)", tot_offset);
     if(res == NULL) {
@@ -447,6 +694,20 @@ pyfile_open(PyObject *fileobj) {
 
     img_info->size = 0;
 
+    /* Does the object export a C level reader? We keep a reference to
+     * fileobj which keeps the reader alive. */
+    tmp = PyObject_GetAttrString(fileobj, PYIMGREAD_ATTRIBUTE);
+    if(tmp && PyCObject_Check(tmp)) {
+        pyfile_info->reader = (struct pyimgread *)PyCObject_AsVoidPtr(tmp);
+        img_info->size = pyfile_info->reader->size;
+        Py_DECREF(tmp);
+        return img_info;
+    }
+
+    /* Not there - fall back to the python file-like interface */
+    Py_XDECREF(tmp);
+    PyErr_Clear();
+
     /** FIXME: Sometimes the file like object has an attribute .size
 	which should avoid us doing this 
     */
@@ -467,12 +728,211 @@ pyfile_open(PyObject *fileobj) {
         tmp = PyObject_CallMethod(fileobj, "seek", "(i)", 0);
 	if(!tmp) return NULL;
 	Py_DECREF(tmp);
+    } else {
+        /* the size stays unknown (0) */
+        PyErr_Clear();
     }
 
     return img_info;
 }
 
 
+/* This layer goes on top of the shared image for filesystems which are used
+ * from threads other than the main one. The layers below may call back into
+ * python and are not safe to use from several threads at once, so every read
+ * is done holding the GIL.
+ */
+static ssize_t
+gilimg_read_random(TSK_IMG_INFO * img_info, TSK_OFF_T vol_offset, char *buf,
+                   size_t len, TSK_OFF_T offset) {
+    IMG_GIL_INFO *gil_info = (IMG_GIL_INFO *) img_info;
+    PyGILState_STATE gstate;
+    ssize_t read;
+
+    gstate = PyGILState_Ensure();
+    read = gil_info->parent->read_random(gil_info->parent, vol_offset, buf,
+                                         len, offset);
+    PyGILState_Release(gstate);
+
+    return read;
+}
+
+static TSK_OFF_T
+gilimg_get_size(TSK_IMG_INFO * img_info) {
+    return img_info->size;
+}
+
+static void
+gilimg_imgstat(TSK_IMG_INFO * img_info, FILE * hFile) {
+    IMG_GIL_INFO *gil_info = (IMG_GIL_INFO *) img_info;
+    gil_info->parent->imgstat(gil_info->parent, hFile);
+}
+
+/* drops our reference on the shared image below */
+static void
+gilimg_close(TSK_IMG_INFO * img_info) {
+    IMG_GIL_INFO *gil_info = (IMG_GIL_INFO *) img_info;
+
+    shared_img_close(gil_info->parent);
+    talloc_free(img_info);
+}
+
+/* parent must be a shared image. We hold a reference on it so that it
+ * stays open even if the skfs is closed while threads still use it. */
+TSK_IMG_INFO *
+gilimg_open(TSK_IMG_INFO *parent) {
+    IMG_GIL_INFO *gil_info;
+    TSK_IMG_INFO *img_info;
+
+    gil_info = talloc_zero(NULL, IMG_GIL_INFO);
+    if(gil_info == NULL)
+        return NULL;
+
+    shared_img_ref(parent);
+    gil_info->parent = parent;
+
+    img_info = (TSK_IMG_INFO *) gil_info;
+    img_info->itype = parent->itype;
+    img_info->size = parent->size;
+    img_info->read_random = gilimg_read_random;
+    img_info->get_size = gilimg_get_size;
+    img_info->close = gilimg_close;
+    img_info->imgstat = gilimg_imgstat;
+
+    return img_info;
+}
+
+/* Open count more copies of the skfs filesystem for use by threads. They
+ * share the image (and its page cache) with the skfs, through a GIL layer.
+ * If not all of them can be opened count is lowered to the number that
+ * were. The array is allocated against ctx.
+ */
+TSK_FS_INFO **
+thread_fs_open(skfs *self, void *ctx, int *count) {
+    TSK_FS_INFO **result;
+    int i;
+
+    PyEval_InitThreads();
+
+    /* the skfs was closed */
+    if(!self->fs || !self->img) {
+        *count = 0;
+        return NULL;
+    }
+
+    result = talloc_zero_array(ctx, TSK_FS_INFO *, *count);
+    if(!result) {
+        *count = 0;
+        return NULL;
+    }
+
+    for(i=0; i<*count; i++) {
+        TSK_IMG_INFO *img = gilimg_open(self->img);
+
+        if(img) {
+            tsk_error_reset();
+            result[i] = tsk_fs_open(img, self->fs->offset,
+                                    tsk_fs_get_type(self->fs->ftype));
+            if(!result[i])
+                img->close(img);
+        }
+
+        /* make do with the ones we have */
+        if(!result[i]) {
+            tsk_error_reset();
+            *count = i;
+            break;
+        }
+    }
+
+    return result;
+}
+
+void
+thread_fs_close(TSK_FS_INFO **fs, int count) {
+    int i;
+
+    for(i=0; i<count; i++) {
+        if(fs[i]) {
+            TSK_IMG_INFO *img = fs[i]->img_info;
+            fs[i]->close(fs[i]);
+            img->close(img);
+            fs[i] = NULL;
+        }
+    }
+}
+
+/* Images are opened through these so that all skfs objects using the same
+ * file object share one page cache. The cache size is set by whoever opens the
+ * image first, a cache_size of 0 disables caching. Every open or
+ * shared_img_ref must be matched by a shared_img_close.
+ */
+TSK_IMG_INFO *
+shared_img_open(PyObject *fileobj, size_t cache_size) {
+    struct shared_img *s;
+    void *key = fileobj;
+    TSK_IMG_INFO *img;
+
+    /* Images are identified by the python file object. Different
+     * handles on the same source get their own cache, since we can not
+     * tell that they are the same. */
+    list_for_each_entry(s, &shared_imgs, list) {
+        if(s->key == key) {
+            s->refs++;
+            return s->img;
+        }
+    }
+
+    img = pyfile_open(fileobj);
+    if(!img)
+        return NULL;
+
+    if(cache_size > 0) {
+        TSK_IMG_INFO *cache = tsk_img_cache_open(img, cache_size);
+        if(!cache) {
+            img->close(img);
+            return NULL;
+        }
+        img = cache;
+    }
+
+    s = talloc(NULL, struct shared_img);
+    s->key = key;
+    s->img = img;
+    s->refs = 1;
+    list_add(&s->list, &shared_imgs);
+
+    return img;
+}
+
+void
+shared_img_ref(TSK_IMG_INFO *img) {
+    struct shared_img *s;
+
+    list_for_each_entry(s, &shared_imgs, list) {
+        if(s->img == img) {
+            s->refs++;
+            return;
+        }
+    }
+}
+
+void
+shared_img_close(TSK_IMG_INFO *img) {
+    struct shared_img *s;
+
+    list_for_each_entry(s, &shared_imgs, list) {
+        if(s->img == img) {
+            if(--s->refs == 0) {
+                list_del(&s->list);
+                img->close(img);
+                talloc_free(s);
+            }
+            return;
+        }
+    }
+}
+
 /*****************************************************************
  * Now for the python module stuff 
  * ***************************************************************/
@@ -482,7 +942,15 @@ static PyObject *skfs_close(skfs *self) {
     if(self->fs)
         self->fs->close(self->fs);
     if(self->img)
-        self->img->close(self->img);
+        shared_img_close(self->img);
+
+    self->fs = NULL;
+    self->img = NULL;
+
+    if(self->inode_map)
+        talloc_free(self->inode_map);
+    self->inode_map = NULL;
+    self->inode_map_failed = 0;
 
     Py_RETURN_NONE;
 }
@@ -491,8 +959,9 @@ static void
 skfs_dealloc(skfs *self) {
   skfs_object_count --;
 
-  // This is not deeded here as skfs_close gets called already
-  //  Py_DECREF(skfs_close(self));
+  /* release the filesystem and our reference on the shared image (and
+     with it the page cache and the python file object) */
+  Py_DECREF(skfs_close(self));
 
   if(self->root_inum) {
     Py_DECREF(self->root_inum);
@@ -507,12 +976,15 @@ skfs_init(skfs *self, PyObject *args, PyObject *kwds) {
     PyObject *imgfile;
     char *fstype=NULL;
     long long int imgoff=0;
+    unsigned long cache_size=SK_IMG_CACHE_SIZE;
     self->root_inum = NULL;
+    self->inode_map = NULL;
+    self->inode_map_failed = 0;
 
-    static char *kwlist[] = {"imgfile", "imgoff", "fstype", NULL};
+    static char *kwlist[] = {"imgfile", "imgoff", "fstype", "cache", NULL};
 
-    if(!PyArg_ParseTupleAndKeywords(args, kwds, "O|Ks", kwlist, 
-				    &imgfile, &imgoff, &fstype))
+    if(!PyArg_ParseTupleAndKeywords(args, kwds, "O|Ksk", kwlist, 
+				    &imgfile, &imgoff, &fstype, &cache_size))
         return -1; 
 
     /** Create a NULL talloc context for us. Now everything will be
@@ -523,7 +995,7 @@ skfs_init(skfs *self, PyObject *args, PyObject *kwds) {
     /* initialise the img and filesystem */
     tsk_error_reset();
 
-    self->img = pyfile_open(imgfile);
+    self->img = shared_img_open(imgfile, cache_size);
     if(!self->img) {
       char *error = error_get();
 
@@ -537,6 +1009,8 @@ skfs_init(skfs *self, PyObject *args, PyObject *kwds) {
     if(!self->fs) {
       char *error = error_get();
       PyErr_Format(PyExc_RuntimeError, "Unable to open filesystem in image: %s", error);
+      shared_img_close(self->img);
+      self->img = NULL;
       return -1;
     }
 
@@ -648,28 +1122,33 @@ static PyObject *
 skfs_walk(skfs *self, PyObject *args, PyObject *kwds) {
     char *path=NULL;
     int alloc=1, unalloc=0, ret;
-    int names=1, inodes=0;
+    int names=1, inodes=0, threads=1;
     PyObject *fileargs, *filekwds;
     skfs_walkiter *iter;
     TSK_INUM_T inode=0;
 
-    static char *kwlist[] = {"path", "inode", "alloc", "unalloc", "names", "inodes", NULL};
+    static char *kwlist[] = {"path", "inode", "alloc", "unalloc", "names", "inodes", "threads", NULL};
 
 
-    if(!PyArg_ParseTupleAndKeywords(args, kwds, "|sKiiii", kwlist, &path, &inode, 
-                                    &alloc, &unalloc, &names, &inodes))
+    if(!PyArg_ParseTupleAndKeywords(args, kwds, "|sKiiiii", kwlist, &path, &inode, 
+                                    &alloc, &unalloc, &names, &inodes, &threads))
         return NULL; 
 
     /* create an skfs_walkiter object to return to the caller */
     fileargs = PyTuple_New(0);
     if(path)
-        filekwds = Py_BuildValue("{sOsssKsisisisi}", "filesystem", (PyObject *)self, "path", path,
-                                 "inode", inode, "alloc", alloc, "unalloc", unalloc, "names", names, "inodes", inodes);
+        filekwds = Py_BuildValue("{sOsssKsisisisisi}", "filesystem", (PyObject *)self, "path", path,
+                                 "inode", inode, "alloc", alloc, "unalloc", unalloc, "names", names, "inodes", inodes,
+                                 "threads", threads);
     else
-        filekwds = Py_BuildValue("{sOsKsisisisi}", "filesystem", (PyObject *)self, 
-                                 "inode", inode, "alloc", alloc, "unalloc", unalloc, "names", names, "inodes", inodes);
+        filekwds = Py_BuildValue("{sOsKsisisisisi}", "filesystem", (PyObject *)self, 
+                                 "inode", inode, "alloc", alloc, "unalloc", unalloc, "names", names, "inodes", inodes,
+                                 "threads", threads);
 
     iter = PyObject_New(skfs_walkiter, &skfs_walkiterType);
+    iter->skfs = NULL;
+    iter->context = NULL;
+    iter->fs = NULL;
 
     ret = skfs_walkiter_init(iter, fileargs, filekwds);
     Py_DECREF(fileargs);
@@ -682,28 +1161,44 @@ skfs_walk(skfs *self, PyObject *args, PyObject *kwds) {
     return (PyObject *)iter;
 }
 
-/* perform an inode walk, return a list of inodes. This is best only used to
- * find unallocated (deleted) inodes as it builds a list in memory and returns
- * it (skfs.walk by contrast uses a generator). */
+/* perform an inode walk. This returns an iterator which asks the filesystem
+ * for a batch of inodes at a time, so memory use does not grow with the size
+ * of the filesystem. The walk can be resumed later by passing the iterators
+ * next_inum as inode. */
 static PyObject *
 skfs_iwalk(skfs *self, PyObject *args, PyObject *kwds) {
-    int alloc=0, unalloc=1;
-    int flags=TSK_FS_INODE_FLAG_UNALLOC | TSK_FS_INODE_FLAG_USED;
-    PyObject *list;
-    TSK_INUM_T inode=0;
+    int alloc=0, unalloc=1, batch=SK_IWALK_BATCH, threads=1, ret;
+    PyObject *fileargs, *filekwds;
+    skfs_iwalkiter *iter;
+    TSK_INUM_T inode=0, end=0;
 
-    static char *kwlist[] = {"inode", "alloc", "unalloc", NULL};
+    static char *kwlist[] = {"inode", "alloc", "unalloc", "end", "batch", "threads", NULL};
 
-    if(!PyArg_ParseTupleAndKeywords(args, kwds, "|Kii", kwlist, &inode, 
-                                    &alloc, &unalloc))
+    if(!PyArg_ParseTupleAndKeywords(args, kwds, "|KiiKii", kwlist, &inode, 
+                                    &alloc, &unalloc, &end, &batch, &threads))
         return NULL; 
 
-    // ignore args for now and just do full walk (start->end)
-    list = PyList_New(0);
-    self->fs->inode_walk(self->fs, self->fs->first_inum, self->fs->last_inum, flags, 
-            inode_walk_callback, (void *)list);
+    /* create an skfs_iwalkiter object to return to the caller */
+    fileargs = PyTuple_New(0);
+    filekwds = Py_BuildValue("{sOsKsisisKsisi}", "filesystem", (PyObject *)self,
+                             "inode", inode, "alloc", alloc, "unalloc", unalloc,
+                             "end", end, "batch", batch, "threads", threads);
 
-    return list;
+    iter = PyObject_New(skfs_iwalkiter, &skfs_iwalkiterType);
+    iter->skfs = NULL;
+    iter->inodes = NULL;
+    iter->fs = NULL;
+    iter->context = NULL;
+
+    ret = skfs_iwalkiter_init(iter, fileargs, filekwds);
+    Py_DECREF(fileargs);
+    Py_DECREF(filekwds);
+
+    if(ret == -1) {
+        Py_DECREF(iter);
+        return NULL;
+    }
+    return (PyObject *)iter;
 }
 
 PyObject *build_stat_result(TSK_FS_INODE *fs_inode) {
@@ -860,10 +1355,79 @@ skfs_readlink(skfs *self, PyObject *args, PyObject *kwds) {
     return result;
 }
 
+/* return the page cache counters as a dict, or None if there is no cache */
+static PyObject *
+skfs_cache_stats(skfs *self) {
+    TSK_IMG_CACHE_STATS stats;
+
+    if(!self->img || self->img->itype != TSK_IMG_INFO_TYPE_CACHE)
+        Py_RETURN_NONE;
+
+    tsk_img_cache_stats(self->img, &stats);
+
+    return Py_BuildValue("{sKsKsKsKsKsksksi}",
+                         "hits", stats.hits, "misses", stats.misses,
+                         "ghost_hits", stats.ghost_hits,
+                         "evictions", stats.evictions, "bypass", stats.bypass,
+                         "pages", (unsigned long)stats.pages,
+                         "max_pages", (unsigned long)stats.max_pages,
+                         "page_size", TSK_IMG_CACHE_PAGE_SIZE);
+}
+
+/* return the path of an inode. Except on NTFS the first call builds
+ * the inode map, after that this is cheap */
+static PyObject *
+skfs_path(skfs *self, PyObject *args, PyObject *kwds) {
+    PyObject *inode_obj, *result;
+    struct dentwalk *dent;
+    TSK_INUM_T inode=0;
+    uint32_t type=0, id=0;
+
+    static char *kwlist[] = {"inode", NULL};
+
+    if(!PyArg_ParseTupleAndKeywords(args, kwds, "O", kwlist, &inode_obj))
+        return NULL;
+
+    if(!self->fs)
+        return PyErr_Format(PyExc_IOError, "Filesystem is closed");
+
+    /* inode can be an int or a string */
+    if(PyNumber_Check(inode_obj)) {
+        PyObject *l = PyNumber_Long(inode_obj);
+        inode = PyLong_AsUnsignedLongLong(l);
+        Py_DECREF(l);
+    } else {
+        if(!parse_inode_str(PyString_AsString(inode_obj), &inode, &type, &id))
+            return PyErr_Format(PyExc_IOError, "Inode must be a long or a string of the format \"inode[-type-id]\"");
+    }
+
+    dent = talloc_zero(NULL, struct dentwalk);
+    dent->inode = inode;
+    if(lookup_path(self, dent)) {
+        talloc_free(dent);
+        return PyErr_Format(PyExc_IOError, "Unable to look up path for inode %llu",
+                            (unsigned long long)inode);
+    }
+
+    if(dent->path) {
+        result = PyString_FromString(dent->path);
+    } else {
+        Py_INCREF(Py_None);
+        result = Py_None;
+    }
+
+    talloc_free(dent);
+    return result;
+}
+
 /* this new object is requred to support the iterator protocol for skfs.walk
  * */
 static void 
 skfs_walkiter_dealloc(skfs_walkiter *self) {
+    /* close the filesystems opened for threads */
+    if(self->fs)
+        thread_fs_close(self->fs, self->threads);
+
     if(self->skfs)
       Py_XDECREF(self->skfs);
 
@@ -877,15 +1441,29 @@ skfs_walkiter_init(skfs_walkiter *self, PyObject *args, PyObject *kwds) {
     PyObject *skfs_obj;
     struct dentwalk *root;
     int alloc=1, unalloc=0;
-    int names=1, inodes=0;
-    TSK_INUM_T inode;
+    int names=1, inodes=0, threads=1;
+    TSK_INUM_T inode=0;
+
+    static char *kwlist[] = {"filesystem", "path", "inode", "alloc", "unalloc", "names", "inodes", "threads", NULL};
 
-    static char *kwlist[] = {"filesystem", "path", "inode", "alloc", "unalloc", "names", "inodes", NULL};
+    self->fs = NULL;
+    self->threads = 0;
 
-    if(!PyArg_ParseTupleAndKeywords(args, kwds, "O|sKiiii", kwlist, &skfs_obj, 
-                                    &path, &inode, &alloc, &unalloc, &names, &inodes))
+    if(!PyArg_ParseTupleAndKeywords(args, kwds, "O|sKiiiii", kwlist, &skfs_obj, 
+                                    &path, &inode, &alloc, &unalloc, &names, &inodes, &threads))
         return -1; 
 
+    /* check the type of the filesystem object */
+    if(PyObject_TypeCheck(skfs_obj, &skfsType) == 0) {
+        PyErr_Format(PyExc_TypeError, "filesystem is not an skfs instance");
+        return -1;
+    }
+
+    if(!((skfs *)skfs_obj)->fs) {
+        PyErr_Format(PyExc_IOError, "Filesystem is closed");
+        return -1;
+    }
+
     /* must have at least inode or path */
     if(inode == 0 && path == NULL) {
         PyErr_Format(PyExc_SyntaxError, "One of filename or inode must be specified");
@@ -906,6 +1484,13 @@ skfs_walkiter_init(skfs_walkiter *self, PyObject *args, PyObject *kwds) {
     if(inodes)
         self->myflags |= SK_FLAG_INODES;
 
+    /* threads are only used to read ahead, 1 walks as before */
+    if(threads < 1)
+        threads = 1;
+    if(threads > SK_WALK_MAX_THREADS)
+        threads = SK_WALK_MAX_THREADS;
+    self->threads = threads;
+
     /* incref the skfs */
     Py_INCREF(skfs_obj);
     self->skfs = (skfs *)skfs_obj;
@@ -918,6 +1503,7 @@ skfs_walkiter_init(skfs_walkiter *self, PyObject *args, PyObject *kwds) {
     root = talloc(self->walklist, struct dentwalk);
     root->type = root->id = 0;
     root->alloc = 1;
+    root->children = NULL;
 
     if(inode == 0) {
         tsk_error_reset();
@@ -926,7 +1512,7 @@ skfs_walkiter_init(skfs_walkiter *self, PyObject *args, PyObject *kwds) {
 
     if(path == NULL) {
         tsk_error_reset();
-        lookup_path(self->skfs->fs, root);
+        lookup_path(self->skfs, root);
     } else root->path = talloc_strdup(root, path);
 
     list_add(&root->list, &self->walklist->list);
@@ -934,12 +1520,125 @@ skfs_walkiter_init(skfs_walkiter *self, PyObject *args, PyObject *kwds) {
     return 0;
 }
 
+/* a batch of directories read ahead by skfs.walk */
+struct walk_batch {
+    struct dentwalk **dirs;
+    int count;
+    int next;               // next entry of dirs to be read
+    int flags;
+    pthread_mutex_t lock;
+};
+
+struct walk_thread {
+    struct walk_batch *batch;
+    TSK_FS_INFO *fs;
+    pthread_t thread;
+};
+
+/* reads directories from the batch until there are none left. Each
+ * directory's listing goes into its own children list, so threads never
+ * allocate from the same talloc context. */
+static void *
+walk_worker(void *data) {
+    struct walk_thread *t = (struct walk_thread *)data;
+    struct walk_batch *batch = t->batch;
+    struct dentwalk *dw;
+
+    while(1) {
+        pthread_mutex_lock(&batch->lock);
+        if(batch->next >= batch->count) {
+            pthread_mutex_unlock(&batch->lock);
+            break;
+        }
+        dw = batch->dirs[batch->next++];
+        pthread_mutex_unlock(&batch->lock);
+
+        /* errors are ignored here just like in a serial walk */
+        tsk_error_reset();
+        t->fs->dent_walk(t->fs, dw->inode, batch->flags,
+                         listdent_walk_callback_dent, (void *)dw->children);
+        tsk_error_reset();
+    }
+
+    return NULL;
+}
+
+/* Read the directories at the top of the stack on several threads. These
+ * are the ones which will be popped next, and the results are only used
+ * when they are popped, so the order of the walk does not change. */
+static void
+skfs_walkiter_readahead(skfs_walkiter *self) {
+    struct dentwalk *dirs[SK_WALK_MAX_THREADS * SK_WALK_READAHEAD];
+    struct walk_thread threads[SK_WALK_MAX_THREADS];
+    struct walk_batch batch;
+    struct dentwalk *dw;
+    int i, nthreads, started=0;
+
+    /* open a filesystem for each thread the first time round */
+    if(!self->fs)
+        self->fs = thread_fs_open(self->skfs, self->context, &self->threads);
+
+    if(self->threads < 2)
+        return;
+
+    /* collect directories that have not been read yet */
+    batch.count = 0;
+    list_for_each_entry(dw, &self->walklist->list, list) {
+        if(batch.count >= self->threads * SK_WALK_READAHEAD)
+            break;
+        if(dw->children)
+            continue;
+
+        dw->children = talloc(dw, struct dentwalk);
+        INIT_LIST_HEAD(&dw->children->list);
+        dirs[batch.count++] = dw;
+    }
+
+    batch.dirs = dirs;
+    batch.next = 0;
+    batch.flags = self->flags;
+    pthread_mutex_init(&batch.lock, NULL);
+
+    nthreads = self->threads;
+    if(nthreads > batch.count)
+        nthreads = batch.count;
+
+    for(i=0; i<nthreads; i++) {
+        threads[i].batch = &batch;
+        threads[i].fs = self->fs[i];
+    }
+
+    /* the image is read with the GIL held, so we must let it go */
+    Py_BEGIN_ALLOW_THREADS
+    for(i=0; i<nthreads; i++) {
+        if(pthread_create(&threads[i].thread, NULL, walk_worker, &threads[i]) != 0)
+            break;
+        started++;
+    }
+
+    /* if no thread could be started we do the work ourselves */
+    if(started == 0)
+        walk_worker(&threads[0]);
+
+    for(i=0; i<started; i++)
+        pthread_join(threads[i].thread, NULL);
+    Py_END_ALLOW_THREADS
+
+    pthread_mutex_destroy(&batch.lock);
+}
+
 static PyObject *skfs_walkiter_iternext(skfs_walkiter *self) {
     PyObject *dirlist, *filelist, *root, *result, *inode;
     struct dentwalk *dw, *dwlist;
     struct dentwalk *dwtmp, *dwtmp2;
     char *tmp;
 
+    if(!self->skfs)
+        return PyErr_Format(PyExc_RuntimeError, "Iterator is not initialised");
+
+    if(!self->skfs->fs)
+        return PyErr_Format(PyExc_IOError, "Filesystem is closed");
+
     /* are we done ? */
     if(list_empty(&self->walklist->list))
         return NULL;
@@ -947,20 +1646,30 @@ static PyObject *skfs_walkiter_iternext(skfs_walkiter *self) {
     /* pop an item from the stack */
     list_next(dw, &self->walklist->list, list);
 
-    /* initialise our list for this walk */
-    dwlist = talloc(self->walklist, struct dentwalk);
-    INIT_LIST_HEAD(&dwlist->list);
+    if(self->threads > 1 && !dw->children)
+        skfs_walkiter_readahead(self);
 
-    /* walk this directory */
-    tsk_error_reset();
-    self->skfs->fs->dent_walk(self->skfs->fs, dw->inode, self->flags, 
-                              listdent_walk_callback_dent, (void *)dwlist);
-    /* must ignore errors and keep going or else we kill the whole walk because one dirlist failed! */
-    if(tsk_errno) {
+    if(dw->children) {
+        /* it was read ahead, take the list off dw as dw is freed below */
+        dwlist = dw->children;
+        talloc_steal(self->walklist, dwlist);
+        dw->children = NULL;
+    } else {
+        /* initialise our list for this walk */
+        dwlist = talloc(self->walklist, struct dentwalk);
+        INIT_LIST_HEAD(&dwlist->list);
+
+        /* walk this directory */
         tsk_error_reset();
-        //PyErr_Format(PyExc_IOError, "Walk error at (%d)%s: %s", dw->inode, dw->path, tsk_error_get());
-        //talloc_free(dwlist);
-        //return NULL;
+        self->skfs->fs->dent_walk(self->skfs->fs, dw->inode, self->flags, 
+                                  listdent_walk_callback_dent, (void *)dwlist);
+        /* must ignore errors and keep going or else we kill the whole walk because one dirlist failed! */
+        if(tsk_errno) {
+            tsk_error_reset();
+            //PyErr_Format(PyExc_IOError, "Walk error at (%d)%s: %s", dw->inode, dw->path, tsk_error_get());
+            //talloc_free(dwlist);
+            //return NULL;
+        }
     }
 
     /* process the list */
@@ -1047,6 +1756,281 @@ static PyObject *skfs_walkiter_iternext(skfs_walkiter *self) {
     return result;
 }
 
+/* iterator for skfs.iwalk */
+static void 
+skfs_iwalkiter_dealloc(skfs_iwalkiter *self) {
+    if(self->fs)
+        thread_fs_close(self->fs, self->threads);
+
+    Py_XDECREF(self->skfs);
+    Py_XDECREF(self->inodes);
+    talloc_free(self->context);
+    self->ob_type->tp_free((PyObject*)self);
+}
+
+static int 
+skfs_iwalkiter_init(skfs_iwalkiter *self, PyObject *args, PyObject *kwds) {
+    PyObject *skfs_obj;
+    TSK_FS_INFO *fs;
+    int alloc=0, unalloc=1, batch=SK_IWALK_BATCH, threads=1;
+    TSK_INUM_T inode=0, end=0;
+
+    static char *kwlist[] = {"filesystem", "inode", "alloc", "unalloc", "end", "batch", "threads", NULL};
+
+    self->fs = NULL;
+    self->threads = 0;
+    self->context = NULL;
+
+    if(!PyArg_ParseTupleAndKeywords(args, kwds, "O|KiiKii", kwlist, &skfs_obj, 
+                                    &inode, &alloc, &unalloc, &end, &batch, &threads))
+        return -1; 
+
+    /* check the type of the filesystem object */
+    if(PyObject_TypeCheck(skfs_obj, &skfsType) == 0) {
+        PyErr_Format(PyExc_TypeError, "filesystem is not an skfs instance");
+        return -1;
+    }
+
+    fs = ((skfs *)skfs_obj)->fs;
+    if(!fs) {
+        PyErr_Format(PyExc_IOError, "Filesystem is closed");
+        return -1;
+    }
+
+    /* 0 means the start (or end) of the filesystem */
+    if(inode == 0 || inode < fs->first_inum)
+        inode = fs->first_inum;
+    if(end == 0 || end > fs->last_inum)
+        end = fs->last_inum;
+    if(batch <= 0)
+        batch = SK_IWALK_BATCH;
+    if(threads < 1)
+        threads = 1;
+    if(threads > SK_WALK_MAX_THREADS)
+        threads = SK_WALK_MAX_THREADS;
+
+    self->flags = TSK_FS_INODE_FLAG_USED;
+    if(alloc)
+        self->flags |= TSK_FS_INODE_FLAG_ALLOC;
+    if(unalloc)
+        self->flags |= TSK_FS_INODE_FLAG_UNALLOC;
+
+    /* incref the skfs */
+    Py_INCREF(skfs_obj);
+    self->skfs = (skfs *)skfs_obj;
+
+    self->batch = batch;
+    self->threads = threads;
+    self->context = talloc_size(NULL, 1);
+    self->next_inum = inode;
+    self->end_inum = end;
+    self->inodes = NULL;
+    self->pos = 0;
+
+    return 0;
+}
+
+/* one part of an inode walk done on its own thread. Python objects can not
+ * be made without the GIL, so the inodes are kept in a plain array until
+ * the thread is done. */
+struct iwalk_inode {
+    TSK_INUM_T inode;
+    uint32_t type;
+    uint32_t id;
+    char alloc;
+};
+
+struct iwalk_range {
+    TSK_FS_INFO *fs;
+    TSK_INUM_T start;
+    TSK_INUM_T end;
+    int flags;
+    struct iwalk_inode *inodes;
+    int count;
+    int size;
+    pthread_t thread;
+    int started;
+};
+
+static int
+iwalk_range_add(struct iwalk_range *range, TSK_INUM_T inode, uint32_t type,
+                uint32_t id, char alloc) {
+    if(range->count >= range->size) {
+        int size = range->size ? range->size * 2 : 64;
+        struct iwalk_inode *tmp = talloc_realloc(NULL, range->inodes, struct iwalk_inode, size);
+
+        if(!tmp)
+            return -1;
+        range->inodes = tmp;
+        range->size = size;
+    }
+    range->inodes[range->count].inode = inode;
+    range->inodes[range->count].type = type;
+    range->inodes[range->count].id = id;
+    range->inodes[range->count].alloc = alloc;
+    range->count++;
+    return 0;
+}
+
+/* same as inode_walk_callback, but without python */
+static TSK_WALK_RET_ENUM
+iwalk_range_callback(TSK_FS_INFO *fs, TSK_FS_INODE *fs_inode, void *ptr) {
+    struct iwalk_range *range = (struct iwalk_range *)ptr;
+    char alloc = (fs_inode->flags & TSK_FS_INODE_FLAG_ALLOC) ? 1 : 0;
+
+    if ((fs->ftype & TSK_FS_INFO_TYPE_FS_MASK) == TSK_FS_INFO_TYPE_NTFS_TYPE) {
+        TSK_FS_DATA *fs_data;
+
+        for(fs_data = fs_inode->attr; fs_data; fs_data = fs_data->next) {
+            if(!(fs_data->flags & TSK_FS_DATA_INUSE))
+                continue;
+
+            if((fs_data->type == NTFS_ATYPE_DATA) &&
+               iwalk_range_add(range, fs_inode->addr, fs_data->type, fs_data->id, alloc) < 0)
+                return TSK_WALK_ERROR;
+        }
+    } else if(iwalk_range_add(range, fs_inode->addr, 0, 0, alloc) < 0) {
+        return TSK_WALK_ERROR;
+    }
+    return TSK_WALK_CONT;
+}
+
+static void *
+iwalk_worker(void *data) {
+    struct iwalk_range *range = (struct iwalk_range *)data;
+
+    tsk_error_reset();
+    range->fs->inode_walk(range->fs, range->start, range->end, range->flags,
+                          iwalk_range_callback, (void *)range);
+    tsk_error_reset();
+
+    return NULL;
+}
+
+/* Walk start..end split into one range per thread, then add the results to
+ * self->inodes in inode order. */
+static void
+skfs_iwalkiter_parallel(skfs_iwalkiter *self, TSK_INUM_T start, TSK_INUM_T end) {
+    struct iwalk_range ranges[SK_WALK_MAX_THREADS];
+    TSK_INUM_T per_thread;
+    int i, j, nthreads;
+
+    /* open a filesystem for each thread the first time round */
+    if(!self->fs)
+        self->fs = thread_fs_open(self->skfs, self->context, &self->threads);
+
+    nthreads = self->threads;
+    if(nthreads < 1) {
+        /* no filesystems could be opened at all */
+        tsk_error_reset();
+        self->skfs->fs->inode_walk(self->skfs->fs, start, end, self->flags,
+                                   inode_walk_callback, (void *)self->inodes);
+        tsk_error_reset();
+        return;
+    }
+
+    if((TSK_INUM_T)nthreads > end - start + 1)
+        nthreads = (int)(end - start + 1);
+    per_thread = (end - start + 1) / nthreads;
+
+    memset(ranges, 0, sizeof(ranges));
+    for(i=0; i<nthreads; i++) {
+        ranges[i].fs = self->fs[i];
+        ranges[i].flags = self->flags;
+        ranges[i].start = start + i * per_thread;
+        ranges[i].end = (i == nthreads - 1) ? end : ranges[i].start + per_thread - 1;
+    }
+
+    Py_BEGIN_ALLOW_THREADS
+    for(i=0; i<nthreads; i++) {
+        /* walk this range here if a thread could not be started */
+        if(pthread_create(&ranges[i].thread, NULL, iwalk_worker, &ranges[i]) == 0)
+            ranges[i].started = 1;
+        else
+            iwalk_worker(&ranges[i]);
+    }
+    for(i=0; i<nthreads; i++)
+        if(ranges[i].started)
+            pthread_join(ranges[i].thread, NULL);
+    Py_END_ALLOW_THREADS
+
+    /* merge in order */
+    for(i=0; i<nthreads; i++) {
+        for(j=0; j<ranges[i].count; j++) {
+            PyObject *inode = (PyObject *)PyObject_New(skfs_inode, &skfs_inodeType);
+            ((skfs_inode *)inode)->inode = ranges[i].inodes[j].inode;
+            ((skfs_inode *)inode)->type = ranges[i].inodes[j].type;
+            ((skfs_inode *)inode)->id = ranges[i].inodes[j].id;
+            ((skfs_inode *)inode)->alloc = ranges[i].inodes[j].alloc;
+
+            PyList_Append(self->inodes, inode);
+            Py_DECREF(inode);
+        }
+        talloc_free(ranges[i].inodes);
+    }
+}
+
+static PyObject *skfs_iwalkiter_iternext(skfs_iwalkiter *self) {
+    TSK_FS_INFO *fs;
+    PyObject *result;
+
+    if(!self->skfs)
+        return PyErr_Format(PyExc_RuntimeError, "Iterator is not initialised");
+
+    fs = self->skfs->fs;
+    if(!fs)
+        return PyErr_Format(PyExc_IOError, "Filesystem is closed");
+
+    /* walk ranges of inodes until we get some results or run out */
+    while(self->inodes == NULL || self->pos >= PyList_GET_SIZE(self->inodes)) {
+        TSK_INUM_T last;
+
+        Py_XDECREF(self->inodes);
+        self->inodes = NULL;
+        self->pos = 0;
+
+        /* are we done ? */
+        if(self->next_inum > self->end_inum)
+            return NULL;
+
+        last = self->next_inum + self->batch - 1;
+        if(last > self->end_inum || last < self->next_inum)
+            last = self->end_inum;
+
+        self->inodes = PyList_New(0);
+        if(!self->inodes)
+            return NULL;
+
+        if(self->threads > 1) {
+            skfs_iwalkiter_parallel(self, self->next_inum, last);
+        } else {
+            tsk_error_reset();
+            fs->inode_walk(fs, self->next_inum, last, self->flags,
+                           inode_walk_callback, (void *)self->inodes);
+            /* as with walk, a bad range should not kill the whole walk */
+            if(tsk_errno)
+                tsk_error_reset();
+        }
+
+        /* the range is done even if it was empty */
+        self->next_inum = last + 1;
+    }
+
+    result = PyList_GET_ITEM(self->inodes, self->pos);
+    self->pos++;
+    Py_INCREF(result);
+    return result;
+}
+
+static PyObject *skfs_iwalkiter_getnext(skfs_iwalkiter *self, void *closure) {
+    /* inodes left over from the current batch come first */
+    if(self->inodes && self->pos < PyList_GET_SIZE(self->inodes)) {
+        skfs_inode *next = (skfs_inode *)PyList_GET_ITEM(self->inodes, self->pos);
+        return PyLong_FromUnsignedLongLong(next->inode);
+    }
+    return PyLong_FromUnsignedLongLong(self->next_inum);
+}
+
 /************** SKTSK_FS_INODE **********/
 static int skfs_inode_init(skfs_inode *self, PyObject *args, PyObject *kwds) {
     static char *kwlist[] = {"inode", "type", "id", "alloc", NULL};
@@ -1176,12 +2160,17 @@ skfile_init(skfile *self, PyObject *args, PyObject *kwds) {
      * which will give us the default data attribute). size will also be set
      * during the walk */
 
-    flags = TSK_FS_FILE_FLAG_AONLY | TSK_FS_FILE_FLAG_RECOVER | TSK_FS_FILE_FLAG_NOSPARSE;
+    flags = TSK_FS_FILE_FLAG_AONLY | TSK_FS_FILE_FLAG_RECOVER;
     if(self->id == 0)
         flags |= TSK_FS_FILE_FLAG_NOID;
 
     self->blocks = talloc(self->context, struct block);
     INIT_LIST_HEAD(&self->blocks->list);
+
+    /* compressed data can not be read straight from the disk */
+    self->runs = NULL;
+    self->nruns = 0;
+    self->runs_valid = !(self->fs_inode->flags & TSK_FS_INODE_FLAG_COMP);
     tsk_error_reset();
     fs->file_walk(fs, self->fs_inode, self->type, self->id, flags,
                  getblocks_walk_callback, (void *)self);
@@ -1205,6 +2194,70 @@ skfile_str(skfile *self) {
     return result;
 }
 
+/* find the run containing a file offset, or -1 if there is none */
+static int
+skfile_find_run(skfile *self, uint64_t offset) {
+    int lo = 0, hi = self->nruns - 1;
+
+    while(lo <= hi) {
+        int mid = (lo + hi) / 2;
+        struct skfile_run *r = &self->runs[mid];
+
+        if(offset < r->offset)
+            hi = mid - 1;
+        else if(offset >= r->offset + r->len)
+            lo = mid + 1;
+        else
+            return mid;
+    }
+    return -1;
+}
+
+/* read file data using the run list. Returns bytes read or -1 on error with
+ * the tsk error set */
+static ssize_t
+skfile_read_runs(skfile *self, TSK_FS_INFO *fs, uint64_t offset, size_t len, char *buf) {
+    size_t done = 0;
+    int i = skfile_find_run(self, offset);
+
+    if(i < 0)
+        return 0;
+
+    for(; i < self->nruns && done < len; i++) {
+        struct skfile_run *r = &self->runs[i];
+        uint64_t run_off = offset + done - r->offset;
+        size_t count = r->len - run_off;
+
+        if(count > len - done)
+            count = len - done;
+
+        if(r->flags & SK_RUN_SPARSE) {
+            memset(buf + done, 0, count);
+        } else {
+            ssize_t cnt;
+
+            if(r->addr + (run_off + count - 1) / fs->block_size > fs->last_block_act) {
+                tsk_error_reset();
+                tsk_errno = TSK_ERR_FS_READ;
+                snprintf(tsk_errstr, TSK_ERRSTR_L,
+                         "skfile_read: Address is too large for partial image: %" PRIuDADDR ")",
+                         r->addr);
+                return -1;
+            }
+
+            cnt = tsk_fs_read_random(fs, buf + done, count,
+                                     (TSK_OFF_T)r->addr * fs->block_size + run_off);
+            if(cnt < 0)
+                return -1;
+            if(cnt < count)
+                return done + cnt;
+        }
+        done += count;
+    }
+
+    return done;
+}
+
 static PyObject *
 skfile_read(skfile *self, PyObject *args, PyObject *kwds) {
     char *buf;
@@ -1218,7 +2271,7 @@ skfile_read(skfile *self, PyObject *args, PyObject *kwds) {
     fs = ((skfs *)self->skfs)->fs;
 
     static char *kwlist[] = {"size", "slack", "overread", NULL};
-    if(!PyArg_ParseTupleAndKeywords(args, kwds, "|iii", kwlist, 
+    if(!PyArg_ParseTupleAndKeywords(args, kwds, "|nii", kwlist, 
                                     &readlen, &slack, &overread))
         return NULL; 
 
@@ -1260,7 +2313,10 @@ skfile_read(skfile *self, PyObject *args, PyObject *kwds) {
     
     buf = PyString_AsString(retdata);
 
-    if(self->type == 0 && self->id == 0)
+    tsk_error_reset();
+    if(self->runs_valid && !slack)
+        written = skfile_read_runs(self, fs, self->readptr, readlen, buf);
+    else if(self->type == 0 && self->id == 0)
         if(slack)
             written = tsk_fs_read_file_noid_slack(fs, self->fs_inode, self->readptr, readlen, buf);
         else
@@ -1271,6 +2327,12 @@ skfile_read(skfile *self, PyObject *args, PyObject *kwds) {
         else
             written = tsk_fs_read_file(fs, self->fs_inode, self->type, self->id, self->readptr, readlen, buf);
 
+    if(written < 0) {
+        char *error = error_get();
+        Py_DECREF(retdata);
+        return PyErr_Format(PyExc_IOError, "Unable to read file: %s", error);
+    }
+
     /* perform overread if necessary have to use direct block IO for this */
     if(slack && overread && written < readlen) {
         TSK_DADDR_T last_block = 0;
@@ -1391,6 +2453,45 @@ skfile_blocks(skfile *self) {
     return list;
 }
 
+/* Returns the runs collected by the file walk in skfile_init, one tuple per
+ * contiguous extent rather than one entry per block */
+static PyObject *
+skfile_runs(skfile *self) {
+    TSK_FS_INFO *fs;
+    PyObject *list, *tmp;
+    int i;
+
+    if(!self->runs_valid)
+        return PyErr_Format(PyExc_IOError,
+                            "File data is resident or compressed and has no disk extents");
+
+    fs = ((skfs *) self->skfs)->fs;
+
+    list = PyList_New(self->nruns);
+    if(!list)
+        return NULL;
+
+    for(i = 0; i < self->nruns; i++) {
+        struct skfile_run *r = &self->runs[i];
+
+        if(r->flags & SK_RUN_SPARSE)
+            tmp = Py_BuildValue("(KOKi)", (unsigned long long)r->offset, Py_None,
+                                (unsigned long long)r->len, r->flags);
+        else
+            tmp = Py_BuildValue("(KKKi)", (unsigned long long)r->offset,
+                                (unsigned long long)(fs->offset + r->addr * fs->block_size),
+                                (unsigned long long)r->len, r->flags);
+        if(!tmp) {
+            Py_DECREF(list);
+            return NULL;
+        }
+
+        PyList_SET_ITEM(list, i, tmp);
+    }
+
+    return list;
+}
+
 static PyObject *
 skfile_close(skfile *self) {
   Py_RETURN_NONE;
@@ -1511,6 +2612,15 @@ initsk(void)
 
     Py_INCREF(&skfs_walkiterType);
 
+    /* setup skfs_iwalkiter type */
+    skfs_iwalkiterType.tp_new = PyType_GenericNew;
+    skfs_iwalkiterType.tp_iter = PyObject_SelfIter;
+
+    if (PyType_Ready(&skfs_iwalkiterType) < 0)
+        return;
+
+    Py_INCREF(&skfs_iwalkiterType);
+
     /* setup inode type */
     skfs_inodeType.tp_new = PyType_GenericNew;
     if (PyType_Ready(&skfs_inodeType) < 0)
@@ -1526,4 +2636,7 @@ initsk(void)
 
     Py_INCREF(&skfileType);
     PyModule_AddObject(m, "skfile", (PyObject *)&skfileType);
+
+    /* flags returned by skfile.runs() */
+    PyModule_AddIntConstant(m, "RUN_SPARSE", SK_RUN_SPARSE);
 }
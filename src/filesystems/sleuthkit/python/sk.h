@@ -7,6 +7,7 @@
 #include "talloc.h"
 //#include "fs_tools.h"
 #include "tsk/libtsk.h"
+#include "pyimgread.h"
 
 /******************************************************************
  * Helpers and SK integration stuff
@@ -25,14 +26,49 @@ struct dentwalk {
     uint32_t id;
     char alloc;
     struct list_head list;
+    struct dentwalk *children;  // listing of this directory if read ahead
 };
 
 /* implements an sk img subsystem */
 typedef struct {
 	TSK_IMG_INFO img_info;
     PyObject *fileobj;
+    /* set when fileobj exports a C level reader (see pyimgread.h), in
+     * which case we never call back into python for reads */
+    struct pyimgread *reader;
 } IMG_PYFILE_INFO;
 
+/* images are shared between skfs objects which open the same python
+ * file object, so that they all use the same page cache */
+struct shared_img {
+    void *key;
+    TSK_IMG_INFO *img;
+    int refs;
+    struct list_head list;
+};
+
+TSK_IMG_INFO *shared_img_open(PyObject *fileobj, size_t cache_size);
+void shared_img_ref(TSK_IMG_INFO *img);
+void shared_img_close(TSK_IMG_INFO *img);
+
+/* default size of the image page cache in bytes */
+#define SK_IMG_CACHE_SIZE   (8 * 1024 * 1024)
+
+/* limits for the number of threads skfs.walk and skfs.iwalk may use, and how many
+ * directories each thread reads ahead at a time */
+#define SK_WALK_MAX_THREADS 64
+#define SK_WALK_READAHEAD   8
+
+/* an img layer which takes the GIL around reads of the image below it, so
+ * that filesystems opened on it can be used from threads */
+typedef struct {
+    TSK_IMG_INFO img_info;
+    TSK_IMG_INFO *parent;
+} IMG_GIL_INFO;
+
+/* default number of inodes skfs.iwalk asks the filesystem for at a time */
+#define SK_IWALK_BATCH      4096
+
 /* tracks block lists */
 struct block {
     TSK_DADDR_T addr;
@@ -40,6 +76,17 @@ struct block {
     struct list_head list;
 };
 
+/* a contiguous run of file data, used to map file offsets to disk without
+ * walking the file again on every read */
+#define SK_RUN_SPARSE   0x1     // run is all zeros and has no disk address
+
+struct skfile_run {
+    uint64_t offset;            // offset in the file
+    TSK_DADDR_T addr;           // first filesystem block
+    uint64_t len;               // length in bytes
+    int flags;
+};
+
 /* callback functions for dent_walk, populate a file list */
 static TSK_WALK_RET_ENUM
 listdent_walk_callback_dent(TSK_FS_INFO *fs, TSK_FS_DENT *fs_dent, void *ptr);
@@ -52,7 +99,26 @@ getblocks_walk_callback(TSK_FS_INFO *fs, TSK_DADDR_T addr, char *buf, size_t siz
 
 /* lookup an inode from a path */
 TSK_INUM_T lookup_inode(TSK_FS_INFO *fs, char *path);
-int lookup_path(TSK_FS_INFO *fs, struct dentwalk *dent);
+
+/* Maps inodes to their parent directory and name. This is built by a
+ * single walk of the filesystem the first time lookup_path is called,
+ * so later lookups only need to follow the parents up to the root.
+ * NTFS does not use the map, ntfs_find_file is fast there and also
+ * finds deleted and orphan files. */
+struct inode_name {
+    TSK_INUM_T inode;
+    TSK_INUM_T parent;          // 0 if the parent is not known
+    size_t name;                // offset of the name in inode_map.names
+};
+
+struct inode_map {
+    struct inode_name *entries; // sorted by inode once built
+    size_t count;
+    size_t size;
+    char *names;                // all names, each NUL terminated
+    size_t names_len;
+    size_t names_size;
+};
 
 /******************************************************************
  * SKFS - Sleuthkit Filesystem Python Type
@@ -68,8 +134,12 @@ typedef struct {
     unsigned long long first_block;
     unsigned long long last_block;
     PyObject *root_inum;
+    struct inode_map *inode_map;
+    int inode_map_failed;       // the walk failed, look paths up one by one
 } skfs;
 
+int lookup_path(skfs *self, struct dentwalk *dent);
+
 static void skfs_dealloc(skfs *self);
 static PyObject *skfs_close(skfs *self);
 static int skfs_init(skfs *self, PyObject *args, PyObject *kwds);
@@ -80,6 +150,8 @@ static PyObject *skfs_iwalk(skfs *self, PyObject *args, PyObject *kwds);
 static PyObject *skfs_stat(skfs *self, PyObject *args, PyObject *kwds);
 static PyObject *skfs_fstat(skfs *self, PyObject *args);
 static PyObject *skfs_readlink(skfs *self, PyObject *args, PyObject *kwds);
+static PyObject *skfs_cache_stats(skfs *self);
+static PyObject *skfs_path(skfs *self, PyObject *args, PyObject *kwds);
 
 static PyMemberDef skfs_members[] = {
     {"root_inum", T_OBJECT, offsetof(skfs, root_inum), 0,
@@ -103,13 +175,17 @@ static PyMethodDef skfs_methods[] = {
     {"walk", (PyCFunction)skfs_walk, METH_VARARGS|METH_KEYWORDS,
      "Walk filesystem from the given path" },
     {"iwalk", (PyCFunction)skfs_iwalk, METH_VARARGS|METH_KEYWORDS,
-     "Walk inodes" },
+     "Iterate over inodes" },
     {"stat", (PyCFunction)skfs_stat, METH_VARARGS|METH_KEYWORDS,
      "Stat a file path" },
     {"fstat", (PyCFunction)skfs_fstat, METH_VARARGS,
      "Stat a skfile" },
     {"readlink", (PyCFunction)skfs_readlink, METH_VARARGS|METH_KEYWORDS,
      "Resolve a symlink" },
+    {"cache_stats", (PyCFunction)skfs_cache_stats, METH_NOARGS,
+     "Return the image page cache counters" },
+    {"path", (PyCFunction)skfs_path, METH_VARARGS|METH_KEYWORDS,
+     "Return the path of an inode (or None)" },
     {NULL}  /* Sentinel */
 };
 
@@ -166,6 +242,9 @@ typedef struct {
     int flags;
     int myflags;
     void *context;
+    /* parallel walks: each thread gets its own filesystem */
+    int threads;
+    TSK_FS_INFO **fs;
 } skfs_walkiter;
 
 static void skfs_walkiter_dealloc(skfs_walkiter *self);
@@ -215,6 +294,86 @@ static PyTypeObject skfs_walkiterType = {
     0,                         /* tp_new */
 };
 
+/******************************************************************
+ * SKFSIWalkIter - Support the skfs.iwalk iterator
+ * ***************************************************************/
+
+typedef struct {
+    PyObject_HEAD
+    skfs *skfs;
+    int flags;
+    int batch;
+    TSK_INUM_T next_inum;   // first inode of the next batch to walk
+    TSK_INUM_T end_inum;    // last inode to walk
+    PyObject *inodes;       // current batch of skfs_inode objects
+    Py_ssize_t pos;         // next item of inodes to return
+    /* parallel walks: each thread walks part of the batch on its own
+     * filesystem */
+    int threads;
+    TSK_FS_INFO **fs;
+    void *context;
+} skfs_iwalkiter;
+
+static void skfs_iwalkiter_dealloc(skfs_iwalkiter *self);
+static int skfs_iwalkiter_init(skfs_iwalkiter *self, PyObject *args, PyObject *kwds);
+static PyObject *skfs_iwalkiter_iternext(skfs_iwalkiter *self);
+
+static PyObject *skfs_iwalkiter_getnext(skfs_iwalkiter *self, void *closure);
+
+static PyMemberDef skfs_iwalkiter_members[] = {
+    {"end_inum", T_ULONGLONG, offsetof(skfs_iwalkiter, end_inum), READONLY,
+     "last inode to walk"},
+    {NULL}  /* Sentinel */
+};
+
+static PyGetSetDef skfs_iwalkiter_getseters[] = {
+    {"next_inum", (getter)skfs_iwalkiter_getnext, NULL,
+     "first inode not yet returned (pass as inode to resume the walk)", NULL},
+    {NULL}  /* Sentinel */
+};
+
+static PyTypeObject skfs_iwalkiterType = {
+    PyObject_HEAD_INIT(NULL)
+    0,                         /* ob_size */
+    "sk.skfs_iwalkiter",       /* tp_name */
+    sizeof(skfs_iwalkiter),    /* tp_basicsize */
+    0,                         /* tp_itemsize */
+    (destructor)skfs_iwalkiter_dealloc, /* tp_dealloc */
+    0,                         /* tp_print */
+    0,                         /* tp_getattr */
+    0,                         /* tp_setattr */
+    0,                         /* tp_compare */
+    0,                         /* tp_repr */
+    0,                         /* tp_as_number */
+    0,                         /* tp_as_sequence */
+    0,                         /* tp_as_mapping */
+    0,                         /* tp_hash */
+    0,                         /* tp_call */
+    0,                         /* tp_str */
+    0,                         /* tp_getattro */
+    0,                         /* tp_setattro */
+    0,                         /* tp_as_buffer */
+    Py_TPFLAGS_DEFAULT,        /* tp_flags */
+    "Sleuthkit Filesystem Inode Walk Iterator Object", /* tp_doc */
+    0,	                       /* tp_traverse */
+    0,                         /* tp_clear */
+    0,                         /* tp_richcompare */
+    0,                         /* tp_weaklistoffset */
+    0,                         /* tp_iter */
+    (iternextfunc)skfs_iwalkiter_iternext, /* tp_iternext */
+    0,                         /* tp_methods */
+    skfs_iwalkiter_members,    /* tp_members */
+    skfs_iwalkiter_getseters,  /* tp_getset */
+    0,                         /* tp_base */
+    0,                         /* tp_dict */
+    0,                         /* tp_descr_get */
+    0,                         /* tp_descr_set */
+    0,                         /* tp_dictoffset */
+    (initproc)skfs_iwalkiter_init, /* tp_init */
+    0,                         /* tp_alloc */
+    0,                         /* tp_new */
+};
+
 /******************************************************************
  * A very simple type to represent an inode
  * ***************************************************************/
@@ -328,6 +487,11 @@ typedef struct {
 	uint32_t type;
 	uint32_t id;
     struct block *blocks;
+    struct skfile_run *runs;
+    int nruns;
+    /* set if reads can be serviced from runs, otherwise we ask TSK to walk
+     * the file (resident and compressed data) */
+    int runs_valid;
     uint64_t readptr;
     uint64_t size;
 } skfile;
@@ -339,6 +503,7 @@ static PyObject *skfile_read(skfile *self, PyObject *args, PyObject *kwds);
 static PyObject *skfile_seek(skfile *self, PyObject *args, PyObject *kwds);
 static PyObject *skfile_tell(skfile *self);
 static PyObject *skfile_blocks(skfile *self);
+static PyObject *skfile_runs(skfile *self);
 static PyObject *skfile_close(skfile *self);
 
 static PyMethodDef skfile_methods[] = {
@@ -350,6 +515,9 @@ static PyMethodDef skfile_methods[] = {
      "Return possition within file" },
     {"blocks", (PyCFunction)skfile_blocks, METH_NOARGS,
      "Return a list of blocks which the file occupies" },
+    {"runs", (PyCFunction)skfile_runs, METH_NOARGS,
+     "Return a list of (file_offset, disk_offset, length, flags) extents. "
+     "disk_offset is a byte offset in the image, or None for sparse runs" },
     {"close", (PyCFunction)skfile_close, METH_NOARGS,
      "Close the file" },
     {NULL}  /* Sentinel */
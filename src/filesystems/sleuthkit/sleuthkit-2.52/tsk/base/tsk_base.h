@@ -193,10 +193,20 @@ typedef enum {
 #define TSK_ERRSTR_L	512
 #define TSK_ERRSTR_PR_L	(TSK_ERRSTR_L << 2)
 
-    extern uint32_t tsk_errno;
-    extern char tsk_errstr[TSK_ERRSTR_L];
-    extern char tsk_errstr2[TSK_ERRSTR_L];
-    extern char tsk_errstr_print[TSK_ERRSTR_PR_L];
+/* The error state is kept per thread so that separate TSK_FS_INFO
+ * structures can be used from different threads at the same time */
+#if defined(_MSC_VER)
+#define TSK_THREAD_LOCAL __declspec(thread)
+#elif defined(__GNUC__)
+#define TSK_THREAD_LOCAL __thread
+#else
+#define TSK_THREAD_LOCAL
+#endif
+
+    extern TSK_THREAD_LOCAL uint32_t tsk_errno;
+    extern TSK_THREAD_LOCAL char tsk_errstr[TSK_ERRSTR_L];
+    extern TSK_THREAD_LOCAL char tsk_errstr2[TSK_ERRSTR_L];
+    extern TSK_THREAD_LOCAL char tsk_errstr_print[TSK_ERRSTR_PR_L];
 
     extern const char *tsk_error_get();
     extern void tsk_error_print(FILE *);
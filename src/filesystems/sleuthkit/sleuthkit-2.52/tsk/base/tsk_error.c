@@ -21,8 +21,8 @@
 char *progname = "unknown";
 int tsk_verbose = 0;
 
-uint32_t tsk_errno = 0;         /* Set when an error occurs */
-char tsk_errstr[TSK_ERRSTR_L];  /* Contains an error-specific string
+TSK_THREAD_LOCAL uint32_t tsk_errno = 0;         /* Set when an error occurs */
+TSK_THREAD_LOCAL char tsk_errstr[TSK_ERRSTR_L];  /* Contains an error-specific string
                                  * and is valid only when tsk_errno is set 
                                  *
                                  * This should be set when errno is set,
@@ -30,7 +30,7 @@ char tsk_errstr[TSK_ERRSTR_L];  /* Contains an error-specific string
                                  * tsk_errstr[0] to '\0'.
                                  * */
 
-char tsk_errstr2[TSK_ERRSTR_L]; /* Contains a caller-specific string 
+TSK_THREAD_LOCAL char tsk_errstr2[TSK_ERRSTR_L]; /* Contains a caller-specific string 
                                  * and is valid only when tsk_errno is set 
                                  *
                                  * This is typically set to start with a NULL
@@ -44,7 +44,7 @@ char tsk_errstr2[TSK_ERRSTR_L]; /* Contains a caller-specific string
                                  * called in the first place
                                  */
 
-char tsk_errstr_print[TSK_ERRSTR_PR_L];
+TSK_THREAD_LOCAL char tsk_errstr_print[TSK_ERRSTR_PR_L];
 
 const char *tsk_err_aux_str[TSK_ERR_IMG_MAX] = {
     "Insufficient memory",
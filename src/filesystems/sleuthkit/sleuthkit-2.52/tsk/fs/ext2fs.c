@@ -32,6 +32,47 @@
 #include "tsk_fs_i.h"
 #include "tsk_ext2fs.h"
 
+/* ext2fs_group_table_load - read all group descriptors into one buffer
+ *
+ * The table is small (32 bytes per group), so keeping it around saves a
+ * read every time a walk or lookup moves to another group.  
+ *
+ * return 1 if the table could not be loaded (the caller then reads
+ * single descriptors) and 0 on success
+ * */
+static uint8_t
+ext2fs_group_table_load(EXT2FS_INFO * ext2fs)
+{
+    TSK_FS_INFO *fs = (TSK_FS_INFO *) ext2fs;
+    size_t len;
+    ssize_t cnt;
+
+    ext2fs->grp_table_tried = 1;
+
+    len = (size_t) ext2fs->groups_count * sizeof(ext2fs_gd);
+    if ((len == 0) || (len > EXT2FS_GRP_TABLE_MAX))
+        return 1;
+
+    if ((ext2fs->grp_table =
+            (ext2fs_gd *) talloc_size(ext2fs, len)) == NULL) {
+        return 1;
+    }
+
+    cnt = tsk_fs_read_random(fs, (char *) ext2fs->grp_table, len,
+        ext2fs->groups_offset);
+    if (cnt != (ssize_t) len) {
+        if (tsk_verbose)
+            tsk_fprintf(stderr,
+                "ext2fs_group_table_load: short read of group descriptor table, using single reads\n");
+        talloc_free(ext2fs->grp_table);
+        ext2fs->grp_table = NULL;
+        tsk_error_reset();
+        return 1;
+    }
+
+    return 0;
+}
+
 /* ext2fs_group_load - load block group descriptor into cache 
  *
  * return 1 on error and 0 on success
@@ -57,34 +98,40 @@ ext2fs_group_load(EXT2FS_INFO * ext2fs, EXT2_GRPNUM_T grp_num)
         return 1;
     }
 
-
-    if (ext2fs->grp_buf == NULL) {
-        if ((ext2fs->grp_buf = talloc(ext2fs, ext2fs_gd)) == NULL) {
-            return 1;
-        }
-    }
-    else if (ext2fs->grp_num == grp_num) {
+    if ((ext2fs->grp_buf != NULL) && (ext2fs->grp_num == grp_num)) {
         return 0;
     }
 
-    gd = ext2fs->grp_buf;
+    if (ext2fs->grp_table_tried == 0)
+        ext2fs_group_table_load(ext2fs);
 
-    /*
-     * We're not reading group descriptors often, so it is OK to do small
-     * reads instead of cacheing group descriptors in a large buffer.
-     */
     offs = ext2fs->groups_offset + grp_num * sizeof(ext2fs_gd);
-    cnt = tsk_fs_read_random(&ext2fs->fs_info, (char *) gd,
-        sizeof(ext2fs_gd), offs);
-    if (cnt != sizeof(ext2fs_gd)) {
-        if (cnt >= 0) {
-            tsk_error_reset();
-            tsk_errno = TSK_ERR_FS_READ;
+
+    if (ext2fs->grp_table != NULL) {
+        gd = &ext2fs->grp_table[grp_num];
+    }
+    else {
+        /* The table was too large or could not be read, so fall back
+         * to reading just the one descriptor */
+        if (ext2fs->grp_buf == NULL) {
+            if ((ext2fs->grp_buf = talloc(ext2fs, ext2fs_gd)) == NULL) {
+                return 1;
+            }
+        }
+        gd = ext2fs->grp_buf;
+
+        cnt = tsk_fs_read_random(&ext2fs->fs_info, (char *) gd,
+            sizeof(ext2fs_gd), offs);
+        if (cnt != sizeof(ext2fs_gd)) {
+            if (cnt >= 0) {
+                tsk_error_reset();
+                tsk_errno = TSK_ERR_FS_READ;
+            }
+            snprintf(tsk_errstr2, TSK_ERRSTR_L,
+                "ext2fs_group_load: Group descriptor %" PRI_EXT2GRP
+                " at %" PRIuOFF, grp_num, offs);
+            return 1;
         }
-        snprintf(tsk_errstr2, TSK_ERRSTR_L,
-            "ext2fs_group_load: Group descriptor %" PRI_EXT2GRP " at %"
-            PRIuOFF, grp_num, offs);
-        return 1;
     }
 
 
@@ -104,6 +151,7 @@ ext2fs_group_load(EXT2FS_INFO * ext2fs, EXT2_GRPNUM_T grp_num)
     }
 
 
+    ext2fs->grp_buf = gd;
     ext2fs->grp_num = grp_num;
 
     if (tsk_verbose) {
@@ -135,6 +183,136 @@ ext2fs_print_map(uint8_t * map, int len)
 }
 
 
+/* ext2fs_map_load - find a block (inode == 0) or inode (inode == 1) 
+ * bitmap in the bitmap cache and read it on a miss.
+ *
+ * A miss also reads the bitmaps of the following groups if they are 
+ * stored in the next blocks on disk (as mke2fs and flex_bg lay them
+ * out), so a walk over many groups needs few reads.
+ *
+ * TTL is 0 if the entry has not been used.  TTL of 1 means it was the
+ * most recently used, and TTL of EXT2FS_MAP_CACHE_N means it was the 
+ * least recently used.  This is the same LRU as the FAT cache.
+ *
+ * return NULL on error or the group's bitmap on success
+ * */
+static uint8_t *
+ext2fs_map_load(EXT2FS_INFO * ext2fs, EXT2FS_MAP_CACHE * cache,
+    EXT2_GRPNUM_T grp_num, uint8_t inode)
+{
+    TSK_FS_INFO *fs = (TSK_FS_INFO *) & ext2fs->fs_info;
+    EXT2_GRPNUM_T grp_cnt;
+    TSK_DADDR_T addr;
+    ssize_t cnt;
+    int i, cidx;
+
+    // see if we already have it in the cache
+    for (i = 0; i < EXT2FS_MAP_CACHE_N; i++) {
+        if ((cache[i].ttl > 0) &&
+            (grp_num >= cache[i].grp_num) &&
+            (grp_num < cache[i].grp_num + cache[i].grp_cnt)) {
+            int a;
+
+            // update the TTLs to push i to the front
+            for (a = 0; a < EXT2FS_MAP_CACHE_N; a++) {
+                if (cache[a].ttl == 0)
+                    continue;
+
+                if (cache[a].ttl < cache[i].ttl)
+                    cache[a].ttl++;
+            }
+            cache[i].ttl = 1;
+            return &cache[i].buf[(size_t) (grp_num -
+                    cache[i].grp_num) * fs->block_size];
+        }
+    }
+
+    /* The group load does the sanity check on the bitmap location */
+    if (ext2fs_group_load(ext2fs, grp_num)) {
+        return NULL;
+    }
+
+    addr = (TSK_DADDR_T) tsk_getu32(fs->endian, inode ?
+        ext2fs->grp_buf->bg_inode_bitmap :
+        ext2fs->grp_buf->bg_block_bitmap);
+
+    /* See how many of the following groups have their bitmap in the
+     * next block */
+    grp_cnt = 1;
+    if (ext2fs->grp_table != NULL) {
+        while ((grp_cnt < EXT2FS_MAP_CACHE_G) &&
+            (grp_num + grp_cnt < ext2fs->groups_count) &&
+            (addr + grp_cnt <= fs->last_block_act)) {
+            ext2fs_gd *gd = &ext2fs->grp_table[grp_num + grp_cnt];
+
+            if ((TSK_DADDR_T) tsk_getu32(fs->endian, inode ?
+                    gd->bg_inode_bitmap : gd->bg_block_bitmap) !=
+                addr + grp_cnt)
+                break;
+            grp_cnt++;
+        }
+    }
+
+    // Look for an unused entry or an entry with a TTL of EXT2FS_MAP_CACHE_N
+    cidx = 0;
+    for (i = 0; i < EXT2FS_MAP_CACHE_N; i++) {
+        if ((cache[i].ttl == 0) || (cache[i].ttl >= EXT2FS_MAP_CACHE_N)) {
+            cidx = i;
+        }
+    }
+
+    if (cache[cidx].buf == NULL) {
+        if ((cache[cidx].buf =
+                (uint8_t *) talloc_size(ext2fs,
+                    EXT2FS_MAP_CACHE_G * fs->block_size)) == NULL) {
+            return NULL;
+        }
+    }
+
+    // the entry's contents are gone from here on
+    cache[cidx].grp_cnt = 0;
+
+    cnt = tsk_fs_read_block_nobuf(fs, (char *) cache[cidx].buf,
+        grp_cnt * fs->block_size, addr);
+
+    // fall back to only the bitmap that was asked for
+    if ((cnt != (ssize_t) (grp_cnt * fs->block_size)) && (grp_cnt > 1)) {
+        grp_cnt = 1;
+        cnt = tsk_fs_read_block_nobuf(fs, (char *) cache[cidx].buf,
+            fs->block_size, addr);
+    }
+
+    if (cnt != (ssize_t) (grp_cnt * fs->block_size)) {
+        if (cnt >= 0) {
+            tsk_error_reset();
+            tsk_errno = TSK_ERR_FS_READ;
+        }
+        snprintf(tsk_errstr2, TSK_ERRSTR_L,
+            "ext2fs_map_load: %s bitmap group %" PRI_EXT2GRP " at %"
+            PRIuDADDR, inode ? "Inode" : "Block", grp_num, addr);
+        return NULL;
+    }
+
+    // update the TTLs
+    if (cache[cidx].ttl == 0)   // special case for unused entry
+        cache[cidx].ttl = EXT2FS_MAP_CACHE_N + 1;
+
+    for (i = 0; i < EXT2FS_MAP_CACHE_N; i++) {
+        if (cache[i].ttl == 0)
+            continue;
+
+        if (cache[i].ttl < cache[cidx].ttl)
+            cache[i].ttl++;
+    }
+
+    cache[cidx].ttl = 1;
+    cache[cidx].grp_num = grp_num;
+    cache[cidx].grp_cnt = grp_cnt;
+
+    return cache[cidx].buf;
+}
+
+
 /* ext2fs_bmap_load - look up block bitmap & load into cache 
  *
  * return 1 on error and 0 on success
@@ -143,10 +321,11 @@ static uint8_t
 ext2fs_bmap_load(EXT2FS_INFO * ext2fs, EXT2_GRPNUM_T grp_num)
 {
     TSK_FS_INFO *fs = (TSK_FS_INFO *) & ext2fs->fs_info;
-    ssize_t cnt;
+    uint8_t *map;
 
     /*
      * Look up the group descriptor info.  The load will do the sanity check.
+     * Callers expect grp_buf to describe this group afterwards.
      */
     if ((ext2fs->grp_buf == NULL) || (ext2fs->grp_num != grp_num)) {
         if (ext2fs_group_load(ext2fs, grp_num)) {
@@ -154,44 +333,15 @@ ext2fs_bmap_load(EXT2FS_INFO * ext2fs, EXT2_GRPNUM_T grp_num)
         }
     }
 
-    if (ext2fs->bmap_buf == NULL) {
-        if ((ext2fs->bmap_buf =
-                (uint8_t *) talloc_size(ext2fs, fs->block_size)) == NULL) {
-            return 1;
-        }
-    }
-    else if (ext2fs->bmap_grp_num == grp_num)
+    if ((ext2fs->bmap_buf != NULL) && (ext2fs->bmap_grp_num == grp_num))
         return 0;
 
-    /*
-     * Look up the block allocation bitmap.
-     */
-    if (tsk_getu32(fs->endian,
-            ext2fs->grp_buf->bg_block_bitmap) > fs->last_block) {
-        tsk_error_reset();
-        tsk_errno = TSK_ERR_FS_BLK_NUM;
-        snprintf(tsk_errstr, TSK_ERRSTR_L,
-            "ext2fs_bmap_load: Block too large for image: %" PRIu32
-            "", tsk_getu32(fs->endian, ext2fs->grp_buf->bg_block_bitmap));
+    if ((map = ext2fs_map_load(ext2fs, ext2fs->bmap_cache, grp_num,
+                0)) == NULL) {
         return 1;
     }
 
-    cnt = tsk_fs_read_block_nobuf(fs, (char *) ext2fs->bmap_buf,
-        ext2fs->fs_info.block_size,
-        (TSK_DADDR_T) tsk_getu32(fs->endian,
-            ext2fs->grp_buf->bg_block_bitmap));
-
-    if (cnt != ext2fs->fs_info.block_size) {
-        if (cnt >= 0) {
-            tsk_error_reset();
-            tsk_errno = TSK_ERR_FS_READ;
-        }
-        snprintf(tsk_errstr2, TSK_ERRSTR_L,
-            "ext2fs_bmap_load: Bitmap group %" PRI_EXT2GRP " at %"
-            PRIu32, grp_num, tsk_getu32(fs->endian,
-                ext2fs->grp_buf->bg_block_bitmap));
-    }
-
+    ext2fs->bmap_buf = map;
     ext2fs->bmap_grp_num = grp_num;
 
     if (tsk_verbose > 1)
@@ -210,7 +360,7 @@ static uint8_t
 ext2fs_imap_load(EXT2FS_INFO * ext2fs, EXT2_GRPNUM_T grp_num)
 {
     TSK_FS_INFO *fs = (TSK_FS_INFO *) & ext2fs->fs_info;
-    ssize_t cnt;
+    uint8_t *map;
 
     /*
      * Look up the group descriptor info.
@@ -221,46 +371,17 @@ ext2fs_imap_load(EXT2FS_INFO * ext2fs, EXT2_GRPNUM_T grp_num)
         }
     }
 
-    /* Allocate the cache buffer and exit if map is already loaded */
-    if (ext2fs->imap_buf == NULL) {
-        if ((ext2fs->imap_buf =
-                (uint8_t *) talloc_size(ext2fs, fs->block_size)) == NULL) {
-            return 1;
-        }
-    }
-    else if (ext2fs->imap_grp_num == grp_num) {
+    /* Exit if map is already loaded */
+    if ((ext2fs->imap_buf != NULL) && (ext2fs->imap_grp_num == grp_num)) {
         return 0;
     }
 
-    /*
-     * Look up the inode allocation bitmap.
-     */
-    if (tsk_getu32(fs->endian,
-            ext2fs->grp_buf->bg_inode_bitmap) > fs->last_block) {
-        tsk_error_reset();
-        tsk_errno = TSK_ERR_FS_BLK_NUM;
-        snprintf(tsk_errstr, TSK_ERRSTR_L,
-            "ext2fs_imap_load: Block too large for image: %" PRIu32
-            "", tsk_getu32(fs->endian, ext2fs->grp_buf->bg_inode_bitmap));
-    }
-
-    cnt = tsk_fs_read_block_nobuf(fs,
-        (char *) ext2fs->imap_buf,
-        ext2fs->fs_info.block_size,
-        (TSK_DADDR_T) tsk_getu32(fs->endian,
-            ext2fs->grp_buf->bg_inode_bitmap));
-
-    if (cnt != ext2fs->fs_info.block_size) {
-        if (cnt >= 0) {
-            tsk_error_reset();
-            tsk_errno = TSK_ERR_FS_READ;
-        }
-        snprintf(tsk_errstr2, TSK_ERRSTR_L,
-            "ext2fs_imap_load: Inode bitmap %" PRI_EXT2GRP " at %"
-            PRIu32, grp_num, tsk_getu32(fs->endian,
-                ext2fs->grp_buf->bg_inode_bitmap));
+    if ((map = ext2fs_map_load(ext2fs, ext2fs->imap_cache, grp_num,
+                1)) == NULL) {
+        return 1;
     }
 
+    ext2fs->imap_buf = map;
     ext2fs->imap_grp_num = grp_num;
     if (tsk_verbose > 1)
         ext2fs_print_map(ext2fs->imap_buf,
@@ -2446,6 +2567,12 @@ ext2fs_open(TSK_IMG_INFO * img_info, TSK_OFF_T offset,
     /* group descriptor */
     ext2fs->grp_buf = NULL;
     ext2fs->grp_num = 0xffffffff;
+    ext2fs->grp_table = NULL;
+    ext2fs->grp_table_tried = 0;
+
+    /* bitmap caches */
+    memset(ext2fs->bmap_cache, 0, sizeof(ext2fs->bmap_cache));
+    memset(ext2fs->imap_cache, 0, sizeof(ext2fs->imap_cache));
 
     fs->list_inum_named = NULL;
 
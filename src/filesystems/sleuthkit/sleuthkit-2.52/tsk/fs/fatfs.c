@@ -132,6 +132,128 @@ getFATCacheIdx(FATFS_INFO * fatfs, TSK_DADDR_T sect)
 }
 
 
+/*
+ * Read the whole FAT and decode it into fatfs->table, so that getFAT
+ * does not need to go to the disk (or the cache above) for every
+ * cluster.  The values are masked and sanity checked in the same way
+ * as getFAT does.
+ *
+ * Return 1 on error or if the table is too large and 0 on success
+ */
+static uint8_t
+fatfs_load_table(FATFS_INFO * fatfs)
+{
+    TSK_FS_INFO *fs = (TSK_FS_INFO *) & fatfs->fs_info;
+    TSK_DADDR_T nent = fatfs->lastclust + 1;
+    TSK_DADDR_T clust, val;
+    size_t raw_len, off;
+    uint8_t *raw;
+    uint32_t *table;
+    uint32_t mask;
+
+    fatfs->table_tried = 1;
+
+    if (nent * sizeof(uint32_t) > FATFS_TABLE_MAX)
+        return 1;
+
+    /* size of the on-disk FAT that getFAT could look at */
+    switch (fs->ftype) {
+    case TSK_FS_INFO_TYPE_FAT_12:
+        raw_len = (size_t) (nent + (nent >> 1) + 2);
+        mask = FATFS_12_MASK;
+        break;
+    case TSK_FS_INFO_TYPE_FAT_16:
+        raw_len = (size_t) (nent << 1);
+        mask = FATFS_16_MASK;
+        break;
+    case TSK_FS_INFO_TYPE_FAT_32:
+        raw_len = (size_t) (nent << 2);
+        mask = FATFS_32_MASK;
+        break;
+    default:
+        return 1;
+    }
+    raw_len = roundup(raw_len, fatfs->ssize);
+
+    if ((table =
+            (uint32_t *) talloc_size(fatfs,
+                nent * sizeof(uint32_t))) == NULL) {
+        tsk_error_reset();
+        return 1;
+    }
+
+    /* FAT32 entries are the same size as the table, so they can be
+     * read straight into it and decoded in place */
+    if (fs->ftype == TSK_FS_INFO_TYPE_FAT_32) {
+        if (raw_len > nent * sizeof(uint32_t))
+            raw_len = nent * sizeof(uint32_t);
+        raw = (uint8_t *) table;
+    }
+    else if ((raw = (uint8_t *) talloc_size(fatfs, raw_len)) == NULL) {
+        talloc_free(table);
+        tsk_error_reset();
+        return 1;
+    }
+
+    for (off = 0; off < raw_len; off += FATFS_TABLE_READ) {
+        size_t len = raw_len - off;
+        ssize_t cnt;
+
+        if (len > FATFS_TABLE_READ)
+            len = FATFS_TABLE_READ;
+
+        cnt = tsk_fs_read_random(fs, (char *) &raw[off], len,
+            fatfs->firstfatsect * fs->block_size + off);
+        if (cnt != (ssize_t) len) {
+            if (tsk_verbose)
+                tsk_fprintf(stderr,
+                    "fatfs_load_table: Error reading FAT at %" PRIuDADDR
+                    " - using FAT cache\n",
+                    fatfs->firstfatsect + (off >> fatfs->ssize_sh));
+            if ((uint8_t *) table != raw)
+                talloc_free(raw);
+            talloc_free(table);
+            tsk_error_reset();
+            return 1;
+        }
+    }
+
+    /* a short FAT32 read leaves the tail of the table unset */
+    if ((fs->ftype == TSK_FS_INFO_TYPE_FAT_32)
+        && (raw_len < nent * sizeof(uint32_t)))
+        memset(&raw[raw_len], 0, nent * sizeof(uint32_t) - raw_len);
+
+    for (clust = 0; clust < nent; clust++) {
+        switch (fs->ftype) {
+        case TSK_FS_INFO_TYPE_FAT_12:
+            val = tsk_getu16(fs->endian, &raw[clust + (clust >> 1)]);
+            if (clust & 1)
+                val >>= 4;
+            break;
+        case TSK_FS_INFO_TYPE_FAT_16:
+            val = tsk_getu16(fs->endian, &raw[clust << 1]);
+            break;
+        default:
+            val = tsk_getu32(fs->endian, &raw[clust << 2]);
+            break;
+        }
+        val &= mask;
+
+        /* sanity check */
+        if ((val > fatfs->lastclust) && (val < (0x0ffffff7 & mask)))
+            val = 0;
+
+        table[clust] = (uint32_t) val;
+    }
+
+    if ((uint8_t *) table != raw)
+        talloc_free(raw);
+
+    fatfs->table = table;
+    return 0;
+}
+
+
 /*
  * Set *value to the entry in the File Allocation Table (FAT) 
  * for the given cluster
@@ -173,6 +295,15 @@ getFAT(FATFS_INFO * fatfs, TSK_DADDR_T clust, TSK_DADDR_T * value)
         return 1;
     }
 
+    /* Use the in memory copy of the FAT if we have (or can load) it */
+    if ((fatfs->table == NULL) && (fatfs->table_tried == 0))
+        fatfs_load_table(fatfs);
+
+    if (fatfs->table) {
+        *value = fatfs->table[clust];
+        return 0;
+    }
+
     switch (fatfs->fs_info.ftype) {
     case TSK_FS_INFO_TYPE_FAT_12:
         if (clust & 0xf000) {
@@ -3436,6 +3567,8 @@ fatfs_open(TSK_IMG_INFO * img_info, TSK_OFF_T offset,
         fatfs->fatc_addr[i] = 0;
         fatfs->fatc_ttl[i] = 0;
     }
+    fatfs->table = NULL;
+    fatfs->table_tried = 0;
 
     /* allocate a cluster-sized buffer for inodes */
     if ((fatfs->dinodes =
@@ -63,6 +63,8 @@ tsk_fs_data_alloc(void *context, TSK_FS_DATA_FLAG_ENUM type)
     fs_data->type = 0;
     fs_data->next = NULL;
     fs_data->compsize = 0;
+    fs_data->comp_addr = NULL;
+    fs_data->comp_nclust = 0;
 
     if (type == TSK_FS_DATA_NONRES) {
         fs_data->buflen = 0;
@@ -163,6 +165,21 @@ tsk_fs_data_free(TSK_FS_DATA * fs_data_head)
     }
 }
 
+/**
+ * Drop the compression unit index of an attribute.  This must be
+ * called whenever the run list changes.
+ *
+ * @param fs_data Attribute to reset
+ */
+static void
+fs_data_comp_reset(TSK_FS_DATA * fs_data)
+{
+    if (fs_data->comp_addr)
+        talloc_free(fs_data->comp_addr);
+    fs_data->comp_addr = NULL;
+    fs_data->comp_nclust = 0;
+}
+
 /**
  * Clear the fields and run_lists in the FS_DATA list.
  *
@@ -174,6 +191,7 @@ tsk_fs_data_clear_list(TSK_FS_DATA * fs_data_head)
     while (fs_data_head) {
         fs_data_head->size = fs_data_head->type = fs_data_head->id =
             fs_data_head->flags = 0;
+        fs_data_comp_reset(fs_data_head);
         if (fs_data_head->run) {
             tsk_fs_data_run_free(fs_data_head->run);
             fs_data_head->run = NULL;
@@ -467,6 +485,10 @@ tsk_fs_data_put_run(void *context, TSK_FS_DATA * fs_data_head,
     if (fs_data_head)
         fs_data = tsk_fs_data_lookup(fs_data_head, type, id);
 
+    /* the runs are about to change */
+    if (fs_data)
+        fs_data_comp_reset(fs_data);
+
     /* one does not already exist, so get a new one */
     if (fs_data == NULL) {
 
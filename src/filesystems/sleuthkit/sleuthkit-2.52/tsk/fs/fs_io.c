@@ -381,6 +381,57 @@ fs_read_file_act_aonly(TSK_FS_INFO * fs, TSK_DADDR_T addr, char *buf,
 }
 
 
+/**
+ * \internal
+ * Look up the NTFS attribute that fs_read_file_int() will read.
+ *
+ * @param fsi The inode structure of the file to read.
+ * @param type The type of attribute to load (0 is replaced by the default attribute type)
+ * @param id The id of attribute to load (ignored if TSK_FS_FILE_FLAG_NOID is given)
+ * @param flags Flags for the read.
+ * @returns NULL on error
+ */
+static TSK_FS_DATA *
+fs_read_file_ntfs_data(TSK_FS_INODE * fsi, uint32_t * type, uint16_t id,
+    int flags)
+{
+    TSK_FS_DATA *fs_data;
+
+    // @@@ This is bad since it duplicates much of ntfs_file_walk...
+    if (fsi->attr == NULL) {
+        tsk_error_reset();
+        tsk_errno = TSK_ERR_FS_ARG;
+        snprintf(tsk_errstr, TSK_ERRSTR_L,
+            "fs_read_file: attributes are NULL");
+        return NULL;
+    }
+
+    /* If they did not give a type, we need to determine
+     * what the default should be. */
+    if (*type == 0) {
+        if ((fsi->mode & TSK_FS_INODE_MODE_FMT) == TSK_FS_INODE_MODE_DIR)
+            *type = NTFS_ATYPE_IDXROOT;
+        else
+            *type = NTFS_ATYPE_DATA;
+    }
+
+    if (flags & TSK_FS_FILE_FLAG_NOID)
+        fs_data = tsk_fs_data_lookup_noid(fsi->attr, *type);
+    else
+        fs_data = tsk_fs_data_lookup(fsi->attr, *type, id);
+
+    if (fs_data == NULL) {
+        tsk_error_reset();
+        tsk_errno = TSK_ERR_FS_ARG;
+        snprintf(tsk_errstr, TSK_ERRSTR_L,
+            "fs_read_file: Data not found in file");
+        return NULL;
+    }
+
+    return fs_data;
+}
+
+
 /**
  * \internal
  * Internal method for reading files using a standard read type interface.
@@ -448,6 +499,32 @@ fs_read_file_int(TSK_FS_INFO * fs, TSK_FS_INODE * fsi, uint32_t type,
      * that we need
      */
     if (fsi->flags & TSK_FS_INODE_FLAG_COMP) {
+        /* NTFS can read only the compression units that we need
+         * instead of uncompressing the file up to offset. */
+        if (((fs->ftype & TSK_FS_INFO_TYPE_FS_MASK) ==
+                TSK_FS_INFO_TYPE_NTFS_TYPE)
+            && ((flags & TSK_FS_FILE_FLAG_SLACK) == 0)) {
+            TSK_FS_DATA *fs_data;
+            uint32_t comp_type = type;
+            ssize_t cnt;
+
+            /* Leave any errors to the file walk below */
+            fs_data = fs_read_file_ntfs_data(fsi, &comp_type, id, flags);
+            if (fs_data == NULL)
+                tsk_error_reset();
+            else if ((fs_data->flags & TSK_FS_DATA_NONRES)
+                && (fs_data->flags & TSK_FS_DATA_COMP)
+                && (fs_data->compsize > 0)) {
+                cnt = ntfs_read_comp((NTFS_INFO *) fs, fs_data, flags,
+                    offset, size, buf);
+                if (cnt == -1) {
+                    strncat(tsk_errstr2, " - tsk_fs_read_file",
+                        TSK_ERRSTR_L - strlen(tsk_errstr2));
+                }
+                return cnt;
+            }
+        }
+
         if (fs->file_walk(fs, fsi, type, id, flags, fs_read_file_act_data,
                 (void *) &lf)) {
             strncat(tsk_errstr2, " - tsk_fs_read_file",
@@ -463,38 +540,9 @@ fs_read_file_int(TSK_FS_INFO * fs, TSK_FS_INODE * fsi, uint32_t type,
             TSK_FS_INFO_TYPE_NTFS_TYPE) {
             TSK_FS_DATA *fs_data;
 
-            // @@@ This is bad since it duplicates much of ntfs_file_walk...
-            if (fsi->attr == NULL) {
-                tsk_error_reset();
-                tsk_errno = TSK_ERR_FS_ARG;
-                snprintf(tsk_errstr, TSK_ERRSTR_L,
-                    "fs_read_file: attributes are NULL");
+            fs_data = fs_read_file_ntfs_data(fsi, &type, id, flags);
+            if (fs_data == NULL)
                 return -1;
-            }
-
-
-            /* If they did not give a type, we need to determine
-             * what the default should be. */
-            if (type == 0) {
-                if ((fsi->mode & TSK_FS_INODE_MODE_FMT) ==
-                    TSK_FS_INODE_MODE_DIR)
-                    type = NTFS_ATYPE_IDXROOT;
-                else
-                    type = NTFS_ATYPE_DATA;
-            }
-
-            if (flags & TSK_FS_FILE_FLAG_NOID)
-                fs_data = tsk_fs_data_lookup_noid(fsi->attr, type);
-            else
-                fs_data = tsk_fs_data_lookup(fsi->attr, type, id);
-
-            if (fs_data == NULL) {
-                tsk_error_reset();
-                tsk_errno = TSK_ERR_FS_ARG;
-                snprintf(tsk_errstr, TSK_ERRSTR_L,
-                    "fs_read_file: Data not found in file");
-                return -1;
-            }
 
             /* The attribute is resident, so use the data callback, otherwise use
              * the normal aonly callback and flags 
@@ -113,6 +113,97 @@ nt2unixtime(uint64_t ntdate)
 
 
 
+/**
+ * Check and remove the update sequence values from a raw MFT entry
+ * that has already been read into memory.  The entry is modified in
+ * place.
+ *
+ * @param a_ntfs File system the entry belongs to
+ * @param a_mft Raw MFT entry (mft_rsize_b bytes)
+ *
+ * @returns TSK_COR if the entry is corrupt
+ */
+static TSK_RETVAL_ENUM
+ntfs_mft_fixup(NTFS_INFO * a_ntfs, ntfs_mft * a_mft)
+{
+    int i;
+    TSK_FS_INFO *fs = (TSK_FS_INFO *) & a_ntfs->fs_info;
+    ntfs_upd *upd;
+    uint16_t sig_seq;
+
+    /* The MFT entries have error and integrity checks in them
+     * called update sequences.  They must be checked and removed
+     * so that later functions can process the data as normal. 
+     * They are located in the last 2 bytes of each 512-byte sector
+     *
+     * We first verify that the the 2-byte value is a give value and
+     * then replace it with what should be there
+     */
+    /* sanity check so we don't run over in the next loop */
+    if ((tsk_getu16(fs->endian, a_mft->upd_cnt) > 0) &&
+        (((uint32_t) (tsk_getu16(fs->endian,
+                        a_mft->upd_cnt) - 1) * a_ntfs->ssize_b) >
+            a_ntfs->mft_rsize_b)) {
+        tsk_error_reset();
+        tsk_errno = TSK_ERR_FS_INODE_INT;
+        snprintf(tsk_errstr, TSK_ERRSTR_L,
+            "dinode_lookup: More Update Sequence Entries than MFT size");
+        return TSK_COR;
+    }
+    if (tsk_getu16(fs->endian, a_mft->upd_off) > a_ntfs->mft_rsize_b) {
+        tsk_error_reset();
+        tsk_errno = TSK_ERR_FS_INODE_INT;
+        snprintf(tsk_errstr, TSK_ERRSTR_L,
+            "dinode_lookup: Update sequence offset larger than MFT size");
+        return TSK_COR;
+    }
+
+    /* Apply the update sequence structure template */
+    upd =
+        (ntfs_upd *) ((uintptr_t) a_mft + tsk_getu16(fs->endian,
+            a_mft->upd_off));
+    /* Get the sequence value that each 16-bit value should be */
+    sig_seq = tsk_getu16(fs->endian, upd->upd_val);
+    /* cycle through each sector */
+    for (i = 1; i < tsk_getu16(fs->endian, a_mft->upd_cnt); i++) {
+        uint8_t *new_val, *old_val;
+        /* The offset into the buffer of the value to analyze */
+        size_t offset = i * a_ntfs->ssize_b - 2;
+        /* get the current sequence value */
+        uint16_t cur_seq =
+            tsk_getu16(fs->endian, (uintptr_t) a_mft + offset);
+        if (cur_seq != sig_seq) {
+            /* get the replacement value */
+            uint16_t cur_repl =
+                tsk_getu16(fs->endian, &upd->upd_seq + (i - 1) * 2);
+            tsk_error_reset();
+            tsk_errno = TSK_ERR_FS_GENFS;
+
+            snprintf(tsk_errstr, TSK_ERRSTR_L,
+                "Incorrect update sequence value in MFT entry\nSignature Value: 0x%"
+                PRIx16 " Actual Value: 0x%" PRIx16
+                " Replacement Value: 0x%" PRIx16
+                "\nThis is typically because of a corrupted entry",
+                sig_seq, cur_seq, cur_repl);
+            return TSK_COR;
+        }
+
+        new_val = &upd->upd_seq + (i - 1) * 2;
+        old_val = (uint8_t *) ((uintptr_t) a_mft + offset);
+        if (tsk_verbose)
+            tsk_fprintf(stderr,
+                "ntfs_mft_fixup: upd_seq %i   Replacing: %.4"
+                PRIx16 "   With: %.4" PRIx16 "\n", i,
+                tsk_getu16(fs->endian, old_val), tsk_getu16(fs->endian,
+                    new_val));
+        *old_val++ = *new_val++;
+        *old_val = *new_val;
+    }
+
+    return TSK_OK;
+}
+
+
 /**
  * Read an MFT entry and save it in raw form in the given buffer.
  * NOTE: This will remove the update sequence integrity checks in the
@@ -129,11 +220,8 @@ ntfs_dinode_lookup(NTFS_INFO * a_ntfs, ntfs_mft * a_mft, TSK_INUM_T a_mftnum)
 {
     TSK_OFF_T mftaddr_b, mftaddr2_b, offset;
     size_t mftaddr_len = 0;
-    int i;
     TSK_FS_INFO *fs = (TSK_FS_INFO *) & a_ntfs->fs_info;
     TSK_FS_DATA_RUN *data_run;
-    ntfs_upd *upd;
-    uint16_t sig_seq;
 
     /* sanity checks */
     if (!a_mft) {
@@ -345,76 +433,89 @@ ntfs_dinode_lookup(NTFS_INFO * a_ntfs, ntfs_mft * a_mft, TSK_INUM_T a_mftnum)
         return 1;
     }
 #endif
-    /* The MFT entries have error and integrity checks in them
-     * called update sequences.  They must be checked and removed
-     * so that later functions can process the data as normal. 
-     * They are located in the last 2 bytes of each 512-byte sector
-     *
-     * We first verify that the the 2-byte value is a give value and
-     * then replace it with what should be there
-     */
-    /* sanity check so we don't run over in the next loop */
-    if ((tsk_getu16(fs->endian, a_mft->upd_cnt) > 0) &&
-        (((uint32_t) (tsk_getu16(fs->endian,
-                        a_mft->upd_cnt) - 1) * a_ntfs->ssize_b) >
-            a_ntfs->mft_rsize_b)) {
-        tsk_error_reset();
-        tsk_errno = TSK_ERR_FS_INODE_INT;
-        snprintf(tsk_errstr, TSK_ERRSTR_L,
-            "dinode_lookup: More Update Sequence Entries than MFT size");
-        return TSK_COR;
-    }
-    if (tsk_getu16(fs->endian, a_mft->upd_off) > a_ntfs->mft_rsize_b) {
+    return ntfs_mft_fixup(a_ntfs, a_mft);
+}
+
+
+
+/**
+ * Read a range of consecutive MFT entries into a buffer in raw form.
+ * The $MFT run list is walked once and each run is read with as few
+ * large reads as possible, instead of one lookup and read per entry.
+ * Entries that cross a run border end up contiguous in the buffer.
+ * NOTE: The update sequence values are NOT removed; call
+ * ntfs_mft_fixup() on each entry before using it.
+ *
+ * @param a_ntfs File system to read from
+ * @param a_buf Buffer to save the entries to (a_count * mft_rsize_b bytes)
+ * @param a_mftnum Address of the first MFT entry to read
+ * @param a_count Number of entries to read
+ *
+ * @returns Number of entries read (may be less than a_count if $MFT
+ * ends) or -1 on error
+ */
+static ssize_t
+ntfs_mft_bulk_read(NTFS_INFO * a_ntfs, char *a_buf, TSK_INUM_T a_mftnum,
+    size_t a_count)
+{
+    TSK_FS_DATA_RUN *data_run;
+    TSK_OFF_T offset, run_off;
+    size_t len, done = 0;
+
+    if (!a_ntfs->mft_data) {
         tsk_error_reset();
-        tsk_errno = TSK_ERR_FS_INODE_INT;
+        tsk_errno = TSK_ERR_FS_ARG;
         snprintf(tsk_errstr, TSK_ERRSTR_L,
-            "dinode_lookup: Update sequence offset larger than MFT size");
-        return TSK_COR;
+            "ntfs_mft_bulk_read: $MFT has not been loaded");
+        return -1;
     }
 
-    /* Apply the update sequence structure template */
-    upd =
-        (ntfs_upd *) ((uintptr_t) a_mft + tsk_getu16(fs->endian,
-            a_mft->upd_off));
-    /* Get the sequence value that each 16-bit value should be */
-    sig_seq = tsk_getu16(fs->endian, upd->upd_val);
-    /* cycle through each sector */
-    for (i = 1; i < tsk_getu16(fs->endian, a_mft->upd_cnt); i++) {
-        uint8_t *new_val, *old_val;
-        /* The offset into the buffer of the value to analyze */
-        size_t offset = i * a_ntfs->ssize_b - 2;
-        /* get the current sequence value */
-        uint16_t cur_seq =
-            tsk_getu16(fs->endian, (uintptr_t) a_mft + offset);
-        if (cur_seq != sig_seq) {
-            /* get the replacement value */
-            uint16_t cur_repl =
-                tsk_getu16(fs->endian, &upd->upd_seq + (i - 1) * 2);
-            tsk_error_reset();
-            tsk_errno = TSK_ERR_FS_GENFS;
+    /* The byte offset within the $Data stream and the bytes wanted */
+    offset = a_mftnum * a_ntfs->mft_rsize_b;
+    len = a_count * a_ntfs->mft_rsize_b;
 
-            snprintf(tsk_errstr, TSK_ERRSTR_L,
-                "Incorrect update sequence value in MFT entry\nSignature Value: 0x%"
-                PRIx16 " Actual Value: 0x%" PRIx16
-                " Replacement Value: 0x%" PRIx16
-                "\nThis is typically because of a corrupted entry",
-                sig_seq, cur_seq, cur_repl);
-            return TSK_COR;
+    for (data_run = a_ntfs->mft_data->run, run_off = 0;
+        (data_run != NULL) && (done < len); data_run = data_run->next) {
+        TSK_OFF_T run_len = data_run->len * a_ntfs->csize_b;
+        TSK_OFF_T rel;
+        size_t cur;
+        ssize_t cnt;
+
+        if (offset + (TSK_OFF_T) done >= run_off + run_len) {
+            run_off += run_len;
+            continue;
         }
 
-        new_val = &upd->upd_seq + (i - 1) * 2;
-        old_val = (uint8_t *) ((uintptr_t) a_mft + offset);
-        if (tsk_verbose)
-            tsk_fprintf(stderr,
-                "ntfs_dinode_lookup: upd_seq %i   Replacing: %.4"
-                PRIx16 "   With: %.4" PRIx16 "\n", i,
-                tsk_getu16(fs->endian, old_val), tsk_getu16(fs->endian,
-                    new_val));
-        *old_val++ = *new_val++;
-        *old_val = *new_val;
+        /* where in this run the next byte we want is */
+        rel = offset + done - run_off;
+        cur = len - done;
+        if ((TSK_OFF_T) cur > run_len - rel)
+            cur = (size_t) (run_len - rel);
+
+        if (data_run->flags & (TSK_FS_DATA_RUN_FLAG_FILLER |
+                TSK_FS_DATA_RUN_FLAG_SPARSE)) {
+            memset(&a_buf[done], 0, cur);
+        }
+        else {
+            cnt = tsk_fs_read_random(&a_ntfs->fs_info, &a_buf[done], cur,
+                data_run->addr * a_ntfs->csize_b + rel);
+            if (cnt != (ssize_t) cur) {
+                if (cnt >= 0) {
+                    tsk_error_reset();
+                    tsk_errno = TSK_ERR_FS_READ;
+                }
+                snprintf(tsk_errstr2, TSK_ERRSTR_L,
+                    "ntfs_mft_bulk_read: Error reading MFT entries at %"
+                    PRIuOFF, data_run->addr * a_ntfs->csize_b + rel);
+                return -1;
+            }
+        }
+
+        done += cur;
+        run_off += run_len;
     }
 
-    return TSK_OK;
+    return done / a_ntfs->mft_rsize_b;
 }
 
 
@@ -1739,6 +1840,385 @@ ntfs_data_walk(NTFS_INFO * ntfs, TSK_INUM_T inum,
 }
 
 
+/*
+ * Reading compressed attributes with ntfs_data_walk() means that we
+ * must uncompress every compression unit before the offset that we
+ * want, so reading a compressed file in small pieces is quadratic.
+ * The functions below give random access instead.  The attribute gets
+ * an index with the address of every cluster (see ntfs_comp_index())
+ * so that the clusters of any compression unit can be found directly
+ * and recently uncompressed units are kept in a small LRU cache in
+ * NTFS_INFO.
+ */
+
+/**
+ * Build the compression unit index of an attribute.  Compression unit
+ * N uses entries N * compsize to (N+1) * compsize - 1 of the index.
+ * Sparse clusters have an address of 0.
+ *
+ * @param ntfs File system to analyze
+ * @param fs_data Compressed, non-resident attribute
+ * @param flags Flags used for the read (TSK_FS_FILE_FLAG_RECOVER)
+ * @returns 1 on error and 0 on success
+ */
+static uint8_t
+ntfs_comp_index(NTFS_INFO * ntfs, TSK_FS_DATA * fs_data, int flags)
+{
+    TSK_FS_DATA_RUN *fs_data_run;
+    TSK_DADDR_T nclust = 0, idx = 0, a;
+
+    for (fs_data_run = fs_data->run; fs_data_run;
+        fs_data_run = fs_data_run->next) {
+
+        /* Filler entries are skipped by ntfs_data_walk() if they
+         * start at 0, so we do the same */
+        if (fs_data_run->flags & TSK_FS_DATA_RUN_FLAG_FILLER) {
+            if (fs_data_run->addr != 0) {
+                tsk_error_reset();
+                if (flags & TSK_FS_FILE_FLAG_RECOVER)
+                    tsk_errno = TSK_ERR_FS_RECOVER;
+                else
+                    tsk_errno = TSK_ERR_FS_GENFS;
+                snprintf(tsk_errstr, TSK_ERRSTR_L,
+                    "Filler Entry exists in fs_data_run %"
+                    PRIuDADDR "@%" PRIuDADDR
+                    " - type: %" PRIu32 "  id: %d", fs_data_run->len,
+                    fs_data_run->addr, fs_data->type, fs_data->id);
+                return 1;
+            }
+            continue;
+        }
+        nclust += fs_data_run->len;
+    }
+
+    if ((fs_data->comp_addr = (TSK_DADDR_T *) talloc_size(fs_data,
+                (size_t) (nclust + 1) * sizeof(TSK_DADDR_T))) == NULL) {
+        return 1;
+    }
+
+    for (fs_data_run = fs_data->run; fs_data_run;
+        fs_data_run = fs_data_run->next) {
+        if (fs_data_run->flags & TSK_FS_DATA_RUN_FLAG_FILLER)
+            continue;
+
+        for (a = 0; a < fs_data_run->len; a++) {
+            if (fs_data_run->flags & TSK_FS_DATA_RUN_FLAG_SPARSE)
+                fs_data->comp_addr[idx++] = 0;
+            else
+                fs_data->comp_addr[idx++] = fs_data_run->addr + a;
+        }
+    }
+    fs_data->comp_nclust = nclust;
+
+    return 0;
+}
+
+
+/**
+ * Return the uncompressed data of a compression unit, either from the
+ * cache or by reading and uncompressing it.  The returned buffer is a
+ * full compression unit in size and is zero padded after the end of the
+ * uncompressed data.  It is only valid until the next call.
+ *
+ * See getFATCacheIdx() in fatfs.c for how the TTL values are used.
+ *
+ * @param ntfs File system to analyze
+ * @param comp_unit Cluster addresses of the unit (without the sparse end)
+ * @param comp_unit_size Number of entries in comp_unit
+ * @param compsize Size of a compression unit in clusters
+ * @param flags Flags used for the read (TSK_FS_FILE_FLAG_RECOVER)
+ * @returns NULL on error
+ */
+static char *
+ntfs_comp_cache_get(NTFS_INFO * ntfs, TSK_DADDR_T * comp_unit,
+    uint32_t comp_unit_size, uint32_t compsize, int flags)
+{
+    TSK_FS_INFO *fs = (TSK_FS_INFO *) & ntfs->fs_info;
+    uint32_t len = compsize * fs->block_size;
+    NTFS_COMP_INFO *comp;
+    TSK_DATA_BUF *data_buf;
+    char *uncompressed_buffer;
+    unsigned int uncompressed_buffer_size;
+    uint32_t a;
+    int i, cidx;
+
+    /* The key is the list of cluster addresses; two units with the
+     * same clusters have the same contents */
+    for (i = 0; i < NTFS_COMPC_N; i++) {
+        if ((ntfs->compc_ttl[i] > 0) && (ntfs->compc_len[i] == len)
+            && (ntfs->compc_nclust[i] == comp_unit_size)
+            && (memcmp(ntfs->compc_addr[i], comp_unit,
+                    comp_unit_size * sizeof(TSK_DADDR_T)) == 0)) {
+
+            for (a = 0; a < NTFS_COMPC_N; a++) {
+                if (ntfs->compc_ttl[a] == 0)
+                    continue;
+
+                if (ntfs->compc_ttl[a] < ntfs->compc_ttl[i])
+                    ntfs->compc_ttl[a]++;
+            }
+            ntfs->compc_ttl[i] = 1;
+            return ntfs->compc_buf[i];
+        }
+    }
+
+    // Look for an unused entry or the least recently used one
+    cidx = 0;
+    for (i = 0; i < NTFS_COMPC_N; i++) {
+        if ((ntfs->compc_ttl[i] == 0) ||
+            (ntfs->compc_ttl[i] >= NTFS_COMPC_N)) {
+            cidx = i;
+        }
+    }
+
+    if (ntfs->compc_len[cidx] != len) {
+        if (ntfs->compc_buf[cidx])
+            talloc_free(ntfs->compc_buf[cidx]);
+        if (ntfs->compc_addr[cidx])
+            talloc_free(ntfs->compc_addr[cidx]);
+        ntfs->compc_len[cidx] = 0;
+        ntfs->compc_ttl[cidx] = 0;
+
+        ntfs->compc_buf[cidx] = talloc_size(ntfs, len);
+        ntfs->compc_addr[cidx] = (TSK_DADDR_T *) talloc_size(ntfs,
+            compsize * sizeof(TSK_DADDR_T));
+        if ((ntfs->compc_buf[cidx] == NULL)
+            || (ntfs->compc_addr[cidx] == NULL))
+            return NULL;
+        ntfs->compc_len[cidx] = len;
+    }
+
+    /* The entry does not hold valid data until we are done */
+    ntfs->compc_ttl[cidx] = 0;
+
+    if ((comp = talloc(ntfs, NTFS_COMP_INFO)) == NULL)
+        return NULL;
+
+    if (ntfs_uncompress_setup(fs, comp, compsize)) {
+        talloc_free(comp);
+        return NULL;
+    }
+
+    if ((data_buf = tsk_data_buf_alloc(comp, fs->block_size)) == NULL) {
+        talloc_free(comp);
+        return NULL;
+    }
+
+    ntfs_uncompress_reset(comp);
+
+    for (a = 0; a < comp_unit_size; a++) {
+        ssize_t cnt;
+
+        if (comp_unit[a] > fs->last_block) {
+            tsk_error_reset();
+            if (flags & TSK_FS_FILE_FLAG_RECOVER)
+                tsk_errno = TSK_ERR_FS_RECOVER;
+            else
+                tsk_errno = TSK_ERR_FS_BLK_NUM;
+            snprintf(tsk_errstr, TSK_ERRSTR_L,
+                "Invalid address in run (too large): %"
+                PRIuDADDR "", comp_unit[a]);
+            talloc_free(comp);
+            return NULL;
+        }
+
+        cnt = tsk_fs_read_block
+            (fs, data_buf, fs->block_size, comp_unit[a]);
+        if (cnt != fs->block_size) {
+            if (cnt >= 0) {
+                tsk_error_reset();
+                tsk_errno = TSK_ERR_FS_READ;
+            }
+            snprintf(tsk_errstr2, TSK_ERRSTR_L,
+                "ntfs_comp_cache_get: Error reading block at %"
+                PRIuDADDR, comp_unit[a]);
+            talloc_free(comp);
+            return NULL;
+        }
+
+        if (ntfs_uncompress(comp, data_buf->data, fs->block_size,
+                &uncompressed_buffer, &uncompressed_buffer_size)) {
+            if (flags & TSK_FS_FILE_FLAG_RECOVER)
+                tsk_errno = TSK_ERR_FS_RECOVER;
+            talloc_free(comp);
+            return NULL;
+        }
+    }
+
+    /* ntfs_uncompress_reset() zeroed the buffer, so the rest of the
+     * unit is already padded */
+    memcpy(ntfs->compc_buf[cidx], comp->uncomp_buf, len);
+    memcpy(ntfs->compc_addr[cidx], comp_unit,
+        comp_unit_size * sizeof(TSK_DADDR_T));
+    ntfs->compc_nclust[cidx] = comp_unit_size;
+    talloc_free(comp);
+
+    // update the TTLs
+    ntfs->compc_ttl[cidx] = NTFS_COMPC_N + 1;
+    for (i = 0; i < NTFS_COMPC_N; i++) {
+        if (ntfs->compc_ttl[i] == 0)
+            continue;
+
+        if (ntfs->compc_ttl[i] < ntfs->compc_ttl[cidx])
+            ntfs->compc_ttl[i]++;
+    }
+    ntfs->compc_ttl[cidx] = 1;
+
+    return ntfs->compc_buf[cidx];
+}
+
+
+/**
+ * Read data from a compressed non-resident attribute.  Only the
+ * compression units that overlap the requested range are read.
+ *
+ * @param ntfs File system to analyze
+ * @param fs_data Compressed attribute (compsize must be > 0)
+ * @param flags Flags used for the read (TSK_FS_FILE_FLAG_RECOVER)
+ * @param offset Byte offset in the attribute to start reading from
+ * @param size Number of bytes to read
+ * @param buf Buffer to read into
+ * @returns number of bytes read or -1 on error
+ */
+ssize_t
+ntfs_read_comp(NTFS_INFO * ntfs, TSK_FS_DATA * fs_data, int flags,
+    TSK_OFF_T offset, size_t size, char *buf)
+{
+    TSK_FS_INFO *fs = (TSK_FS_INFO *) & ntfs->fs_info;
+    TSK_OFF_T unit_size_b;
+    size_t len_left;
+    char *cur = buf;
+
+    // clean up any error messages that are lying around
+    tsk_error_reset();
+
+    if (((fs_data->flags & TSK_FS_DATA_COMP) == 0)
+        || (fs_data->flags & TSK_FS_DATA_RES) || (fs_data->compsize == 0)) {
+        tsk_errno = TSK_ERR_FS_ARG;
+        snprintf(tsk_errstr, TSK_ERRSTR_L,
+            "ntfs_read_comp: attribute is not compressed");
+        return -1;
+    }
+
+    if (offset >= fs_data->size)
+        return 0;
+    if ((TSK_OFF_T) size > fs_data->size - offset)
+        size = (size_t) (fs_data->size - offset);
+
+    if ((fs_data->comp_addr == NULL)
+        && (ntfs_comp_index(ntfs, fs_data, flags)))
+        return -1;
+
+    unit_size_b = (TSK_OFF_T) fs_data->compsize * fs->block_size;
+    len_left = size;
+
+    while (len_left > 0) {
+        TSK_DADDR_T unit = offset / unit_size_b;
+        TSK_DADDR_T first = unit * fs_data->compsize;
+        size_t unit_off = (size_t) (offset % unit_size_b);
+        size_t len = (size_t) unit_size_b - unit_off;
+        TSK_DADDR_T *comp_unit = NULL;
+        uint32_t comp_unit_size = 0, a;
+        int sparse = 1;
+
+        if (len > len_left)
+            len = len_left;
+
+        if (first < fs_data->comp_nclust) {
+            comp_unit = &fs_data->comp_addr[first];
+            comp_unit_size = fs_data->compsize;
+            if (first + comp_unit_size > fs_data->comp_nclust)
+                comp_unit_size = (uint32_t) (fs_data->comp_nclust - first);
+
+            for (a = 0; a < comp_unit_size; a++) {
+                if (comp_unit[a]) {
+                    sparse = 0;
+                    break;
+                }
+            }
+        }
+
+        /* Sparse unit (or past the end of the run list) */
+        if (sparse) {
+            memset(cur, 0, len);
+        }
+
+        /* The end of the unit is sparse, so the unit is compressed */
+        else if (comp_unit[comp_unit_size - 1] == 0) {
+            char *data;
+
+            /* Only the clusters before the first sparse one have data */
+            for (a = 0; a < comp_unit_size; a++) {
+                if (comp_unit[a] == 0)
+                    break;
+            }
+            comp_unit_size = a;
+
+            data = ntfs_comp_cache_get(ntfs, comp_unit, comp_unit_size,
+                fs_data->compsize, flags);
+            if (data == NULL)
+                return -1;
+            memcpy(cur, data + unit_off, len);
+        }
+
+        /* Uncompressed unit, read the clusters directly */
+        else {
+            size_t done = 0;
+
+            while (done < len) {
+                size_t clust_off = (unit_off + done) % fs->block_size;
+                size_t clen = fs->block_size - clust_off;
+                TSK_DADDR_T addr;
+                ssize_t cnt;
+
+                a = (uint32_t) ((unit_off + done) / fs->block_size);
+                if (clen > len - done)
+                    clen = len - done;
+
+                /* A short unit at the end of the run list */
+                if (a >= comp_unit_size) {
+                    memset(cur + done, 0, len - done);
+                    break;
+                }
+
+                addr = comp_unit[a];
+                if (addr > fs->last_block) {
+                    tsk_error_reset();
+                    if (flags & TSK_FS_FILE_FLAG_RECOVER)
+                        tsk_errno = TSK_ERR_FS_RECOVER;
+                    else
+                        tsk_errno = TSK_ERR_FS_BLK_NUM;
+                    snprintf(tsk_errstr, TSK_ERRSTR_L,
+                        "Invalid address in run (too large): %"
+                        PRIuDADDR "", addr);
+                    return -1;
+                }
+
+                cnt = tsk_fs_read_random(fs, cur + done, clen,
+                    (TSK_OFF_T) addr * fs->block_size + clust_off);
+                if (cnt != (ssize_t) clen) {
+                    if (cnt >= 0) {
+                        tsk_error_reset();
+                        tsk_errno = TSK_ERR_FS_READ;
+                    }
+                    snprintf(tsk_errstr2, TSK_ERRSTR_L,
+                        "ntfs_read_comp: Error reading block at %"
+                        PRIuDADDR, addr);
+                    return -1;
+                }
+                done += clen;
+            }
+        }
+
+        cur += len;
+        offset += len;
+        len_left -= len;
+    }
+
+    return (ssize_t) size;
+}
+
+
 
 /* 
  * Process an NTFS attribute sequence and load the data into data
@@ -3499,6 +3979,9 @@ ntfs_inode_walk(TSK_FS_INFO * fs, TSK_INUM_T start_inum, TSK_INUM_T end_inum,
     int myflags;
     TSK_INUM_T mftnum;
     TSK_FS_INODE *fs_inode;
+    char *bulk_buf = NULL;
+    size_t bulk_max = 0;
+    TSK_INUM_T bulk_start = 0, bulk_count = 0, bulk_fail = 0;
 
     /*
      * Sanity checks.
@@ -3579,12 +4062,63 @@ ntfs_inode_walk(TSK_FS_INFO * fs, TSK_INUM_T start_inum, TSK_INUM_T end_inum,
         return 1;
     }
 
+    /* Rather than looking up each entry in the $MFT run list and
+     * reading it on its own, the entries are read sequentially
+     * in large chunks and the update sequences removed in the buffer.
+     */
+    if ((ntfs->mft_data) && (end_inum > start_inum)) {
+        bulk_max = NTFS_MFT_BULK_SIZE / ntfs->mft_rsize_b;
+        if (bulk_max > end_inum - start_inum + 1)
+            bulk_max = (size_t) (end_inum - start_inum + 1);
+        if (bulk_max == 0)
+            bulk_max = 1;
+        bulk_buf = talloc_size(ntfs, bulk_max * ntfs->mft_rsize_b);
+        if (bulk_buf == NULL)
+            bulk_max = 0;
+    }
+
     for (mftnum = start_inum; mftnum <= end_inum; mftnum++) {
         int retval;
         TSK_RETVAL_ENUM retval2;
 
+        /* refill the bulk buffer if we have walked off the end of it */
+        if ((bulk_buf) && (mftnum >= bulk_start + bulk_count)
+            && (mftnum >= bulk_fail)) {
+            size_t want = bulk_max;
+            ssize_t cnt;
+
+            if (want > end_inum - mftnum + 1)
+                want = (size_t) (end_inum - mftnum + 1);
+
+            bulk_start = mftnum;
+            cnt = ntfs_mft_bulk_read(ntfs, bulk_buf, mftnum, want);
+            if (cnt < 0) {
+                /* fall back to reading this chunk one entry at a time
+                 * so that a bad sector only costs the entries in it */
+                if (tsk_verbose)
+                    tsk_error_print(stderr);
+                tsk_error_reset();
+                bulk_count = 0;
+                bulk_fail = mftnum + want;
+            }
+            else {
+                bulk_count = cnt;
+            }
+        }
+
         /* read MFT entry in to NTFS_INFO */
-        if ((retval2 = ntfs_dinode_load(ntfs, mftnum)) != TSK_OK) {
+        if ((mftnum >= bulk_start) && (mftnum < bulk_start + bulk_count)) {
+            memcpy(ntfs->mft,
+                &bulk_buf[(mftnum - bulk_start) * ntfs->mft_rsize_b],
+                ntfs->mft_rsize_b);
+            ntfs->mnum = mftnum;
+            retval2 = ntfs_mft_fixup(ntfs, ntfs->mft);
+        }
+        else {
+            retval2 = ntfs_dinode_load(ntfs, mftnum);
+        }
+
+        if (retval2 != TSK_OK) {
             // if the entry is corrupt, then skip to the next one
             if (retval2 == TSK_COR) {
                 if (tsk_verbose)
@@ -3592,6 +4126,7 @@ ntfs_inode_walk(TSK_FS_INFO * fs, TSK_INUM_T start_inum, TSK_INUM_T end_inum,
                 tsk_error_reset();
                 continue;
             }
+            talloc_free(bulk_buf);
             tsk_fs_inode_free(fs_inode);
             return 1;
         }
@@ -3639,6 +4174,7 @@ ntfs_inode_walk(TSK_FS_INFO * fs, TSK_INUM_T start_inum, TSK_INUM_T end_inum,
                 tsk_error_reset();
                 continue;
             }
+            talloc_free(bulk_buf);
             tsk_fs_inode_free(fs_inode);
             return 1;
         }
@@ -3647,15 +4183,18 @@ ntfs_inode_walk(TSK_FS_INFO * fs, TSK_INUM_T start_inum, TSK_INUM_T end_inum,
         retval = action(fs, fs_inode, ptr);
 
         if (retval == TSK_WALK_STOP) {
+            talloc_free(bulk_buf);
             tsk_fs_inode_free(fs_inode);
             return 0;
         }
         else if (retval == TSK_WALK_ERROR) {
+            talloc_free(bulk_buf);
             tsk_fs_inode_free(fs_inode);
             return 1;
         }
     }
 
+    talloc_free(bulk_buf);
     tsk_fs_inode_free(fs_inode);
     return 0;
 }
@@ -4411,6 +4950,11 @@ ntfs_open(TSK_IMG_INFO * img_info, TSK_OFF_T offset,
     ntfs->loading_the_MFT = 0;
     ntfs->bmap = NULL;
     ntfs->bmap_buf = NULL;
+    memset(ntfs->compc_buf, 0, sizeof(ntfs->compc_buf));
+    memset(ntfs->compc_addr, 0, sizeof(ntfs->compc_addr));
+    memset(ntfs->compc_nclust, 0, sizeof(ntfs->compc_nclust));
+    memset(ntfs->compc_len, 0, sizeof(ntfs->compc_len));
+    memset(ntfs->compc_ttl, 0, sizeof(ntfs->compc_ttl));
 
     /* Read the boot sector */
     len = roundup(sizeof(ntfs_sb), NTFS_DEV_BSIZE);
@@ -38,6 +38,15 @@ extern "C" {
 #define EXT2FS_MAXPATHLEN	4096
 #define EXT2FS_MIN_BLOCK_SIZE	1024
 #define EXT2FS_MAX_BLOCK_SIZE	4096
+
+/* Bitmap cache: EXT2FS_MAP_CACHE_N entries for each of the block and
+ * inode bitmaps, each holding the bitmaps of up to EXT2FS_MAP_CACHE_G
+ * consecutive groups that were read with one request */
+#define EXT2FS_MAP_CACHE_N	8
+#define EXT2FS_MAP_CACHE_G	16
+
+/* Largest group descriptor table that is kept in memory */
+#define EXT2FS_GRP_TABLE_MAX	(64 * 1024 * 1024)
 #define EXT2FS_DEV_BSIZE	512
 
 /*
@@ -389,6 +398,16 @@ extern "C" {
 
 
 
+    /*
+     * A cached run of allocation bitmaps, one block per group.
+     */
+    typedef struct {
+        uint8_t *buf;           /* EXT2FS_MAP_CACHE_G blocks */
+        EXT2_GRPNUM_T grp_num;  /* group of the first bitmap in buf */
+        EXT2_GRPNUM_T grp_cnt;  /* number of bitmaps in buf */
+        uint8_t ttl;            /* 0 if not in use, 1 is most recent */
+    } EXT2FS_MAP_CACHE;
+
     /*
      * Structure of an ext2fs file system handle.
      */
@@ -398,12 +417,16 @@ extern "C" {
 
         ext2fs_gd *grp_buf;     /* cached group descriptor */
         EXT2_GRPNUM_T grp_num;  /* cached group number */
+        ext2fs_gd *grp_table;   /* all group descriptors, if loaded */
+        uint8_t grp_table_tried;        /* set once a load was attempted */
 
         uint8_t *bmap_buf;        /* cached block allocation bitmap */
         EXT2_GRPNUM_T bmap_grp_num;     /* cached block bitmap nr */
+        EXT2FS_MAP_CACHE bmap_cache[EXT2FS_MAP_CACHE_N];
 
         uint8_t *imap_buf;        /* cached inode allocation bitmap */
         EXT2_GRPNUM_T imap_grp_num;     /* cached inode bitmap nr */
+        EXT2FS_MAP_CACHE imap_cache[EXT2FS_MAP_CACHE_N];
 
         ext2fs_inode *dino_buf; /* cached disk inode */
         TSK_INUM_T dino_inum;       /* cached inode number */
@@ -48,6 +48,12 @@ extern "C" {
 #define FAT_CACHE_B		4096
 #define FAT_CACHE_S		8       // number of sectors in cache
 
+/* The whole FAT is decoded into memory the first time it is used, unless
+ * the decoded table would be larger than this (the cache above is used
+ * then) */
+#define FATFS_TABLE_MAX	(256 * 1024 * 1024)
+#define FATFS_TABLE_READ	(1024 * 1024)   // bytes of FAT read at a time while loading
+
 /* MASK values for FAT entries */
 #define FATFS_12_MASK	0x00000fff
 #define FATFS_16_MASK	0x0000ffff
@@ -296,6 +302,11 @@ extern "C" {
         TSK_DADDR_T fatc_addr[FAT_CACHE_N];
         uint8_t fatc_ttl[FAT_CACHE_N];  // ttl of 0 means is not in use
 
+        /* The whole FAT with one entry per cluster, already masked and
+         * sanity checked */
+        uint32_t *table;
+        uint8_t table_tried;    // set once we have tried to load table
+
 
         TSK_DATA_BUF *dinodes;  /* sector size buffer of inode list */
         fatfs_sb *sb;
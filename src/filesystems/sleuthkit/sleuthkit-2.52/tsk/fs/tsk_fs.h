@@ -582,6 +582,8 @@ extern "C" {
         TSK_FS_DATA_RUN *run_end;       ///< Pointer to final run in the list
         TSK_OFF_T allocsize;        ///< Number of bytes that are allocated in all clusters of non-resident run (will be larger than size)
         uint32_t compsize;      ///< Size of compression units (needed only if file is compressed)
+        TSK_DADDR_T *comp_addr; ///< Address of each cluster in the run (0 if sparse), built on first read of a compressed attribute
+        TSK_DADDR_T comp_nclust;        ///< Number of entries in comp_addr
 
         /* stream data (resident) */
         size_t buflen;          ///< Number of bytes allocated to resident buffer
@@ -34,6 +34,9 @@ extern "C" {
 #define NTFS_MAXNAMLEN	256
 #define NTFS_MAXNAMLEN_UTF8	4 * NTFS_MAXNAMLEN
 
+#define NTFS_COMPC_N	8       // number of decompressed units to cache
+#define NTFS_MFT_BULK_SIZE	(4 * 1024 * 1024)       // bytes of $MFT read at a time by inode_walk
+
 /* location of the Root Directory inode */
 #define NTFS_ROOTINO	NTFS_MFT_ROOT
 #define NTFS_FIRSTINO	0       /* location of the $Mft Record */
@@ -674,6 +677,14 @@ extern "C" {
         ntfs_attrdef *attrdef;  // buffer of attrdef file contents
         size_t attrdef_len;    // length of addrdef buffer
 
+        /* Cache of uncompressed compression units, keyed by the
+         * addresses of the clusters in the unit */
+        char *compc_buf[NTFS_COMPC_N];
+        TSK_DADDR_T *compc_addr[NTFS_COMPC_N];  // cluster addresses of the unit
+        uint32_t compc_nclust[NTFS_COMPC_N];    // entries in compc_addr
+        uint32_t compc_len[NTFS_COMPC_N];       // size of compc_buf in bytes
+        uint8_t compc_ttl[NTFS_COMPC_N];        // ttl of 0 means is not in use
+
 #if TSK_USE_SID
         NTFS_SDS_ENTRY *sds;    /* Data run of ntfs_attr_sds */
         //NTFS_SDH_ENTRY *sdh;  /* Data run of ntfs_attr_sdh */
@@ -685,6 +696,9 @@ extern "C" {
     extern uint8_t
         ntfs_data_walk(NTFS_INFO *, TSK_INUM_T, TSK_FS_DATA *, int,
         TSK_FS_FILE_WALK_CB, void *);
+    extern ssize_t
+        ntfs_read_comp(NTFS_INFO *, TSK_FS_DATA *, int, TSK_OFF_T,
+        size_t, char *);
     extern uint8_t
         ntfs_dent_walk(TSK_FS_INFO *, TSK_INUM_T, TSK_FS_DENT_FLAG_ENUM,
         TSK_FS_DENT_TYPE_WALK_CB, void *);
@@ -379,6 +379,18 @@ tsk_hdb_idxfinalize(TSK_HDB_INFO * hdb_info)
     }
 
     unlink(hdb_info->uns_fname);
+
+    /* The text index stays usable if these fail */
+    if (tsk_hdb_makebinindex(hdb_info, hdb_info->hash_type)) {
+        if (tsk_verbose)
+            tsk_error_print(stderr);
+        tsk_error_reset();
+    }
+    if (tsk_hdb_makebloom(hdb_info, hdb_info->hash_type)) {
+        if (tsk_verbose)
+            tsk_error_print(stderr);
+        tsk_error_reset();
+    }
 #endif
 
     return 0;
@@ -576,11 +588,792 @@ hdb_setupindex(TSK_HDB_INFO * hdb_info, uint8_t htype)
 }
 
 
+/**
+ * Convert a hex hash value to its raw form.
+ *
+ * @param hex Hash value as text (not NULL terminated)
+ * @param hlen Number of hex digits in the hash
+ * @param raw Buffer for the hlen / 2 bytes of output
+ * @return 1 if the text is not a hex value and 0 on success
+ */
+static uint8_t
+hdb_hex2raw(const char *hex, size_t hlen, uint8_t * raw)
+{
+    size_t i;
+
+    for (i = 0; i < hlen; i++) {
+        int c = hex[i];
+        uint8_t v;
+
+        if ((c >= '0') && (c <= '9'))
+            v = c - '0';
+        else if ((c >= 'a') && (c <= 'f'))
+            v = c - 'a' + 10;
+        else if ((c >= 'A') && (c <= 'F'))
+            v = c - 'A' + 10;
+        else
+            return 1;
+
+        if (i % 2)
+            raw[i / 2] |= v;
+        else
+            raw[i / 2] = v << 4;
+    }
+    return 0;
+}
+
+/* Store values in the little endian order of the binary index */
+static void
+hdb_putu32(uint8_t * buf, uint32_t val)
+{
+    int i;
+    for (i = 0; i < 4; i++)
+        buf[i] = (uint8_t) (val >> (8 * i));
+}
+
+static void
+hdb_putu64(uint8_t * buf, uint64_t val)
+{
+    int i;
+    for (i = 0; i < 8; i++)
+        buf[i] = (uint8_t) (val >> (8 * i));
+}
+
+/** \internal
+ * Return the prefix table slot for a raw hash value
+ */
+#define hdb_bidx_prefix(hash) \
+    (((uint32_t) (hash)[0] << 8 | (hash)[1]) >> (16 - TSK_HDB_BIDX_PREFIX))
+
+/** \internal
+ * Make the name of the binary index file.  The hash type must be set up.
+ *
+ * @return 1 on error and 0 on success
+ */
+static uint8_t
+hdb_bidx_name(TSK_HDB_INFO * hdb_info)
+{
+    size_t flen;
+
+    if (hdb_info->bidx_fname != NULL)
+        return 0;
+
+    flen = TSTRLEN(hdb_info->db_fname) + 32;
+    hdb_info->bidx_fname =
+        (TSK_TCHAR *) talloc_size(hdb_info, flen * sizeof(TSK_TCHAR));
+    if (hdb_info->bidx_fname == NULL) {
+        return 1;
+    }
+    TSNPRINTF(hdb_info->bidx_fname, flen,
+              _TSK_T("%s-%") PRIcTSK _TSK_T(".bidx"), hdb_info->db_fname,
+              TSK_HDB_HTYPE_STR(hdb_info->hash_type));
+    return 0;
+}
+
+/** \internal
+ * Unmap the binary index if it is in use.
+ */
+static void
+hdb_bidx_close(TSK_HDB_INFO * hdb_info)
+{
+#ifndef TSK_WIN32
+    if (hdb_info->bidx_map != NULL)
+        munmap(hdb_info->bidx_map, hdb_info->bidx_size);
+#endif
+    hdb_info->bidx_map = NULL;
+    hdb_info->bidx_size = 0;
+    hdb_info->bidx_count = 0;
+}
+
+/** \internal
+ * Map the binary index for lookups if one exists and is not older than 
+ * the text index.  Not finding a usable binary index is not an error, 
+ * lookups then use the text index.
+ *
+ * @param hdb_info Hash database to analyze
+ * @param htype The hash type that was used to make the index.
+ *
+ * @return 1 if the binary index is not in use and 0 if it is
+ */
+static uint8_t
+hdb_bidx_open(TSK_HDB_INFO * hdb_info, uint8_t htype)
+{
+#ifdef TSK_WIN32
+    hdb_info->bidx_tried = 1;
+    return 1;
+#else
+    struct stat sb, sb_idx;
+    uint8_t *map;
+    uint64_t count, prev;
+    size_t rlen, i;
+    int fd;
+
+    hdb_info->bidx_tried = 1;
+
+    if ((htype != TSK_HDB_HTYPE_MD5_ID)
+        && (htype != TSK_HDB_HTYPE_SHA1_ID)) {
+        return 1;
+    }
+
+    if (hdb_setuphash(hdb_info, htype) || hdb_bidx_name(hdb_info)) {
+        tsk_error_reset();
+        return 1;
+    }
+    rlen = hdb_info->hash_len / 2;
+
+    if (stat(hdb_info->bidx_fname, &sb) < 0)
+        return 1;
+
+    /* The text index was remade after this one */
+    if ((stat(hdb_info->idx_fname, &sb_idx) == 0) &&
+        (sb_idx.st_mtime > sb.st_mtime)) {
+        if (tsk_verbose)
+            tsk_fprintf(stderr,
+                        "hdb_bidx_open: Ignoring binary index older than %s\n",
+                        hdb_info->idx_fname);
+        return 1;
+    }
+
+    if (sb.st_size < (off_t) (TSK_HDB_BIDX_HEAD_LEN + TSK_HDB_BIDX_TABLE_LEN))
+        return 1;
+
+    if ((fd = open(hdb_info->bidx_fname, O_RDONLY)) < 0)
+        return 1;
+
+    map = mmap(NULL, (size_t) sb.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+        return 1;
+
+    /* Check the header against what we expect for this hash type */
+    count = tsk_getu64(TSK_LIT_ENDIAN, &map[16]);
+    if ((memcmp(map, TSK_HDB_BIDX_MAGIC, 8) != 0) ||
+        (tsk_getu32(TSK_LIT_ENDIAN, &map[8]) != rlen) ||
+        (tsk_getu32(TSK_LIT_ENDIAN, &map[12]) != TSK_HDB_BIDX_PREFIX) ||
+        ((uint64_t) sb.st_size != TSK_HDB_BIDX_HEAD_LEN +
+         TSK_HDB_BIDX_TABLE_LEN + count * (rlen + 8)) ||
+        (tsk_getu64(TSK_LIT_ENDIAN, &map[TSK_HDB_BIDX_HEAD_LEN +
+                                         TSK_HDB_BIDX_TABLE_LEN - 8]) !=
+         count)) {
+        if (tsk_verbose)
+            tsk_fprintf(stderr,
+                        "hdb_bidx_open: Invalid binary index header\n");
+        munmap(map, (size_t) sb.st_size);
+        return 1;
+    }
+
+    /* Lookups trust the prefix table, so every bucket must lie within
+     * the hashes */
+    prev = 0;
+    for (i = 0; i < TSK_HDB_BIDX_TABLE_LEN / 8; i++) {
+        uint64_t val =
+            tsk_getu64(TSK_LIT_ENDIAN, &map[TSK_HDB_BIDX_HEAD_LEN + i * 8]);
+
+        if ((val < prev) || (val > count)) {
+            if (tsk_verbose)
+                tsk_fprintf(stderr,
+                            "hdb_bidx_open: Invalid binary index prefix table\n");
+            munmap(map, (size_t) sb.st_size);
+            return 1;
+        }
+        prev = val;
+    }
+
+    hdb_info->bidx_map = map;
+    hdb_info->bidx_size = (size_t) sb.st_size;
+    hdb_info->bidx_count = count;
+
+    if (tsk_verbose)
+        tsk_fprintf(stderr,
+                    "hdb_bidx_open: Using binary index with %" PRIu64
+                    " entries\n", count);
+    return 0;
+#endif
+}
+
+/** \internal
+ * Find a raw hash value in the binary index.  The prefix table gives
+ * the bucket and a binary search finds the first match in it.
+ *
+ * @param hdb_info Hash database with a mapped binary index
+ * @param hash Raw hash value (hash_len / 2 bytes)
+ * @param first Set to the entry number of the first match
+ *
+ * @return Number of entries with this hash value
+ */
+static uint64_t
+hdb_bidx_find(TSK_HDB_INFO * hdb_info, const uint8_t * hash,
+              uint64_t * first)
+{
+    size_t rlen = hdb_info->hash_len / 2;
+    uint8_t *table = &hdb_info->bidx_map[TSK_HDB_BIDX_HEAD_LEN];
+    uint8_t *hashes = table + TSK_HDB_BIDX_TABLE_LEN;
+    uint8_t *ent;
+    uint32_t prefix = hdb_bidx_prefix(hash);
+    uint64_t low, up, cnt;
+
+    ent = &table[prefix * 8];
+    low = tsk_getu64(TSK_LIT_ENDIAN, ent);
+    ent = &table[(prefix + 1) * 8];
+    up = tsk_getu64(TSK_LIT_ENDIAN, ent);
+
+    while (low < up) {
+        uint64_t mid = low + (up - low) / 2;
+
+        if (memcmp(&hashes[mid * rlen], hash, rlen) < 0)
+            low = mid + 1;
+        else
+            up = mid;
+    }
+
+    *first = low;
+    for (cnt = 0; low + cnt < hdb_info->bidx_count; cnt++) {
+        if (memcmp(&hashes[(low + cnt) * rlen], hash, rlen) != 0)
+            break;
+    }
+    return cnt;
+}
+
+/** \internal
+ * Look up a value in the binary index and call the database specific
+ * getentry function for each match.
+ *
+ * @param hdb_info Hash database with a mapped binary index
+ * @param raw Raw hash value to search for
+ * @param hash Same hash value as text, passed on to getentry
+ * @param flags
+ * @param action Callback function to call for each hash db entry 
+ * @param ptr Pointer to data to pass to each callback
+ *
+ * @return -1 on error, 0 if hash value not found, and 1 if value was found.
+ */
+static int8_t
+hdb_bidx_lookup(TSK_HDB_INFO * hdb_info, const uint8_t * raw,
+                const char *hash, TSK_HDB_FLAG_ENUM flags,
+                TSK_HDB_LOOKUP_FN action, void *ptr)
+{
+    size_t rlen = hdb_info->hash_len / 2;
+    uint8_t *offsets;
+    uint64_t first, cnt, i;
+
+    cnt = hdb_bidx_find(hdb_info, raw, &first);
+    if (cnt == 0)
+        return 0;
+
+    if ((flags & TSK_HDB_FLAG_QUICK)
+        || (hdb_info->db_type == TSK_HDB_DBTYPE_IDXONLY_ID)) {
+        return 1;
+    }
+
+    offsets = &hdb_info->bidx_map[TSK_HDB_BIDX_HEAD_LEN +
+                                  TSK_HDB_BIDX_TABLE_LEN +
+                                  hdb_info->bidx_count * rlen];
+    for (i = first; i < first + cnt; i++) {
+        uint8_t *ent = &offsets[i * 8];
+        TSK_OFF_T db_off = (TSK_OFF_T) tsk_getu64(TSK_LIT_ENDIAN, ent);
+
+        if (hdb_info->getentry(hdb_info, hash, db_off, flags, action, ptr)) {
+            snprintf(tsk_errstr2, TSK_ERRSTR_L, "hdb_lookup");
+            return -1;
+        }
+    }
+    return 1;
+}
+
+/**
+ * Make a binary index from the sorted text index.  It holds the raw
+ * hash values with a prefix table so that lookups can be done from 
+ * memory without parsing index lines.  It is used by the lookup 
+ * functions whenever it exists and is newer than the text index.
+ *
+ * @param hdb_info Hash database state info
+ * @param htype Hash type of the text index to convert
+ * @return 1 on error and 0 on success
+ */
+uint8_t
+tsk_hdb_makebinindex(TSK_HDB_INFO * hdb_info, uint8_t htype)
+{
+#ifdef TSK_WIN32
+    tsk_error_reset();
+    tsk_errno = TSK_ERR_HDB_UNSUPTYPE;
+    snprintf(tsk_errstr, TSK_ERRSTR_L,
+             "hdb_makebinindex: Binary index not supported on Windows");
+    return 1;
+#else
+    char buf[TSK_HDB_MAXLEN];
+    uint8_t head[TSK_HDB_BIDX_HEAD_LEN];
+    uint8_t raw[TSK_HDB_HTYPE_SHA1_LEN / 2];
+    uint8_t prev[TSK_HDB_HTYPE_SHA1_LEN / 2];
+    uint8_t ent[8];
+    uint64_t *table;
+    uint8_t *tbuf;
+    uint64_t count, i;
+    size_t rlen, p;
+    FILE *hBidx;
+    int pass;
+
+    if (hdb_info->hIdx == NULL) {
+        if (hdb_setupindex(hdb_info, htype))
+            return 1;
+    }
+
+    if (hdb_bidx_name(hdb_info))
+        return 1;
+
+    /* We are about to replace the file that may be mapped */
+    hdb_bidx_close(hdb_info);
+    hdb_info->bidx_tried = 0;
+
+    rlen = hdb_info->hash_len / 2;
+    count = (hdb_info->idx_size - hdb_info->idx_off) / hdb_info->idx_llen;
+
+    table = talloc_zero_array(hdb_info, uint64_t,
+                              ((size_t) 1 << TSK_HDB_BIDX_PREFIX) + 1);
+    tbuf = talloc_zero_size(hdb_info, TSK_HDB_BIDX_TABLE_LEN);
+    if ((table == NULL) || (tbuf == NULL)) {
+        talloc_free(table);
+        talloc_free(tbuf);
+        return 1;
+    }
+
+    if (NULL == (hBidx = fopen(hdb_info->bidx_fname, "wb"))) {
+        tsk_error_reset();
+        tsk_errno = TSK_ERR_HDB_CREATE;
+        snprintf(tsk_errstr, TSK_ERRSTR_L,
+                 "hdb_makebinindex: Error creating binary index file: %s",
+                 hdb_info->bidx_fname);
+        talloc_free(table);
+        talloc_free(tbuf);
+        return 1;
+    }
+
+    if (tsk_verbose)
+        tsk_fprintf(stderr,
+                    "hdb_makebinindex: Writing %" PRIu64
+                    " entries to %s\n", count, hdb_info->bidx_fname);
+
+    /* The prefix table is filled in once all of the hashes are seen */
+    memcpy(head, TSK_HDB_BIDX_MAGIC, 8);
+    hdb_putu32(&head[8], (uint32_t) rlen);
+    hdb_putu32(&head[12], TSK_HDB_BIDX_PREFIX);
+    hdb_putu64(&head[16], count);
+    if ((fwrite(head, TSK_HDB_BIDX_HEAD_LEN, 1, hBidx) != 1) ||
+        (fwrite(tbuf, TSK_HDB_BIDX_TABLE_LEN, 1, hBidx) != 1)) {
+        tsk_error_reset();
+        tsk_errno = TSK_ERR_HDB_WRITE;
+        snprintf(tsk_errstr, TSK_ERRSTR_L,
+                 "hdb_makebinindex: Error writing header");
+        goto on_error;
+    }
+
+    /* The first pass writes the hashes and the second their offsets */
+    for (pass = 0; pass < 2; pass++) {
+        if (0 != fseeko(hdb_info->hIdx, hdb_info->idx_off, SEEK_SET)) {
+            tsk_error_reset();
+            tsk_errno = TSK_ERR_HDB_READIDX;
+            snprintf(tsk_errstr, TSK_ERRSTR_L,
+                     "hdb_makebinindex: Error seeking to first entry");
+            goto on_error;
+        }
+
+        for (i = 0; i < count; i++) {
+            if (NULL == fgets(buf, TSK_HDB_MAXLEN, hdb_info->hIdx)) {
+                tsk_error_reset();
+                tsk_errno = TSK_ERR_HDB_READIDX;
+                snprintf(tsk_errstr, TSK_ERRSTR_L,
+                         "hdb_makebinindex: Error reading index entry %"
+                         PRIu64, i);
+                goto on_error;
+            }
+
+            if ((strlen(buf) <= hdb_info->hash_len) ||
+                (buf[hdb_info->hash_len] != '|') ||
+                (hdb_hex2raw(buf, hdb_info->hash_len, raw))) {
+                tsk_error_reset();
+                tsk_errno = TSK_ERR_HDB_CORRUPT;
+                snprintf(tsk_errstr, TSK_ERRSTR_L,
+                         "hdb_makebinindex: Invalid line in index file: %"
+                         PRIu64, i);
+                goto on_error;
+            }
+
+            if (pass == 0) {
+                /* sort(1) may use a locale order, so make sure that we
+                 * can binary search the result */
+                if ((i > 0) && (memcmp(prev, raw, rlen) > 0)) {
+                    tsk_error_reset();
+                    tsk_errno = TSK_ERR_HDB_CORRUPT;
+                    snprintf(tsk_errstr, TSK_ERRSTR_L,
+                             "hdb_makebinindex: Index is not sorted at entry %"
+                             PRIu64, i);
+                    goto on_error;
+                }
+                memcpy(prev, raw, rlen);
+                table[hdb_bidx_prefix(raw) + 1]++;
+
+                if (fwrite(raw, rlen, 1, hBidx) != 1) {
+                    tsk_error_reset();
+                    tsk_errno = TSK_ERR_HDB_WRITE;
+                    snprintf(tsk_errstr, TSK_ERRSTR_L,
+                             "hdb_makebinindex: Error writing hash value");
+                    goto on_error;
+                }
+            }
+            else {
+                hdb_putu64(ent,
+                           strtoull(&buf[hdb_info->hash_len + 1], NULL,
+                                    10));
+                if (fwrite(ent, 8, 1, hBidx) != 1) {
+                    tsk_error_reset();
+                    tsk_errno = TSK_ERR_HDB_WRITE;
+                    snprintf(tsk_errstr, TSK_ERRSTR_L,
+                             "hdb_makebinindex: Error writing offset");
+                    goto on_error;
+                }
+            }
+        }
+    }
+
+    /* Turn the bucket sizes into the number of the first entry in each */
+    for (p = 1; p <= ((size_t) 1 << TSK_HDB_BIDX_PREFIX); p++)
+        table[p] += table[p - 1];
+    for (p = 0; p <= ((size_t) 1 << TSK_HDB_BIDX_PREFIX); p++)
+        hdb_putu64(&tbuf[p * 8], table[p]);
+
+    if ((0 != fseeko(hBidx, TSK_HDB_BIDX_HEAD_LEN, SEEK_SET)) ||
+        (fwrite(tbuf, TSK_HDB_BIDX_TABLE_LEN, 1, hBidx) != 1)) {
+        tsk_error_reset();
+        tsk_errno = TSK_ERR_HDB_WRITE;
+        snprintf(tsk_errstr, TSK_ERRSTR_L,
+                 "hdb_makebinindex: Error writing prefix table");
+        goto on_error;
+    }
+
+    if (fclose(hBidx) != 0) {
+        tsk_error_reset();
+        tsk_errno = TSK_ERR_HDB_WRITE;
+        snprintf(tsk_errstr, TSK_ERRSTR_L,
+                 "hdb_makebinindex: Error closing binary index file");
+        hBidx = NULL;
+        goto on_error;
+    }
+
+    talloc_free(table);
+    talloc_free(tbuf);
+    return 0;
+
+  on_error:
+    if (hBidx)
+        fclose(hBidx);
+    unlink(hdb_info->bidx_fname);
+    talloc_free(table);
+    talloc_free(tbuf);
+    return 1;
+#endif
+}
+
+/** \internal
+ * Make the name of the Bloom filter file.  The hash type must be set up.
+ *
+ * @return 1 on error and 0 on success
+ */
+static uint8_t
+hdb_bloom_name(TSK_HDB_INFO * hdb_info)
+{
+    size_t flen;
+
+    if (hdb_info->bloom_fname != NULL)
+        return 0;
+
+    flen = TSTRLEN(hdb_info->db_fname) + 32;
+    hdb_info->bloom_fname =
+        (TSK_TCHAR *) talloc_size(hdb_info, flen * sizeof(TSK_TCHAR));
+    if (hdb_info->bloom_fname == NULL) {
+        return 1;
+    }
+    TSNPRINTF(hdb_info->bloom_fname, flen,
+              _TSK_T("%s-%") PRIcTSK _TSK_T(".bloom"), hdb_info->db_fname,
+              TSK_HDB_HTYPE_STR(hdb_info->hash_type));
+    return 0;
+}
+
+/** \internal
+ * Unmap the Bloom filter if it is in use.
+ */
+static void
+hdb_bloom_close(TSK_HDB_INFO * hdb_info)
+{
+#ifndef TSK_WIN32
+    if (hdb_info->bloom_map != NULL)
+        munmap(hdb_info->bloom_map, hdb_info->bloom_size);
+#endif
+    hdb_info->bloom_map = NULL;
+    hdb_info->bloom_size = 0;
+    hdb_info->bloom_bits = 0;
+    hdb_info->bloom_k = 0;
+}
+
+/** \internal
+ * Map the Bloom filter if one exists and is not older than the text 
+ * index.  Not finding one is not an error, every lookup then goes to
+ * the index.
+ *
+ * @param hdb_info Hash database to analyze
+ * @param htype The hash type that was used to make the index.
+ *
+ * @return 1 if the filter is not in use and 0 if it is
+ */
+static uint8_t
+hdb_bloom_open(TSK_HDB_INFO * hdb_info, uint8_t htype)
+{
+#ifdef TSK_WIN32
+    hdb_info->bloom_tried = 1;
+    return 1;
+#else
+    struct stat sb, sb_idx;
+    uint8_t *map;
+    uint64_t bits;
+    int fd;
+
+    hdb_info->bloom_tried = 1;
+
+    if ((htype != TSK_HDB_HTYPE_MD5_ID)
+        && (htype != TSK_HDB_HTYPE_SHA1_ID)) {
+        return 1;
+    }
+
+    if (hdb_setuphash(hdb_info, htype) || hdb_bloom_name(hdb_info)) {
+        tsk_error_reset();
+        return 1;
+    }
+
+    if (stat(hdb_info->bloom_fname, &sb) < 0)
+        return 1;
+
+    if ((stat(hdb_info->idx_fname, &sb_idx) == 0) &&
+        (sb_idx.st_mtime > sb.st_mtime)) {
+        if (tsk_verbose)
+            tsk_fprintf(stderr,
+                        "hdb_bloom_open: Ignoring filter older than %s\n",
+                        hdb_info->idx_fname);
+        return 1;
+    }
+
+    if (sb.st_size <= TSK_HDB_BLOOM_HEAD_LEN)
+        return 1;
+
+    if ((fd = open(hdb_info->bloom_fname, O_RDONLY)) < 0)
+        return 1;
+
+    map = mmap(NULL, (size_t) sb.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+        return 1;
+
+    /* The number of bits must be a power of two */
+    bits = tsk_getu64(TSK_LIT_ENDIAN, &map[16]);
+    if ((memcmp(map, TSK_HDB_BLOOM_MAGIC, 8) != 0) ||
+        (tsk_getu32(TSK_LIT_ENDIAN, &map[8]) != hdb_info->hash_len / 2) ||
+        (tsk_getu32(TSK_LIT_ENDIAN, &map[12]) == 0) ||
+        (bits == 0) || ((bits & (bits - 1)) != 0) ||
+        ((uint64_t) sb.st_size != TSK_HDB_BLOOM_HEAD_LEN + bits / 8)) {
+        if (tsk_verbose)
+            tsk_fprintf(stderr,
+                        "hdb_bloom_open: Invalid Bloom filter header\n");
+        munmap(map, (size_t) sb.st_size);
+        return 1;
+    }
+
+    hdb_info->bloom_map = map;
+    hdb_info->bloom_size = (size_t) sb.st_size;
+    hdb_info->bloom_bits = bits;
+    hdb_info->bloom_k = tsk_getu32(TSK_LIT_ENDIAN, &map[12]);
+
+    if (tsk_verbose)
+        tsk_fprintf(stderr,
+                    "hdb_bloom_open: Using Bloom filter with %" PRIu64
+                    " bits\n", bits);
+    return 0;
+#endif
+}
+
+/** \internal
+ * Set or test the Bloom filter bits of a raw hash value.  The hash 
+ * values are already uniformly distributed, so the bit numbers are made
+ * from two 64-bit words of the hash by double hashing.
+ *
+ * @param filter Filter bits
+ * @param bits Number of bits in the filter (a power of two)
+ * @param k Number of bits per hash value
+ * @param hash Raw hash value (at least 16 bytes)
+ * @param set 1 to set the bits and 0 to test them
+ *
+ * @return 1 if all bits were set (the value may be in the set) and 0 if
+ * the value is certainly not in the set
+ */
+static uint8_t
+hdb_bloom_bits(uint8_t * filter, uint64_t bits, uint32_t k,
+               const uint8_t * hash, uint8_t set)
+{
+    uint64_t h1 = tsk_getu64(TSK_LIT_ENDIAN, hash);
+    uint64_t h2 = tsk_getu64(TSK_LIT_ENDIAN, hash + 8) | 1;
+    uint32_t i;
+
+    for (i = 0; i < k; i++) {
+        uint64_t bit = (h1 + i * h2) & (bits - 1);
+
+        if (set)
+            filter[bit / 8] |= (uint8_t) (1 << (bit % 8));
+        else if ((filter[bit / 8] & (1 << (bit % 8))) == 0)
+            return 0;
+    }
+    return 1;
+}
+
+/** \internal
+ * @return 0 if the raw hash value is certainly not in the database and
+ * 1 if it may be (or there is no filter)
+ */
+static uint8_t
+hdb_bloom_test(TSK_HDB_INFO * hdb_info, const uint8_t * hash)
+{
+    if (hdb_info->bloom_map == NULL)
+        return 1;
+
+    return hdb_bloom_bits(&hdb_info->bloom_map[TSK_HDB_BLOOM_HEAD_LEN],
+                          hdb_info->bloom_bits, hdb_info->bloom_k, hash, 0);
+}
+
+/**
+ * Make a Bloom filter of the hash values in the text index.  Lookups 
+ * consult it first, so most values that are not in the database are 
+ * rejected without reading the index.
+ *
+ * @param hdb_info Hash database state info
+ * @param htype Hash type of the text index
+ * @return 1 on error and 0 on success
+ */
+uint8_t
+tsk_hdb_makebloom(TSK_HDB_INFO * hdb_info, uint8_t htype)
+{
+#ifdef TSK_WIN32
+    tsk_error_reset();
+    tsk_errno = TSK_ERR_HDB_UNSUPTYPE;
+    snprintf(tsk_errstr, TSK_ERRSTR_L,
+             "hdb_makebloom: Bloom filter not supported on Windows");
+    return 1;
+#else
+    char buf[TSK_HDB_MAXLEN];
+    uint8_t head[TSK_HDB_BLOOM_HEAD_LEN];
+    uint8_t raw[TSK_HDB_HTYPE_SHA1_LEN / 2];
+    uint8_t *filter;
+    uint64_t count, bits, i;
+    FILE *hBloom;
+
+    if (hdb_info->hIdx == NULL) {
+        if (hdb_setupindex(hdb_info, htype))
+            return 1;
+    }
+
+    if (hdb_bloom_name(hdb_info))
+        return 1;
+
+    /* We are about to replace the file that may be mapped */
+    hdb_bloom_close(hdb_info);
+    hdb_info->bloom_tried = 0;
+
+    count = (hdb_info->idx_size - hdb_info->idx_off) / hdb_info->idx_llen;
+    for (bits = 64; bits < count * TSK_HDB_BLOOM_BITS; bits *= 2);
+
+    if ((filter = talloc_zero_size(hdb_info, bits / 8)) == NULL)
+        return 1;
+
+    if (0 != fseeko(hdb_info->hIdx, hdb_info->idx_off, SEEK_SET)) {
+        tsk_error_reset();
+        tsk_errno = TSK_ERR_HDB_READIDX;
+        snprintf(tsk_errstr, TSK_ERRSTR_L,
+                 "hdb_makebloom: Error seeking to first entry");
+        talloc_free(filter);
+        return 1;
+    }
+
+    for (i = 0; i < count; i++) {
+        if (NULL == fgets(buf, TSK_HDB_MAXLEN, hdb_info->hIdx)) {
+            tsk_error_reset();
+            tsk_errno = TSK_ERR_HDB_READIDX;
+            snprintf(tsk_errstr, TSK_ERRSTR_L,
+                     "hdb_makebloom: Error reading index entry %" PRIu64,
+                     i);
+            talloc_free(filter);
+            return 1;
+        }
+
+        if ((strlen(buf) <= hdb_info->hash_len) ||
+            (buf[hdb_info->hash_len] != '|') ||
+            (hdb_hex2raw(buf, hdb_info->hash_len, raw))) {
+            tsk_error_reset();
+            tsk_errno = TSK_ERR_HDB_CORRUPT;
+            snprintf(tsk_errstr, TSK_ERRSTR_L,
+                     "hdb_makebloom: Invalid line in index file: %" PRIu64,
+                     i);
+            talloc_free(filter);
+            return 1;
+        }
 
+        hdb_bloom_bits(filter, bits, TSK_HDB_BLOOM_K, raw, 1);
+    }
 
+    if (tsk_verbose)
+        tsk_fprintf(stderr,
+                    "hdb_makebloom: Writing %" PRIu64
+                    " bit filter for %" PRIu64 " entries to %s\n", bits,
+                    count, hdb_info->bloom_fname);
+
+    if (NULL == (hBloom = fopen(hdb_info->bloom_fname, "wb"))) {
+        tsk_error_reset();
+        tsk_errno = TSK_ERR_HDB_CREATE;
+        snprintf(tsk_errstr, TSK_ERRSTR_L,
+                 "hdb_makebloom: Error creating Bloom filter file: %s",
+                 hdb_info->bloom_fname);
+        talloc_free(filter);
+        return 1;
+    }
+
+    memcpy(head, TSK_HDB_BLOOM_MAGIC, 8);
+    hdb_putu32(&head[8], (uint32_t) (hdb_info->hash_len / 2));
+    hdb_putu32(&head[12], TSK_HDB_BLOOM_K);
+    hdb_putu64(&head[16], bits);
+    hdb_putu64(&head[24], count);
 
+    if ((fwrite(head, TSK_HDB_BLOOM_HEAD_LEN, 1, hBloom) != 1) ||
+        (fwrite(filter, (size_t) (bits / 8), 1, hBloom) != 1) ||
+        (fclose(hBloom) != 0)) {
+        tsk_error_reset();
+        tsk_errno = TSK_ERR_HDB_WRITE;
+        snprintf(tsk_errstr, TSK_ERRSTR_L,
+                 "hdb_makebloom: Error writing Bloom filter file: %s",
+                 hdb_info->bloom_fname);
+        unlink(hdb_info->bloom_fname);
+        talloc_free(filter);
+        return 1;
+    }
 
+    talloc_free(filter);
+    return 0;
+#endif
+}
 
+/** \internal
+ * Map the binary index and Bloom filter on the first lookup.
+ */
+static void
+hdb_lookup_setup(TSK_HDB_INFO * hdb_info, uint8_t htype)
+{
+    if (hdb_info->bidx_tried == 0)
+        hdb_bidx_open(hdb_info, htype);
+    if (hdb_info->bloom_tried == 0)
+        hdb_bloom_open(hdb_info, htype);
+}
 
 /**
  * Perform the binary search in the index for the text/ASCII hash value
@@ -635,8 +1428,11 @@ tsk_hdb_lookup(TSK_HDB_INFO * hdb_info, const char *hash,
     }
 
 
+    /* Use the binary index and Bloom filter if there are any */
+    hdb_lookup_setup(hdb_info, htype);
+
     /* See if we have had a lookup yet -- and therefore initialized the variables */
-    if (hdb_info->hIdx == NULL) {
+    if ((hdb_info->bidx_map == NULL) && (hdb_info->hIdx == NULL)) {
         if (hdb_setupindex(hdb_info, htype))
             return -1;
     }
@@ -651,6 +1447,25 @@ tsk_hdb_lookup(TSK_HDB_INFO * hdb_info, const char *hash,
         return -1;
     }
 
+    if ((hdb_info->bidx_map != NULL) || (hdb_info->bloom_map != NULL)) {
+        uint8_t raw[TSK_HDB_HTYPE_SHA1_LEN / 2];
+
+        if (hdb_hex2raw(hash, hdb_info->hash_len, raw)) {
+            tsk_error_reset();
+            tsk_errno = TSK_ERR_HDB_ARG;
+            snprintf(tsk_errstr, TSK_ERRSTR_L,
+                     "hdb_lookup: Invalid hash value (hex only): %s",
+                     hash);
+            return -1;
+        }
+
+        if (hdb_bloom_test(hdb_info, raw) == 0)
+            return 0;
+
+        if (hdb_info->bidx_map != NULL)
+            return hdb_bidx_lookup(hdb_info, raw, hash, flags, action,
+                                   ptr);
+    }
 
     low = hdb_info->idx_off;
     up = hdb_info->idx_size;
@@ -934,9 +1749,78 @@ tsk_hdb_lookup_raw(TSK_HDB_INFO * hdb_info, uint8_t * hash, uint8_t len,
     }
     hashbuf[2 * len] = '\0';
 
+    /* Skip the text conversion and checks when the binary index is
+     * used, and the index altogether if the Bloom filter rules the
+     * value out */
+    if (2 * len == TSK_HDB_HTYPE_MD5_LEN)
+        hdb_lookup_setup(hdb_info, TSK_HDB_HTYPE_MD5_ID);
+    else if (2 * len == TSK_HDB_HTYPE_SHA1_LEN)
+        hdb_lookup_setup(hdb_info, TSK_HDB_HTYPE_SHA1_ID);
+
+    if (2 * len == hdb_info->hash_len) {
+        if (hdb_bloom_test(hdb_info, hash) == 0)
+            return 0;
+
+        if (hdb_info->bidx_map != NULL)
+            return hdb_bidx_lookup(hdb_info, hash, hashbuf, flags, action,
+                                   ptr);
+    }
+
     return tsk_hdb_lookup(hdb_info, hashbuf, flags, action, ptr);
 }
 
+/**
+ * Look up many raw hash values at once.  Only membership is reported,
+ * as with the TSK_HDB_FLAG_QUICK flag.  This is much faster than
+ * single lookups when a binary index exists.
+ *
+ * @param hdb_info Hash database state information
+ * @param hashes Array of count raw hash values, each len bytes long
+ * @param len Number of bytes in each hash value
+ * @param count Number of hash values
+ * @param hits Bitmap of (count + 7) / 8 bytes. Bit i (hits[i / 8] & 
+ * (1 << (i % 8))) is set if hash value i was found.
+ *
+ * @return -1 on error, 0 if no hash value was found, and 1 if at least 
+ * one was found.
+ */
+int8_t
+tsk_hdb_lookup_batch(TSK_HDB_INFO * hdb_info, const uint8_t * hashes,
+                     uint8_t len, size_t count, uint8_t * hits)
+{
+    size_t i;
+    int8_t found = 0;
+
+    memset(hits, 0, (count + 7) / 8);
+
+    for (i = 0; i < count; i++) {
+        const uint8_t *hash = &hashes[i * len];
+        int8_t ret;
+
+        /* The first normal lookup sets up the index */
+        if ((hdb_info->bidx_map != NULL) && (2 * len == hdb_info->hash_len)) {
+            uint64_t first;
+            if (hdb_bloom_test(hdb_info, hash) == 0)
+                ret = 0;
+            else
+                ret = hdb_bidx_find(hdb_info, hash, &first) ? 1 : 0;
+        }
+        else {
+            ret = tsk_hdb_lookup_raw(hdb_info, (uint8_t *) hash, len,
+                                     TSK_HDB_FLAG_QUICK, NULL, NULL);
+            if (ret == -1)
+                return -1;
+        }
+
+        if (ret) {
+            hits[i / 8] |= (uint8_t) (1 << (i % 8));
+            found = 1;
+        }
+    }
+
+    return found;
+}
+
 /**
  * Determine if the hash database that is open has an
  * index that has been created.
@@ -949,6 +1833,10 @@ tsk_hdb_lookup_raw(TSK_HDB_INFO * hdb_info, uint8_t * hash, uint8_t len,
 uint8_t
 tsk_hdb_hasindex(TSK_HDB_INFO * hdb_info, uint8_t htype)
 {
+    hdb_lookup_setup(hdb_info, htype);
+    if (hdb_info->bidx_map != NULL)
+        return 1;
+
     /* Check if the index is already open, and 
      * try to open it if not */
     if (hdb_info->idx_size == 0) {
@@ -1097,6 +1985,18 @@ tsk_hdb_open(TSK_TCHAR * db_file, TSK_HDB_OPEN_ENUM flags)
 
     hdb_info->idx_lbuf = NULL;
 
+    hdb_info->bidx_fname = NULL;
+    hdb_info->bidx_map = NULL;
+    hdb_info->bidx_size = 0;
+    hdb_info->bidx_count = 0;
+    hdb_info->bidx_tried = 0;
+
+    hdb_info->bloom_fname = NULL;
+    hdb_info->bloom_map = NULL;
+    hdb_info->bloom_size = 0;
+    hdb_info->bloom_bits = 0;
+    hdb_info->bloom_k = 0;
+    hdb_info->bloom_tried = 0;
 
     /* Copy the database name into the structure */
     flen = TSTRLEN(db_file) + 8;        // + 32;
@@ -1120,6 +2020,9 @@ tsk_hdb_open(TSK_TCHAR * db_file, TSK_HDB_OPEN_ENUM flags)
 void
 tsk_hdb_close(TSK_HDB_INFO * hdb_info)
 {
+    hdb_bidx_close(hdb_info);
+    hdb_bloom_close(hdb_info);
+
     if (hdb_info->hIdx)
         fclose(hdb_info->hIdx);
 
@@ -113,6 +113,19 @@ extern "C" {
         char *idx_lbuf;         ///< Buffer to hold a line from the index
         TSK_TCHAR *idx_fname;   ///< Name of index file
 
+        TSK_TCHAR *bidx_fname;  ///< Name of binary index file
+        uint8_t *bidx_map;      ///< Memory mapped binary index (NULL if not in use)
+        size_t bidx_size;       ///< Size of the mapped binary index
+        uint64_t bidx_count;    ///< Number of entries in the binary index
+        uint8_t bidx_tried;     ///< Set once we tried to open the binary index
+
+        TSK_TCHAR *bloom_fname; ///< Name of Bloom filter file
+        uint8_t *bloom_map;     ///< Memory mapped Bloom filter (NULL if not in use)
+        size_t bloom_size;      ///< Size of the mapped Bloom filter
+        uint64_t bloom_bits;    ///< Number of bits in the filter
+        uint32_t bloom_k;       ///< Number of bits set per hash value
+        uint8_t bloom_tried;    ///< Set once we tried to open the Bloom filter
+
         TSK_HDB_HTYPE_ENUM hash_type;   ///< Type of hash used in index
         uint16_t hash_len;      ///< Length of hash
 
@@ -147,6 +160,13 @@ extern "C" {
                                      uint8_t len, TSK_HDB_FLAG_ENUM,
                                      TSK_HDB_LOOKUP_FN, void *);
 
+    extern int8_t tsk_hdb_lookup_batch(TSK_HDB_INFO *, const uint8_t * hashes,
+                                       uint8_t len, size_t count,
+                                       uint8_t * hits);
+
+    extern uint8_t tsk_hdb_makebinindex(TSK_HDB_INFO *, uint8_t htype);
+    extern uint8_t tsk_hdb_makebloom(TSK_HDB_INFO *, uint8_t htype);
+
 #ifdef __cplusplus
 }
 #endif
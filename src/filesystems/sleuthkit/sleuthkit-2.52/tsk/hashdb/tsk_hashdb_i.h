@@ -34,6 +34,10 @@
 #ifdef TSK_WIN32
 #include <io.h>
 #include <fcntl.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
 #endif
 
 #ifdef __cplusplus
@@ -57,6 +61,34 @@ extern "C" {
  * sha-1 hash - so that it always sorts to the top */
 #define TSK_HDB_IDX_HEAD_STR	"00000000000000000000000000000000000000000"
 
+/**
+ * Binary index layout (all values little endian):
+ *   magic (8 bytes), hash length in bytes (4), prefix bits (4), 
+ *   number of entries (8), prefix table of (1 << prefix bits) + 1 
+ *   entry numbers (8 each), the sorted raw hashes and then the 
+ *   database offsets of each hash (8 each).
+ * The prefix table holds the first entry whose leading bits are at 
+ * least the table index, so a lookup only searches one bucket.
+ */
+#define TSK_HDB_BIDX_MAGIC	"TSKHDBI1"
+#define TSK_HDB_BIDX_PREFIX	16      ///< Number of hash bits in the prefix table
+#define TSK_HDB_BIDX_HEAD_LEN	24      ///< Size of the fixed header
+#define TSK_HDB_BIDX_TABLE_LEN \
+    ((((size_t) 1 << TSK_HDB_BIDX_PREFIX) + 1) * 8)
+
+/**
+ * Bloom filter layout (all values little endian):
+ *   magic (8 bytes), hash length in bytes (4), bits set per hash (4),
+ *   number of filter bits (8, a power of two), number of entries (8) 
+ *   and then the filter bits.
+ * About 10 bits per entry with 7 bits per hash gives a false positive
+ * rate of around 1%.
+ */
+#define TSK_HDB_BLOOM_MAGIC	"TSKHDBB1"
+#define TSK_HDB_BLOOM_HEAD_LEN	32      ///< Size of the fixed header
+#define TSK_HDB_BLOOM_BITS	10      ///< Minimum filter bits per entry
+#define TSK_HDB_BLOOM_K		7       ///< Bits set per hash value
+
 
 
     extern uint8_t tsk_hdb_idxinitialize(TSK_HDB_INFO *,
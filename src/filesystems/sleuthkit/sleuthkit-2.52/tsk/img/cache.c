@@ -0,0 +1,438 @@
+/*
+ * The Sleuth Kit
+ *
+ * cache - PyFlag page cache layer
+ *
+ * This software is distributed under the Common Public License 1.0
+ *
+ */
+
+/**
+ * \file cache.c
+ * A page cache which is layered over another disk image.  The file system
+ * code reads the same metadata sectors (inode tables, directory blocks, the
+ * MFT) over and over, so we keep fixed size pages of the image in memory.
+ *
+ * Replacement is 2Q (Johnson and Shasha, VLDB 1994).  Pages seen for the
+ * first time go on a FIFO (A1in) and only move to the LRU (Am) if they are
+ * requested again after falling out of A1in, which we notice through a
+ * queue of recently evicted page numbers (A1out).  A single pass over file
+ * content therefore does not flush the metadata out of the cache.
+ *
+ * The cache is keyed on the offset in the image rather than in the volume,
+ * so it can be shared by several file systems in the same image.
+ */
+
+#include "tsk_img_i.h"
+#include "cache.h"
+
+/* Reads larger than this go straight to the layer below. They are almost
+ * always file content which we would not see again anyway. */
+#define IMG_CACHE_BYPASS	(32 * TSK_IMG_CACHE_PAGE_SIZE)
+
+
+/* queue helpers - the queue head is a sentinel in a circular list */
+static void
+cache_queue_init(IMG_CACHE_ENTRY * head)
+{
+    head->prev = head->next = head;
+}
+
+static void
+cache_queue_del(IMG_CACHE_ENTRY * e)
+{
+    e->prev->next = e->next;
+    e->next->prev = e->prev;
+    e->prev = e->next = e;
+}
+
+static void
+cache_queue_push(IMG_CACHE_ENTRY * head, IMG_CACHE_ENTRY * e)
+{
+    e->next = head->next;
+    e->prev = head;
+    head->next->prev = e;
+    head->next = e;
+}
+
+
+/* hash helpers */
+static size_t
+cache_hash(IMG_CACHE_INFO * cache_info, TSK_OFF_T page)
+{
+    return (size_t) (((uint64_t) page * 0x9E3779B97F4A7C15ULL) >> 32) &
+        cache_info->hash_mask;
+}
+
+static IMG_CACHE_ENTRY *
+cache_hash_find(IMG_CACHE_INFO * cache_info, TSK_OFF_T page)
+{
+    IMG_CACHE_ENTRY *e;
+
+    for (e = cache_info->hash[cache_hash(cache_info, page)]; e;
+        e = e->hnext) {
+        if (e->page == page)
+            return e;
+    }
+    return NULL;
+}
+
+static void
+cache_hash_add(IMG_CACHE_INFO * cache_info, IMG_CACHE_ENTRY * e)
+{
+    size_t h = cache_hash(cache_info, e->page);
+
+    e->hnext = cache_info->hash[h];
+    cache_info->hash[h] = e;
+}
+
+static void
+cache_hash_del(IMG_CACHE_INFO * cache_info, IMG_CACHE_ENTRY * e)
+{
+    IMG_CACHE_ENTRY **pp;
+
+    for (pp = &cache_info->hash[cache_hash(cache_info, e->page)]; *pp;
+        pp = &(*pp)->hnext) {
+        if (*pp == e) {
+            *pp = e->hnext;
+            break;
+        }
+    }
+    e->hnext = NULL;
+}
+
+
+/** \internal
+ * Remember that a page has just been evicted from A1in.
+ */
+static void
+cache_add_ghost(IMG_CACHE_INFO * cache_info, TSK_OFF_T page)
+{
+    IMG_CACHE_ENTRY *g;
+
+    if (cache_info->free_ghost) {
+        g = cache_info->free_ghost;
+        cache_info->free_ghost = g->hnext;
+    }
+    /* A1out is full - forget the oldest one */
+    else {
+        g = cache_info->a1out.prev;
+        cache_queue_del(g);
+        cache_hash_del(cache_info, g);
+        cache_info->a1out_count--;
+    }
+
+    g->page = page;
+    g->queue = IMG_CACHE_A1OUT;
+    cache_queue_push(&cache_info->a1out, g);
+    cache_hash_add(cache_info, g);
+    cache_info->a1out_count++;
+}
+
+/** \internal
+ * Find an entry with a data buffer we can load a new page into.
+ */
+static IMG_CACHE_ENTRY *
+cache_reclaim(IMG_CACHE_INFO * cache_info)
+{
+    IMG_CACHE_ENTRY *e;
+
+    if (cache_info->free_data) {
+        e = cache_info->free_data;
+        cache_info->free_data = e->hnext;
+        return e;
+    }
+
+    cache_info->stats.evictions++;
+
+    if ((cache_info->a1in_count > cache_info->kin)
+        || (cache_info->am_count == 0)) {
+        e = cache_info->a1in.prev;
+        cache_queue_del(e);
+        cache_hash_del(cache_info, e);
+        cache_info->a1in_count--;
+        cache_add_ghost(cache_info, e->page);
+    }
+    else {
+        e = cache_info->am.prev;
+        cache_queue_del(e);
+        cache_hash_del(cache_info, e);
+        cache_info->am_count--;
+    }
+
+    e->queue = IMG_CACHE_FREE;
+    return e;
+}
+
+/** \internal
+ * Return the cache entry holding a page, reading it from the layer
+ * below if necessary.
+ *
+ * @returns NULL on error
+ */
+static IMG_CACHE_ENTRY *
+cache_get_page(IMG_CACHE_INFO * cache_info, TSK_OFF_T page)
+{
+    TSK_IMG_INFO *next = cache_info->img_info.next;
+    IMG_CACHE_ENTRY *e, *ghost = NULL;
+    ssize_t cnt;
+
+    e = cache_hash_find(cache_info, page);
+    if (e) {
+        if (e->queue == IMG_CACHE_AM) {
+            cache_queue_del(e);
+            cache_queue_push(&cache_info->am, e);
+            cache_info->stats.hits++;
+            return e;
+        }
+        else if (e->queue == IMG_CACHE_A1IN) {
+            cache_info->stats.hits++;
+            return e;
+        }
+        ghost = e;
+    }
+
+    e = cache_reclaim(cache_info);
+
+    cnt = next->read_random(next, 0, e->data, TSK_IMG_CACHE_PAGE_SIZE,
+        page * TSK_IMG_CACHE_PAGE_SIZE);
+    if (cnt < 0) {
+        e->hnext = cache_info->free_data;
+        cache_info->free_data = e;
+        return NULL;
+    }
+
+    cache_info->stats.misses++;
+    e->page = page;
+    e->len = cnt;
+
+    /* It was seen recently - this is a hot page */
+    if (ghost) {
+        cache_queue_del(ghost);
+        cache_hash_del(cache_info, ghost);
+        cache_info->a1out_count--;
+        ghost->queue = IMG_CACHE_FREE;
+        ghost->hnext = cache_info->free_ghost;
+        cache_info->free_ghost = ghost;
+
+        cache_info->stats.ghost_hits++;
+        e->queue = IMG_CACHE_AM;
+        cache_queue_push(&cache_info->am, e);
+        cache_info->am_count++;
+    }
+    else {
+        e->queue = IMG_CACHE_A1IN;
+        cache_queue_push(&cache_info->a1in, e);
+        cache_info->a1in_count++;
+    }
+
+    cache_hash_add(cache_info, e);
+    return e;
+}
+
+
+/**
+ * Read data through the page cache.
+ *
+ * @param img_info Disk image to read from
+ * @param vol_offset Byte offset of the start of the current volume (relative to start of disk image)
+ * @param buf [out] Buffer to write data to
+ * @param len Number of bytes to read
+ * @param offset Byte offset relative to start of volume to read from
+ * @return number of bytes read or -1 on error
+ */
+static ssize_t
+cache_read_random(TSK_IMG_INFO * img_info, TSK_OFF_T vol_offset,
+    char *buf, size_t len, TSK_OFF_T offset)
+{
+    IMG_CACHE_INFO *cache_info = (IMG_CACHE_INFO *) img_info;
+    TSK_OFF_T tot_offset = offset + vol_offset;
+    size_t copied = 0;
+
+    /* A size of 0 means the size is not known (e.g. python file
+     * objects), the pages just come back short at the end */
+    if (img_info->size && tot_offset > img_info->size) {
+        tsk_error_reset();
+        tsk_errno = TSK_ERR_IMG_READ_OFF;
+        snprintf(tsk_errstr, TSK_ERRSTR_L,
+            "cache_read_random - %" PRIuOFF, tot_offset);
+        return -1;
+    }
+
+    if (len > IMG_CACHE_BYPASS) {
+        cache_info->stats.bypass++;
+        return img_info->next->read_random(img_info->next, 0, buf, len,
+            tot_offset);
+    }
+
+    while (copied < len) {
+        IMG_CACHE_ENTRY *e;
+        size_t page_off, cnt;
+
+        e = cache_get_page(cache_info,
+            tot_offset / TSK_IMG_CACHE_PAGE_SIZE);
+        if (e == NULL)
+            return copied ? (ssize_t) copied : -1;
+
+        page_off = (size_t) (tot_offset % TSK_IMG_CACHE_PAGE_SIZE);
+
+        /* short page at the end of the image */
+        if (page_off >= e->len)
+            break;
+
+        cnt = e->len - page_off;
+        if (cnt > len - copied)
+            cnt = len - copied;
+
+        memcpy(buf + copied, e->data + page_off, cnt);
+        copied += cnt;
+        tot_offset += cnt;
+
+        if (e->len < TSK_IMG_CACHE_PAGE_SIZE)
+            break;
+    }
+
+    return copied;
+}
+
+TSK_OFF_T
+cache_get_size(TSK_IMG_INFO * img_info)
+{
+    return img_info->size;
+}
+
+void
+cache_imgstat(TSK_IMG_INFO * img_info, FILE * hFile)
+{
+    IMG_CACHE_INFO *cache_info = (IMG_CACHE_INFO *) img_info;
+
+    img_info->next->imgstat(img_info->next, hFile);
+
+    tsk_fprintf(hFile, "\n--------------------------------------------\n");
+    tsk_fprintf(hFile, "Page Cache Information:\n");
+    tsk_fprintf(hFile, "Pages: %zu of %zu (%d bytes each)\n",
+        cache_info->a1in_count + cache_info->am_count,
+        cache_info->max_pages, TSK_IMG_CACHE_PAGE_SIZE);
+    tsk_fprintf(hFile, "Hits: %" PRIu64 "  Misses: %" PRIu64
+        "  Ghost hits: %" PRIu64 "\n", cache_info->stats.hits,
+        cache_info->stats.misses, cache_info->stats.ghost_hits);
+    tsk_fprintf(hFile, "Evictions: %" PRIu64 "  Bypassed reads: %" PRIu64
+        "\n", cache_info->stats.evictions, cache_info->stats.bypass);
+}
+
+/**
+ * Closes the layer below as well.
+ */
+void
+cache_close(TSK_IMG_INFO * img_info)
+{
+    img_info->next->close(img_info->next);
+    talloc_free(img_info);
+}
+
+
+/**
+ * Put a page cache on top of an open disk image.  The cache takes over
+ * the image, closing the cache will close it too.
+ *
+ * @param next Image to cache
+ * @param cache_size Size of the cache in bytes
+ * @return NULL on error
+ */
+TSK_IMG_INFO *
+tsk_img_cache_open(TSK_IMG_INFO * next, size_t cache_size)
+{
+    IMG_CACHE_INFO *cache_info;
+    TSK_IMG_INFO *img_info;
+    IMG_CACHE_ENTRY *entries;
+    char *data;
+    size_t i, hash_size;
+
+    if ((cache_info = talloc(NULL, IMG_CACHE_INFO)) == NULL)
+        return NULL;
+
+    memset((void *) cache_info, 0, sizeof(IMG_CACHE_INFO));
+
+    img_info = (TSK_IMG_INFO *) cache_info;
+
+    img_info->itype = TSK_IMG_INFO_TYPE_CACHE;
+    img_info->read_random = cache_read_random;
+    img_info->get_size = cache_get_size;
+    img_info->close = cache_close;
+    img_info->imgstat = cache_imgstat;
+    img_info->next = next;
+    img_info->size = next->get_size(next);
+
+    /* The sizes suggested in the 2Q paper */
+    cache_info->max_pages = cache_size / TSK_IMG_CACHE_PAGE_SIZE;
+    if (cache_info->max_pages < 4)
+        cache_info->max_pages = 4;
+    cache_info->kin = cache_info->max_pages / 4;
+    cache_info->kout = cache_info->max_pages / 2;
+
+    cache_queue_init(&cache_info->a1in);
+    cache_queue_init(&cache_info->a1out);
+    cache_queue_init(&cache_info->am);
+
+    for (hash_size = 1;
+        hash_size < 2 * (cache_info->max_pages + cache_info->kout);
+        hash_size <<= 1);
+    cache_info->hash_mask = hash_size - 1;
+    cache_info->hash = talloc_zero_array(cache_info, IMG_CACHE_ENTRY *,
+        hash_size);
+
+    entries = talloc_zero_array(cache_info, IMG_CACHE_ENTRY,
+        cache_info->max_pages + cache_info->kout);
+    data = talloc_size(cache_info,
+        cache_info->max_pages * TSK_IMG_CACHE_PAGE_SIZE);
+
+    if (!cache_info->hash || !entries || !data) {
+        tsk_error_reset();
+        tsk_errno = TSK_ERR_AUX_MALLOC;
+        snprintf(tsk_errstr, TSK_ERRSTR_L,
+            "tsk_img_cache_open: unable to allocate %zu pages",
+            cache_info->max_pages);
+        talloc_free(cache_info);
+        return NULL;
+    }
+
+    /* The first max_pages entries own a data buffer, the rest are for A1out */
+    for (i = 0; i < cache_info->max_pages; i++) {
+        entries[i].data = data + i * TSK_IMG_CACHE_PAGE_SIZE;
+        entries[i].hnext = cache_info->free_data;
+        cache_info->free_data = &entries[i];
+    }
+    for (; i < cache_info->max_pages + cache_info->kout; i++) {
+        entries[i].hnext = cache_info->free_ghost;
+        cache_info->free_ghost = &entries[i];
+    }
+
+    cache_info->stats.max_pages = cache_info->max_pages;
+
+    return img_info;
+}
+
+/**
+ * Return the counters for a page cache layer.
+ *
+ * @param img_info Image returned by tsk_img_cache_open
+ * @param stats [out] Counters
+ * @return 1 on error (not a cache layer) and 0 on success
+ */
+uint8_t
+tsk_img_cache_stats(TSK_IMG_INFO * img_info, TSK_IMG_CACHE_STATS * stats)
+{
+    IMG_CACHE_INFO *cache_info = (IMG_CACHE_INFO *) img_info;
+
+    if (img_info->itype != TSK_IMG_INFO_TYPE_CACHE) {
+        tsk_error_reset();
+        tsk_errno = TSK_ERR_IMG_UNSUPTYPE;
+        snprintf(tsk_errstr, TSK_ERRSTR_L,
+            "tsk_img_cache_stats: image is not a cache layer");
+        return 1;
+    }
+
+    *stats = cache_info->stats;
+    stats->pages = cache_info->a1in_count + cache_info->am_count;
+    return 0;
+}
@@ -0,0 +1,67 @@
+/*
+ * The Sleuth Kit
+ *
+ * This software is distributed under the Common Public License 1.0
+ */
+
+/** \file cache.h
+ * Contains the page cache layer specific functions and structures.
+ */
+
+#ifndef _CACHE_H
+#define _CACHE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+    /* Which 2Q queue a cache entry is on */
+    typedef enum {
+        IMG_CACHE_FREE = 0,
+        IMG_CACHE_A1IN,         ///< Seen once recently (FIFO, has data)
+        IMG_CACHE_A1OUT,        ///< Evicted from A1in (FIFO, no data)
+        IMG_CACHE_AM,           ///< Seen more than once (LRU, has data)
+    } IMG_CACHE_QUEUE;
+
+    typedef struct IMG_CACHE_ENTRY IMG_CACHE_ENTRY;
+
+    struct IMG_CACHE_ENTRY {
+        TSK_OFF_T page;         ///< Page number in the image
+        IMG_CACHE_QUEUE queue;
+        char *data;             ///< NULL for A1out entries
+        size_t len;             ///< Valid bytes in data (short at end of image)
+
+        IMG_CACHE_ENTRY *prev;  ///< Queue links (circular)
+        IMG_CACHE_ENTRY *next;
+        IMG_CACHE_ENTRY *hnext; ///< Hash chain
+    };
+
+    typedef struct {
+        TSK_IMG_INFO img_info;
+
+        size_t max_pages;       ///< Pages with data (A1in + Am)
+        size_t kin;             ///< Target size of A1in
+        size_t kout;            ///< Maximum size of A1out
+
+        /* Queue heads, the head itself is a sentinel */
+        IMG_CACHE_ENTRY a1in;
+        IMG_CACHE_ENTRY a1out;
+        IMG_CACHE_ENTRY am;
+        size_t a1in_count;
+        size_t a1out_count;
+        size_t am_count;
+
+        /* Entries which are not in use (both data and ghost) */
+        IMG_CACHE_ENTRY *free_data;
+        IMG_CACHE_ENTRY *free_ghost;
+
+        IMG_CACHE_ENTRY **hash;
+        size_t hash_mask;
+
+        TSK_IMG_CACHE_STATS stats;
+    } IMG_CACHE_INFO;
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -47,7 +47,10 @@ extern "C" {
 
         /* EWF */
         TSK_IMG_INFO_TYPE_EWF_TYPE = 0x30,      ///< EWF/EnCase Type (General)
-        TSK_IMG_INFO_TYPE_EWF_EWF = 0x31        ///< EWF version
+        TSK_IMG_INFO_TYPE_EWF_EWF = 0x31,       ///< EWF version
+
+        /* Page cache layered over another image */
+        TSK_IMG_INFO_TYPE_CACHE = 0x50  ///< 2Q page cache
     } TSK_IMG_INFO_TYPE_ENUM;
 
     typedef struct TSK_IMG_INFO TSK_IMG_INFO;
@@ -83,6 +86,27 @@ extern "C" {
         const TSK_TCHAR **);
 
 
+/********* CACHE *******/
+#define TSK_IMG_CACHE_PAGE_SIZE	4096    ///< Size of a cached page in bytes
+
+    /**
+     * Counters kept by the page cache layer
+     */
+    typedef struct {
+        uint64_t hits;          ///< Pages found in the cache
+        uint64_t misses;        ///< Pages read from the layer below
+        uint64_t ghost_hits;    ///< Misses on recently evicted pages (promoted straight to Am)
+        uint64_t evictions;     ///< Pages dropped from the cache
+        uint64_t bypass;        ///< Reads too large to go through the cache
+        size_t pages;           ///< Pages currently held
+        size_t max_pages;       ///< Capacity in pages
+    } TSK_IMG_CACHE_STATS;
+
+    extern TSK_IMG_INFO *tsk_img_cache_open(TSK_IMG_INFO *, size_t);
+    extern uint8_t tsk_img_cache_stats(TSK_IMG_INFO *,
+        TSK_IMG_CACHE_STATS *);
+
+
 /********* TYPES *******/
     extern TSK_IMG_INFO_TYPE_ENUM tsk_img_parse_type(const TSK_TCHAR *);
     extern void tsk_img_print_types(FILE *);
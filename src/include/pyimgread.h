@@ -0,0 +1,54 @@
+/******************************************************
+# Michael Cohen <scudette@users.sourceforge.net>
+#
+# ******************************************************
+#  Version: FLAG  $Version: 0.87-pre1 Date: Thu Jun 12 00:48:38 EST 2008$
+# ******************************************************
+#
+# * This program is free software; you can redistribute it and/or
+# * modify it under the terms of the GNU General Public License
+# * as published by the Free Software Foundation; either version 2
+# * of the License, or (at your option) any later version.
+# *
+# * This program is distributed in the hope that it will be useful,
+# * but WITHOUT ANY WARRANTY; without even the implied warranty of
+# * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# * GNU General Public License for more details.
+# *
+# * You should have received a copy of the GNU General Public License
+# * along with this program; if not, write to the Free Software
+# * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+# ******************************************************/
+#ifndef __PYIMGREAD_H
+#define __PYIMGREAD_H
+
+#include <stdint.h>
+
+/** A C level read interface for python image objects.
+
+Image objects implemented in C (iosubsys, pyewf, pyaff) export one of
+these through a PyCObject stored in the attribute named by
+PYIMGREAD_ATTRIBUTE. Other C modules (e.g. sk) can then read from the
+image directly without calling back into the interpreter for every
+seek and read.
+
+The struct lives inside the exporting object, so the consumer must
+hold a reference to that object for as long as it uses the reader.
+*/
+#define PYIMGREAD_ATTRIBUTE "__c_read_random__"
+
+struct pyimgread {
+  /** Reads len bytes at offs into buf. Returns the number of bytes
+      read or -1 on error. This must leave the position used by the
+      object's python read() and tell() where it was.
+  */
+  int (*read_random)(void *ctx, char *buf, uint32_t len, uint64_t offs);
+
+  // Passed as the first arg to read_random
+  void *ctx;
+
+  // Total size of the image in bytes
+  uint64_t size;
+};
+
+#endif
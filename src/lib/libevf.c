@@ -514,6 +514,40 @@ void evf_decompress_fds(struct offset_table *offsets,int outfd) {
   free(cdata);
 };
 
+/* Reads and decompresses a single chunk into data (which must be
+   chunk_size long). cdata is scratch space for the compressed chunk
+   (chunk_size+1024 long). This uses pread and no static state so it
+   may be called from several threads at once. Returns the number of
+   bytes in data or -1 if the chunk could not be read. */
+static int evf_read_chunk(unsigned long long int chunk, char *data, char *cdata,
+			  const struct offset_table *offsets) {
+  long int length,clength;
+  int result;
+  unsigned long long int chunk_size;
+
+  //The size of the compressed chunk
+  chunk_size=offsets->size[chunk];
+  if(chunk_size > offsets->chunk_size+1024) return -1;
+
+  clength=pread(offsets->fd[chunk],cdata,chunk_size,offsets->offset[chunk]);
+  if(clength<(long int)chunk_size) return -1;
+
+  //Decompress the chunk:
+  length=offsets->chunk_size;  
+  if(chunk_size<offsets->chunk_size) {
+    result=uncompress(data,(long int *)&length,cdata,clength);
+    if(result!=Z_OK) {
+      evf_warn("Cant uncompress block of size %lu into size %lu..., filling with zeros\n" , clength, offsets->chunk_size);
+      memset(data,0,offsets->chunk_size);
+      length=offsets->chunk_size;
+    };
+  } else {
+    memcpy(data,cdata,length);
+  };
+
+  return(length);
+};
+
 /* We implement a simple cache here to avoid having to decompress the
    same block if it is read in little chunks. This seems to make a
    huge difference for programs like ils etc, particularly when
@@ -530,9 +564,8 @@ static int cached_length=-1;
 /* Read a random buffer from the evf file */
 int evf_read_random(char *buf, int len, unsigned long long int offs,
 		    const struct offset_table *offsets) {
-  long int length,clength,available;
-  int result;
-  unsigned long long int chunk,buffer_offset,chunk_size,copied=0;
+  long int available;
+  unsigned long long int chunk,buffer_offset,copied=0;
 
   if(!data)
     data=(char *)malloc(offsets->chunk_size);
@@ -557,30 +590,10 @@ int evf_read_random(char *buf, int len, unsigned long long int offs,
 
     //Work out if this is a cache miss:
     if(cached_chunk != chunk) {
-
-      //Seek to the right place in the right image:
-      if(lseek(offsets->fd[chunk],offsets->offset[chunk],SEEK_SET)<0) {
-	RAISE(E_IOERROR,NULL,"Cant Seek");
-      };
-
-      //The size of the compressed chunk
-      chunk_size=offsets->size[chunk];
-      clength=read_from_stream(offsets->fd[chunk],cdata,chunk_size);
-      if(clength<chunk_size) {
+      cached_chunk = -1;
+      if(evf_read_chunk(chunk,data,cdata,offsets)<0) {
 	RAISE(E_IOERROR,NULL,Read,"decompressing file");  
       };
-    
-      //Decompress the chunk:
-      length=offsets->chunk_size;  
-      if(chunk_size<offsets->chunk_size) {
-	result=uncompress(data,(long int *)&length,cdata,clength);
-	if(result!=Z_OK) {
-	  evf_warn("Cant uncompress block of size %lu into size %lu..., filling with zeros\n" , clength, offsets->chunk_size);
-	  memset(data,0,offsets->chunk_size);
-	};
-      } else {
-	memcpy(data,cdata,length);
-      };
       cached_chunk = chunk;
     };
 
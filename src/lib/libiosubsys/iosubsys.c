@@ -27,11 +27,15 @@ This is the python binding for the io subsystem.
 #include "structmember.h"
 #include "libiosubsys.h"
 #include "except.h"
+#include "pyimgread.h"
 
 typedef struct {
     PyObject_HEAD
     IOSource driver;
     unsigned long long size;
+
+    // Exported to other C modules through PYIMGREAD_ATTRIBUTE
+    struct pyimgread reader;
 } iosource;
 
 PyObject *map_exceptions_for_python(enum _exception e) {
@@ -68,6 +72,23 @@ static void iosource_dealloc(iosource *self) {
     self->ob_type->tp_free((PyObject*)self);
 }
 
+/** This is the C level read interface we export to other modules. We
+    must trap our exceptions here because the caller knows nothing
+    about them.
+*/
+static int iosource_c_read_random(void *ctx, char *buf, uint32_t len, uint64_t offs) {
+  iosource *self = (iosource *)ctx;
+  int length;
+
+  TRY {
+    length=self->driver->read_random(self->driver, buf, len, offs);
+  } EXCEPT(E_ANY) {
+    return -1;
+  };
+
+  return length;
+};
+
 static int iosource_init(iosource *self, PyObject *args, PyObject *kwds) {
   char *keywords[] = { "opts", NULL};
   char *drivername;
@@ -168,6 +189,10 @@ static int iosource_init(iosource *self, PyObject *args, PyObject *kwds) {
   talloc_steal(self->driver, options);
   self->size = self->driver->size;
 
+  self->reader.read_random = iosource_c_read_random;
+  self->reader.ctx = self;
+  self->reader.size = self->size;
+
   return 0;
 };
 
@@ -206,6 +231,19 @@ static PyMemberDef iosource_members[] = {
     {NULL}  /* Sentinel */
 };
 
+static PyObject *iosource_get_reader(iosource *self, void *closure) {
+  if(!self->driver)
+    return PyErr_Format(PyExc_IOError, "iosource is not initialised");
+
+  return PyCObject_FromVoidPtr(&self->reader, NULL);
+};
+
+static PyGetSetDef iosource_getseters[] = {
+    {PYIMGREAD_ATTRIBUTE, (getter)iosource_get_reader, NULL,
+     "C level read interface", NULL},
+    {NULL}  /* Sentinel */
+};
+
 static PyMethodDef iosource_methods[] = {
     {"read_random", (PyCFunction)iosource_read_random, METH_VARARGS,
      "read data from given offset" },
@@ -243,7 +281,7 @@ static PyTypeObject iosourceType = {
     0,                         /* tp_iternext */
     iosource_methods,          /* tp_methods */
     iosource_members,          /* tp_members */
-    0,                         /* tp_getset */
+    iosource_getseters,        /* tp_getset */
     0,                         /* tp_base */
     0,                         /* tp_dict */
     0,                         /* tp_descr_get */
@@ -11,6 +11,8 @@
 #include <sys/stat.h>
 #include <fcntl.h>
 
+#include "pyimgread.h"
+
 /******************************************************************
  * pyaff - afflib python binding
  * ***************************************************************/
@@ -19,6 +21,9 @@ typedef struct {
     PyObject_HEAD
     AFFILE *af;
     uint64_t size;
+
+    // Exported to other C modules through PYIMGREAD_ATTRIBUTE
+    struct pyimgread reader;
 } affile;
 
 static void affile_dealloc(affile *self);
@@ -29,6 +34,13 @@ static PyObject *affile_get_seg(affile *self, PyObject *args, PyObject *kwds);
 static PyObject *affile_get_seg_names(affile *self);
 static PyObject *affile_tell(affile *self);
 static PyObject *affile_close(affile *self);
+static PyObject *affile_get_reader(affile *self, void *closure);
+
+static PyGetSetDef affile_getseters[] = {
+    {PYIMGREAD_ATTRIBUTE, (getter)affile_get_reader, NULL,
+     "C level read interface", NULL},
+    {NULL}  /* Sentinel */
+};
 
 static PyMethodDef affile_methods[] = {
     {"read", (PyCFunction)affile_read, METH_VARARGS|METH_KEYWORDS,
@@ -77,7 +89,7 @@ static PyTypeObject affileType = {
     0,                         /* tp_iternext */
     affile_methods,            /* tp_methods */
     0,                         /* tp_members */
-    0,                         /* tp_getset */
+    affile_getseters,          /* tp_getset */
     0,                         /* tp_base */
     0,                         /* tp_dict */
     0,                         /* tp_descr_get */
@@ -90,15 +102,42 @@ static PyTypeObject affileType = {
 
 static void
 affile_dealloc(affile *self) {
+    if(self->af)
+        af_close(self->af);
     self->ob_type->tp_free((PyObject*)self);
 }
 
+/* The C level read interface. afflib has no pread so we have to seek
+ * first, and then put the file position back where python left it.
+ * Readers may outlive close() so a closed file just fails the read. */
+static int
+affile_c_read_random(void *ctx, char *buf, uint32_t len, uint64_t offs) {
+    affile *self = (affile *)ctx;
+    uint64_t pos;
+    int result;
+
+    if(!self->af)
+        return -1;
+
+    pos = af_tell(self->af);
+    if(af_seek(self->af, offs, SEEK_SET) < 0)
+        return -1;
+
+    result = af_read(self->af, (unsigned char *)buf, len);
+
+    if(af_seek(self->af, pos, SEEK_SET) < 0)
+        return -1;
+
+    return result;
+}
+
 static int
 affile_init(affile *self, PyObject *args, PyObject *kwds) {
 	char *filename;
     static char *kwlist[] = {"filename", NULL};
 
     self->size = 0;
+    self->af = NULL;
 
     if(!PyArg_ParseTupleAndKeywords(args, kwds, "s", kwlist, &filename))
         return -1;
@@ -115,6 +154,10 @@ affile_init(affile *self, PyObject *args, PyObject *kwds) {
     self->size = af_get_imagesize(self->af);
 #endif
 
+    self->reader.read_random = affile_c_read_random;
+    self->reader.ctx = self;
+    self->reader.size = self->size;
+
     return 0;
 }
 
@@ -131,6 +174,9 @@ affile_read(affile *self, PyObject *args, PyObject *kwds) {
     if(readlen < 0 || readlen > self->size)
     	readlen = self->size;
 
+    if(!self->af)
+        return PyErr_Format(PyExc_IOError, "File is closed");
+
     retdata = PyString_FromStringAndSize(NULL, readlen);
     written = af_read(self->af, (unsigned char *)PyString_AsString(retdata), readlen);
 
@@ -151,6 +197,9 @@ affile_seek(affile *self, PyObject *args, PyObject *kwds) {
                                     &offset, &whence))
         return NULL; 
 
+    if(!self->af)
+        return PyErr_Format(PyExc_IOError, "File is closed");
+
     if(af_seek(self->af, offset, whence) < 0)
         return PyErr_Format(PyExc_IOError, "libaff_seek_offset failed");
 
@@ -159,15 +208,28 @@ affile_seek(affile *self, PyObject *args, PyObject *kwds) {
 
 static PyObject *
 affile_tell(affile *self) {
+    if(!self->af)
+        return PyErr_Format(PyExc_IOError, "File is closed");
+
     return PyLong_FromLongLong(af_tell(self->af));
 }
 
 static PyObject *
 affile_close(affile *self) {
-  af_close(self->af);
+  if(self->af)
+    af_close(self->af);
+  self->af = NULL;
   Py_RETURN_NONE;
 }
 
+static PyObject *
+affile_get_reader(affile *self, void *closure) {
+    if(!self->af)
+        return PyErr_Format(PyExc_IOError, "File is closed");
+
+    return PyCObject_FromVoidPtr(&self->reader, NULL);
+}
+
 static PyObject *affile_get_seg(affile *self, PyObject *args, PyObject *kwds) {
 	PyObject *retdata;
 	char *buf;
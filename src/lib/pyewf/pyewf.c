@@ -1,11 +1,18 @@
 #include "Python.h"
 #include "libewf.h"
+#include "pyimgread.h"
 
 #include <string.h>
 #include <stdlib.h>
+#include <pthread.h>
 
 #define EWFDIGEST_HASH_SIZE_MD5 16
 
+/* Reads of at least this many chunks are spread over the worker
+   threads (if the file was opened with threads > 1) */
+#define EWF_BULK_MIN_CHUNKS 4
+#define EWF_MAX_THREADS 64
+
 /******************************************************************
  * pyewf - libewf python binding
  * ***************************************************************/
@@ -17,8 +24,39 @@ typedef struct {
     int numfiles;
     uint64_t readptr;
     uint64_t size;
+
+    // Exported to other C modules through PYIMGREAD_ATTRIBUTE
+    struct pyimgread reader;
+
+    /* Bulk reads: libewf handles can not be shared between threads so
+       each worker gets its own handle on the same files. These are
+       opened on the first bulk read. */
+    int threads;
+    uint32_t chunk_size;
+    LIBEWF_HANDLE **worker_handles;
+    pthread_mutex_t bulk_lock;
 } ewffile;
 
+/* State shared by the workers of one bulk read */
+struct ewf_bulk {
+    char *buf;
+    uint64_t offs;
+    uint64_t len;
+    uint32_t chunk_size;
+
+    // Next chunk (counted from the chunk containing offs) to read
+    uint64_t next;
+    uint64_t nchunks;
+    int error;
+    pthread_mutex_t lock;
+};
+
+struct ewf_worker {
+    pthread_t thread;
+    LIBEWF_HANDLE *handle;
+    struct ewf_bulk *bulk;
+};
+
 static void ewffile_dealloc(ewffile *self);
 static int ewffile_init(ewffile *self, PyObject *args, PyObject *kwds);
 static PyObject *ewffile_read(ewffile *self, PyObject *args, PyObject *kwds);
@@ -27,6 +65,13 @@ static PyObject *ewffile_get_header(ewffile *self, PyObject *args, PyObject *kwd
 static PyObject *ewffile_get_headers(ewffile *self);
 static PyObject *ewffile_tell(ewffile *self);
 static PyObject *ewffile_close(ewffile *self);
+static PyObject *ewffile_get_reader(ewffile *self, void *closure);
+
+static PyGetSetDef ewffile_getseters[] = {
+    {PYIMGREAD_ATTRIBUTE, (getter)ewffile_get_reader, NULL,
+     "C level read interface", NULL},
+    {NULL}  /* Sentinel */
+};
 
 static PyMethodDef ewffile_methods[] = {
     {"read", (PyCFunction)ewffile_read, METH_VARARGS|METH_KEYWORDS,
@@ -75,7 +120,7 @@ static PyTypeObject ewffileType = {
     0,                         /* tp_iternext */
     ewffile_methods,           /* tp_methods */
     0,                         /* tp_members */
-    0,                         /* tp_getset */
+    ewffile_getseters,         /* tp_getset */
     0,                         /* tp_base */
     0,                         /* tp_dict */
     0,                         /* tp_descr_get */
@@ -86,9 +131,29 @@ static PyTypeObject ewffileType = {
     0,                         /* tp_new */
 };
 
+/* Closes the worker handles. bulk_lock must be held unless no bulk
+   read can be using them (in dealloc, or before they were used). */
+static void
+ewffile_close_workers(ewffile *self) {
+    int i;
+
+    if(!self->worker_handles) return;
+
+    for(i=0; i<self->threads; i++)
+        if(self->worker_handles[i])
+            libewf_close(self->worker_handles[i]);
+
+    free(self->worker_handles);
+    self->worker_handles = NULL;
+}
+
 static void
 ewffile_dealloc(ewffile *self) {
 	int i;
+    ewffile_close_workers(self);
+    if(self->handle)
+        libewf_close(self->handle);
+    pthread_mutex_destroy(&self->bulk_lock);
 	if(self->filenames) {
     	for(i=0; i<self->numfiles; i++)
     		free(self->filenames[i]);
@@ -97,19 +162,45 @@ ewffile_dealloc(ewffile *self) {
     self->ob_type->tp_free((PyObject*)self);
 }
 
+/* The C level read interface, this does not touch readptr. It does
+   move the libewf handle's offset, so python reads always read at
+   readptr. Readers may outlive close() so a closed file just fails
+   the read. */
+static int
+ewffile_c_read_random(void *ctx, char *buf, uint32_t len, uint64_t offs) {
+    ewffile *self = (ewffile *)ctx;
+
+    if(!self->handle)
+        return -1;
+
+    return libewf_read_random(self->handle, buf, len, offs);
+}
+
 static int
 ewffile_init(ewffile *self, PyObject *args, PyObject *kwds) {
 	int i;
 	PyObject *files, *tmp;
-    static char *kwlist[] = {"files", NULL};
+    static char *kwlist[] = {"files", "threads", NULL};
 
     self->filenames = NULL;
     self->readptr = 0;
     self->numfiles = 0;
     self->size = 0;
+    self->threads = 0;
+    self->chunk_size = 0;
+    self->worker_handles = NULL;
+    self->handle = NULL;
+    pthread_mutex_init(&self->bulk_lock, NULL);
+
+    if(!PyArg_ParseTupleAndKeywords(args, kwds, "O|i", kwlist, &files,
+                                    &self->threads))
+        return -1;
 
-    if(!PyArg_ParseTupleAndKeywords(args, kwds, "O", kwlist, &files))
+    if(self->threads < 0 || self->threads > EWF_MAX_THREADS) {
+        PyErr_Format(PyExc_ValueError, "threads must be between 0 and %d",
+                     EWF_MAX_THREADS);
         return -1;
+    }
 
     if(PySequence_Check(files) == 0) {
         PyErr_Format(PyExc_TypeError, "Option must be a list or tuple");
@@ -131,6 +222,119 @@ ewffile_init(ewffile *self, PyObject *args, PyObject *kwds) {
     }
 
     libewf_get_media_size(self->handle, &self->size);
+    libewf_get_chunk_size(self->handle, &self->chunk_size);
+
+    self->reader.read_random = ewffile_c_read_random;
+    self->reader.ctx = self;
+    self->reader.size = self->size;
+
+    return 0;
+}
+
+/* Worker thread for bulk reads. Each task is one chunk, which is
+   read into its place in the output buffer so the result is in order
+   regardless of which worker finishes first. */
+static void *
+ewffile_bulk_worker(void *arg) {
+    struct ewf_worker *worker = (struct ewf_worker *)arg;
+    struct ewf_bulk *bulk = worker->bulk;
+    uint64_t first = bulk->offs / bulk->chunk_size;
+    uint64_t i, start, end;
+    int len;
+
+    while(1) {
+        pthread_mutex_lock(&bulk->lock);
+        if(bulk->error || bulk->next >= bulk->nchunks) {
+            pthread_mutex_unlock(&bulk->lock);
+            break;
+        }
+        i = bulk->next++;
+        pthread_mutex_unlock(&bulk->lock);
+
+        // The part of the request covered by this chunk
+        start = (first + i) * bulk->chunk_size;
+        end = start + bulk->chunk_size;
+        if(start < bulk->offs) start = bulk->offs;
+        if(end > bulk->offs + bulk->len) end = bulk->offs + bulk->len;
+        len = end - start;
+
+        if(libewf_read_random(worker->handle, bulk->buf + (start - bulk->offs),
+                              len, start) != len) {
+            pthread_mutex_lock(&bulk->lock);
+            bulk->error = 1;
+            pthread_mutex_unlock(&bulk->lock);
+            break;
+        }
+    }
+
+    return NULL;
+}
+
+/* Read len bytes at offs using all the worker threads. The GIL must
+   not be held. Returns 0 on success, -1 on error. */
+static int
+ewffile_read_bulk(ewffile *self, char *buf, uint64_t len, uint64_t offs) {
+    struct ewf_bulk bulk;
+    struct ewf_worker workers[EWF_MAX_THREADS];
+    int i, started = 0;
+
+    bulk.buf = buf;
+    bulk.offs = offs;
+    bulk.len = len;
+    bulk.chunk_size = self->chunk_size;
+    bulk.next = 0;
+    bulk.nchunks = (offs + len - 1) / self->chunk_size
+        - offs / self->chunk_size + 1;
+    bulk.error = 0;
+    pthread_mutex_init(&bulk.lock, NULL);
+
+    for(i=0; i<self->threads; i++) {
+        workers[i].handle = self->worker_handles[i];
+        workers[i].bulk = &bulk;
+        if(pthread_create(&workers[i].thread, NULL, ewffile_bulk_worker,
+                          &workers[i]) != 0)
+            break;
+        started++;
+    }
+
+    // If we could not start any threads do it ourselves
+    if(started == 0) {
+        workers[0].handle = self->worker_handles[0];
+        workers[0].bulk = &bulk;
+        ewffile_bulk_worker(&workers[0]);
+    }
+
+    for(i=0; i<started; i++)
+        pthread_join(workers[i].thread, NULL);
+
+    pthread_mutex_destroy(&bulk.lock);
+    return bulk.error ? -1 : 0;
+}
+
+/* Opens the worker handles for bulk reads. Returns -1 with an
+   exception set on error. */
+static int
+ewffile_open_workers(ewffile *self) {
+    int i;
+
+    if(self->worker_handles) return 0;
+
+    self->worker_handles = (LIBEWF_HANDLE **)calloc(sizeof(LIBEWF_HANDLE *),
+                                                    self->threads);
+    if(!self->worker_handles) {
+        PyErr_NoMemory();
+        return -1;
+    }
+
+    for(i=0; i<self->threads; i++) {
+        self->worker_handles[i] = libewf_open(self->filenames, self->numfiles,
+                                              LIBEWF_OPEN_READ);
+        if(!self->worker_handles[i]) {
+            ewffile_close_workers(self);
+            PyErr_Format(PyExc_IOError, "Failed to initialise libewf");
+            return -1;
+        }
+    }
 
     return 0;
 }
@@ -140,6 +344,7 @@ ewffile_read(ewffile *self, PyObject *args, PyObject *kwds) {
     int written;
     PyObject *retdata;
     int readlen=-1;
+    int result;
 
     static char *kwlist[] = {"size", NULL};
     if(!PyArg_ParseTupleAndKeywords(args, kwds, "|i", kwlist, &readlen))
@@ -151,10 +356,51 @@ ewffile_read(ewffile *self, PyObject *args, PyObject *kwds) {
 
     if(readlen < 0) readlen = 0;
 
+    if(!self->handle)
+        return PyErr_Format(PyExc_IOError, "File is closed");
+
     retdata = PyString_FromStringAndSize(NULL, readlen);
-    written = libewf_read_buffer(self->handle, PyString_AsString(retdata), readlen);
+    if(!retdata) return NULL;
+
+    /* Large reads are decompressed in parallel */
+    if(self->threads > 1 && self->chunk_size > 0 &&
+       readlen >= EWF_BULK_MIN_CHUNKS * self->chunk_size) {
+        if(ewffile_open_workers(self) < 0) {
+            Py_DECREF(retdata);
+            return NULL;
+        }
+
+        Py_BEGIN_ALLOW_THREADS
+        pthread_mutex_lock(&self->bulk_lock);
+        // The file may have been closed while we waited for the lock
+        if(self->worker_handles)
+            result = ewffile_read_bulk(self, PyString_AsString(retdata), readlen,
+                                       self->readptr);
+        else
+            result = -2;
+        pthread_mutex_unlock(&self->bulk_lock);
+        Py_END_ALLOW_THREADS
+
+        if(result == -2) {
+            Py_DECREF(retdata);
+            return PyErr_Format(PyExc_IOError, "File is closed");
+        }
+
+        if(result < 0) {
+            Py_DECREF(retdata);
+            return PyErr_Format(PyExc_IOError, "Failed to read %d bytes at %llu",
+                                readlen, (unsigned long long)self->readptr);
+        }
+
+        self->readptr += readlen;
+        return retdata;
+    }
+
+    written = libewf_read_random(self->handle, PyString_AsString(retdata),
+                                 readlen, self->readptr);
 
     if(readlen != written) {
+        Py_DECREF(retdata);
         return PyErr_Format(PyExc_IOError, "Failed to read all data: wanted %d, got %d", readlen, written);
     }
 
@@ -174,6 +420,9 @@ ewffile_seek(ewffile *self, PyObject *args, PyObject *kwds) {
                                     &offset, &whence))
         return NULL; 
 
+    if(!self->handle)
+        return PyErr_Format(PyExc_IOError, "File is closed");
+
     switch(whence) {
         case 0:
             self->readptr = offset;
@@ -208,12 +457,32 @@ ewffile_tell(ewffile *self) {
     return PyLong_FromLongLong(self->readptr);
 }
 
+/* A bulk read runs without the GIL, so we wait for it to finish
+   before closing the handles it uses. The GIL is only released while
+   waiting for the lock since other threads may be using self->handle. */
 static PyObject *
 ewffile_close(ewffile *self) {
-  libewf_close(self->handle);
+  Py_BEGIN_ALLOW_THREADS
+  pthread_mutex_lock(&self->bulk_lock);
+  Py_END_ALLOW_THREADS
+
+  ewffile_close_workers(self);
+  if(self->handle)
+    libewf_close(self->handle);
+  self->handle = NULL;
+
+  pthread_mutex_unlock(&self->bulk_lock);
   Py_RETURN_NONE;
 }
 
+static PyObject *
+ewffile_get_reader(ewffile *self, void *closure) {
+    if(!self->handle)
+        return PyErr_Format(PyExc_IOError, "File is closed");
+
+    return PyCObject_FromVoidPtr(&self->reader, NULL);
+}
+
 /* The following regular headers exist:
  *
  * case_number
@@ -331,14 +600,15 @@ static PyObject *pyewf_open(PyObject *self, PyObject *args, PyObject *kwds) {
 	int ret;
 	ewffile *file;
 	PyObject *files, *fileargs, *filekwds;
-    static char *kwlist[] = {"files", NULL};
+	int threads=0;
+    static char *kwlist[] = {"files", "threads", NULL};
 
-    if(!PyArg_ParseTupleAndKeywords(args, kwds, "O", kwlist, &files))
+    if(!PyArg_ParseTupleAndKeywords(args, kwds, "O|i", kwlist, &files, &threads))
         return NULL;
 
     /* create an ewffile object and return it */
     fileargs = PyTuple_New(0);
-    filekwds = Py_BuildValue("{sO}", "files", files);
+    filekwds = Py_BuildValue("{sOsi}", "files", files, "threads", threads);
     if(!filekwds) return NULL;
 
     file = PyObject_New(ewffile, &ewffileType);
@@ -356,7 +626,7 @@ static PyObject *pyewf_open(PyObject *self, PyObject *args, PyObject *kwds) {
 /* these are the module methods */
 static PyMethodDef pyewf_methods[] = {
     {"open", (PyCFunction)pyewf_open, METH_VARARGS|METH_KEYWORDS,
-     "Open encase file (or set of files)" },
+     "Open encase file (or set of files). If threads > 1, large reads are decompressed by that many threads in parallel." },
     {NULL, NULL, 0, NULL}  /* Sentinel */
 };
 
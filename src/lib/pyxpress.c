@@ -53,6 +53,7 @@ Return Values:
         -
 --*/
 #include <stdint.h>
+#include <string.h>
 typedef int ULONG;
 typedef unsigned char * PUCHAR;
 typedef unsigned char UCHAR;
@@ -65,6 +66,10 @@ typedef uint16_t USHORT;
 #define DELTA_PAGE ((2 * PAGE_SIZE) - 1)
 #define UNCOMPRESSED_BLOCK_SIZE (PAGE_SIZE * 0x10)
 
+// Matches are copied in chunks of this many bytes when there is room
+// for the last chunk to run past the end of the match.
+#define XPRESS_CHUNK 16
+
 ULONG Xpress_Decompress(PUCHAR InputBuffer,
 			unsigned long InputSize,
 			PUCHAR OutputBuffer,
@@ -104,6 +109,21 @@ NibbleIndicator = XPRESS_ENCODE_MAGIC;
 
         if (((Indicator >> IndicatorBit) & 1) == 0)
         {
+            //* Fast path: copy the whole run of literals (clear bits
+            //* from IndicatorBit down) at once if it fits.
+            uint32_t bits = (uint32_t)Indicator & (((uint32_t)2 << IndicatorBit) - 1);
+            ULONG Run = IndicatorBit + 1;
+
+            if (bits) Run = IndicatorBit - (31 - __builtin_clz(bits));
+            if (Run > 1 && InputIndex + Run <= InputSize && OutputIndex + Run <= OutputSize)
+            {
+                memcpy(OutputBuffer + OutputIndex, InputBuffer + InputIndex, Run);
+                InputIndex += Run;
+                OutputIndex += Run;
+                IndicatorBit -= Run - 1;
+                continue;
+            }
+
 	    if(OutputIndex>=OutputSize) return OutputIndex;
             OutputBuffer[OutputIndex] = InputBuffer[InputIndex]; 
             InputIndex += sizeof(UCHAR);
@@ -165,6 +185,29 @@ NibbleIndicator = XPRESS_ENCODE_MAGIC;
             //if ((OutputIndex > 0xD0) && (OutputIndex < 0xF0)) printf("--7 Len: %02X (%d)\n", Length, Length);
             //if (Length > 280) printf("DECOMP DEBUG: [0x%08X]->[0x%08X] Len: %d Offset: %08X\n", 
             //    OutputIndex, InputIndex, Length, Offset);
+            //* Fast path: a match starting at least 8 bytes back can be
+            //* copied 8 (or 16) bytes at a time, as each chunk only reads
+            //* bytes which are already there. The last chunk may write
+            //* past the end of the match, which is fine as long as there
+            //* is room in the buffer since what comes next overwrites it.
+            if ((Offset + 1) < OutputIndex && Offset + 1 >= 8 &&
+                OutputIndex + Length + XPRESS_CHUNK <= OutputSize)
+            {
+                PUCHAR to = OutputBuffer + OutputIndex;
+                PUCHAR from = to - Offset - 1;
+                ULONG i;
+
+                if (Offset + 1 >= XPRESS_CHUNK)
+                    for (i = 0; i < Length; i += XPRESS_CHUNK)
+                        memcpy(to + i, from + i, XPRESS_CHUNK);
+                else
+                    for (i = 0; i < Length; i += 8)
+                        memcpy(to + i, from + i, 8);
+
+                OutputIndex += Length;
+                continue;
+            }
+
             while (Length != 0) 
             {
                 if ((OutputIndex >= OutputSize) || ((Offset + 1) >= OutputIndex)) break;
@@ -197,7 +240,11 @@ static PyObject *xpress_decode(PyObject *self, PyObject *args) {
   if(!result) return NULL;
 
   outbuff = PyString_AsString(result);
+
+  // Neither buffer can change under us
+  Py_BEGIN_ALLOW_THREADS
   outsize = Xpress_Decompress(inbuff, insize, outbuff, outsize);
+  Py_END_ALLOW_THREADS
 
   // Truncate buffer back to outsize:
   if(_PyString_Resize(&result, outsize) < 0) 
@@ -206,9 +253,81 @@ static PyObject *xpress_decode(PyObject *self, PyObject *args) {
   return result;
 };
 
+/* Decodes a list of compressed blocks, releasing the GIL once for all
+   of them. */
+static PyObject *xpress_decode_many(PyObject *self, PyObject *args) {
+  PyObject *blocks, *seq, *result=NULL;
+  Py_ssize_t count, i;
+  char **inbuffs = NULL;
+  Py_ssize_t *sizes = NULL;
+
+  if(!PyArg_ParseTuple(args, "O", &blocks))
+    return NULL;
+
+  // A tuple holds on to the strings while we do not have the GIL, a
+  // list could be changed by another thread.
+  seq = PySequence_Tuple(blocks);
+  if(!seq) return NULL;
+
+  count = PyTuple_GET_SIZE(seq);
+  result = PyList_New(count);
+  inbuffs = PyMem_New(char *, count + 1);
+  sizes = PyMem_New(Py_ssize_t, count + 1);
+  if(!result || !inbuffs || !sizes) {
+    PyErr_NoMemory();
+    goto error;
+  };
+
+  // Set up all the input and output buffers while we hold the GIL
+  for(i=0; i<count; i++) {
+    PyObject *out;
+
+    if(PyString_AsStringAndSize(PyTuple_GET_ITEM(seq, i),
+				&inbuffs[i], &sizes[i]) < 0)
+      goto error;
+
+    out = PyString_FromStringAndSize(NULL, UNCOMPRESSED_BLOCK_SIZE);
+    if(!out) goto error;
+    PyList_SET_ITEM(result, i, out);
+  };
+
+  Py_BEGIN_ALLOW_THREADS
+  for(i=0; i<count; i++)
+    sizes[i] = Xpress_Decompress((PUCHAR)inbuffs[i], sizes[i],
+				 (PUCHAR)PyString_AS_STRING(PyList_GET_ITEM(result, i)),
+				 UNCOMPRESSED_BLOCK_SIZE);
+  Py_END_ALLOW_THREADS
+
+  // Truncate each buffer back to its size:
+  for(i=0; i<count; i++) {
+    PyObject *out = PyList_GET_ITEM(result, i);
+
+    if(_PyString_Resize(&out, sizes[i]) < 0) {
+      // _PyString_Resize has released the old string already
+      PyList_SET_ITEM(result, i, NULL);
+      goto error;
+    };
+    PyList_SET_ITEM(result, i, out);
+  };
+
+  PyMem_Free(inbuffs);
+  PyMem_Free(sizes);
+  Py_DECREF(seq);
+  return result;
+
+ error:
+  PyMem_Free(inbuffs);
+  PyMem_Free(sizes);
+  Py_XDECREF(result);
+  Py_DECREF(seq);
+  return NULL;
+};
+
 static PyMethodDef pyxpressMethods[] = {
   {"decode", (PyCFunction)xpress_decode, METH_VARARGS,
    "decode a buffer" },
+  {"decode_many", (PyCFunction)xpress_decode_many, METH_VARARGS,
+   "decode a list of buffers, returns a list of the decoded buffers" },
   {NULL, NULL, 0, NULL}
 };
 
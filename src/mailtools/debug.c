@@ -23,7 +23,8 @@ struct pst_debug_item {
 struct pst_debug_func {
     char * name;
     struct pst_debug_func *next;
-} *func_head=NULL, *func_ptr=NULL;
+};
+PST_THREAD_LOCAL struct pst_debug_func *func_head=NULL, *func_ptr=NULL;
 
 
 void pst_debug_write_msg(struct pst_debug_item *item, const char *fmt, va_list *ap, int size);
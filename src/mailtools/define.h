@@ -34,6 +34,16 @@
 //number of items to save in memory between writes
 #define DEBUG_MAX_ITEMS 0
 
+// state which is kept per thread, so that several threads can parse
+// items at once, each through its own pst_open_handle()
+#if defined(_MSC_VER)
+#define PST_THREAD_LOCAL __declspec(thread)
+#elif defined(__GNUC__)
+#define PST_THREAD_LOCAL __thread
+#else
+#define PST_THREAD_LOCAL
+#endif
+
 #define DEBUG_FILE_NO     1
 #define DEBUG_INDEX_NO    2
 #define DEBUG_EMAIL_NO    3
@@ -40,6 +40,12 @@
 
 #define PST_SIGNATURE 0x4E444221
 
+#define PST_DESC_HASH_MIN       1024    // initial slots in the descriptor hash
+#define PST_ID2_TABLE_MIN       8       // shorter id2 lists are searched linearly
+#define PST_ID_HASH(id)         ((size_t)(((uint64_t)(id) * 0x9E3779B97F4A7C15ULL) >> 32))
+#define PST_CACHE_SIZE          (16*1024*1024)  // bytes of file blocks kept in memory
+#define PST_CACHE_HASH          4096            // block cache hash buckets
+
 
 struct pst_table_ptr_struct32{
   uint32_t start;
@@ -155,10 +161,35 @@ static unsigned char comp_high2 [] = {
     0x61, 0xe0, 0xc6, 0xc1, 0x59, 0xab, 0xbb, 0x58, 0xde, 0x5f, 0xdf, 0x60, 0x79, 0x7e, 0xb2, 0x8a
 };
 
+// for "strong" encryption, comp_high1, comp_high2 and comp_enc folded into
+// one table for each value of the high salt byte, see pst_decrypt_init()
+static unsigned char comp_strong[256][256];
+static int comp_strong_ready = 0;
+
+
+static void pst_decrypt_init(void);
+static void pst_decrypt_init(void) {
+    int hisalt, x;
+    unsigned char y;
+    if (comp_strong_ready) return;
+    for (hisalt=0; hisalt<256; hisalt++) {
+        for (x=0; x<256; x++) {
+            y = comp_high1[x];
+            y += (unsigned char)hisalt;
+            y = comp_high2[y];
+            y -= (unsigned char)hisalt;
+            comp_strong[hisalt][x] = comp_enc[y];
+        }
+    }
+    comp_strong_ready = 1;
+}
+
+
 int pst_open(pst_file *pf, char *name) {
     int32_t sig;
 
     unicode_init();
+    pst_decrypt_init();     // before any reader threads can race on it
 
     DEBUG_ENT("pst_open");
 
@@ -168,6 +199,7 @@ int pst_open(pst_file *pf, char *name) {
         return -1;
     }
     memset(pf, 0, sizeof(*pf));
+    pf->cache_max = PST_CACHE_SIZE;
 
     if ((pf->fp = fopen(name, "rb")) == NULL) {
         WARN(("cannot open PST file. Error\n"));
@@ -226,6 +258,7 @@ int pst_open(pst_file *pf, char *name) {
 }
 
 
+static void pst_cache_free(pst_file *pf);
 int pst_close(pst_file *pf) {
     DEBUG_ENT("pst_close");
     if (!pf->fp) {
@@ -242,6 +275,61 @@ int pst_close(pst_file *pf) {
     pst_free_id (pf->i_head);
     pst_free_desc (pf->d_head);
     pst_free_xattrib (pf->x_head);
+    if (pf->i_table) free(pf->i_table);
+    if (pf->d_table) free(pf->d_table);
+    pf->i_table = NULL;
+    pf->d_table = NULL;
+    DEBUG_INFO(("block cache hits %"PRIu64" misses %"PRIu64"\n", pf->cache_hits, pf->cache_misses));
+    pst_cache_free(pf);
+    DEBUG_RET();
+    return 0;
+}
+
+
+/**
+ * open another handle on a pst file which has already been opened
+ * and indexed. The handle shares the index of pf but has its own file
+ * pointer and block cache, so threads can parse items at the same
+ * time with one handle each. Each thread must also call unicode_init().
+ *
+ * @param pf      the pst file, after pst_load_index()
+ * @param handle  filled in with the new handle
+ * @param name    the name pf was opened with
+ * @return 0 on success, -1 if the file could not be opened
+ */
+int pst_open_handle(pst_file *pf, pst_file *handle, char *name) {
+    DEBUG_ENT("pst_open_handle");
+    *handle = *pf;
+    handle->cache_hash = NULL;
+    handle->cache_head = handle->cache_tail = NULL;
+    handle->cache_size = 0;
+    handle->cache_hits = handle->cache_misses = 0;
+
+    if ((handle->fp = fopen(name, "rb")) == NULL) {
+        WARN(("cannot open PST file for another handle\n"));
+        DEBUG_RET();
+        return -1;
+    }
+    DEBUG_RET();
+    return 0;
+}
+
+
+/**
+ * close a handle from pst_open_handle(). This leaves the shared index
+ * alone, so it must be called before pst_close() on the original.
+ */
+int pst_close_handle(pst_file *handle) {
+    DEBUG_ENT("pst_close_handle");
+    if (!handle->fp) {
+        WARN(("cannot close NULL fp\n"));
+        DEBUG_RET();
+        return -1;
+    }
+    (void)fclose(handle->fp);
+    handle->fp = NULL;
+    DEBUG_INFO(("block cache hits %"PRIu64" misses %"PRIu64"\n", handle->cache_hits, handle->cache_misses));
+    pst_cache_free(handle);
     DEBUG_RET();
     return 0;
 }
@@ -272,6 +360,47 @@ static void add_descriptor_to_list(pst_desc_ll *node, pst_desc_ll **head, pst_de
 }
 
 
+/**
+ * add a pst descriptor node to the id hash used by pst_getDptr().
+ * If the id is already there the earlier node is kept.
+ *
+ * @param pf   global pst file pointer
+ * @param node pointer to the node to be added
+ */
+static void record_descriptor_hash(pst_file *pf, pst_desc_ll *node);
+static void record_descriptor_hash(pst_file *pf, pst_desc_ll *node)
+{
+    size_t i, mask;
+    if ((pf->d_count + 1) * 2 > pf->d_table_size) {
+        // keep the load factor under one half
+        pst_desc_ll **old = pf->d_table;
+        size_t j, old_size = pf->d_table_size;
+        pf->d_table_size = (old_size) ? old_size * 2 : PST_DESC_HASH_MIN;
+        pf->d_table = (pst_desc_ll**) xmalloc(pf->d_table_size * sizeof(pst_desc_ll*));
+        memset(pf->d_table, 0, pf->d_table_size * sizeof(pst_desc_ll*));
+        mask = pf->d_table_size - 1;
+        for (j=0; j<old_size; j++) {
+            if (!old[j]) continue;
+            i = PST_ID_HASH(old[j]->id) & mask;
+            while (pf->d_table[i]) i = (i + 1) & mask;
+            pf->d_table[i] = old[j];
+        }
+        if (old) free(old);
+    }
+    mask = pf->d_table_size - 1;
+    i = PST_ID_HASH(node->id) & mask;
+    while (pf->d_table[i]) {
+        if (pf->d_table[i]->id == node->id) {
+            DEBUG_INDEX(("Duplicate descriptor %#"PRIx64", keeping the first one\n", node->id));
+            return;
+        }
+        i = (i + 1) & mask;
+    }
+    pf->d_table[i] = node;
+    pf->d_count++;
+}
+
+
 /**
  * add a pst descriptor node into the global tree.
  *
@@ -332,6 +461,7 @@ static void record_descriptor(pst_file *pf, pst_desc_ll *node)
             add_descriptor_to_list(node, &pf->d_head, &pf->d_tail);
         }
     }
+    record_descriptor_hash(pf, node);
     DEBUG_RET();
 }
 
@@ -457,6 +587,44 @@ size_t pst_attach_to_file_base64(pst_file *pf, pst_item_attach *attach, FILE* fp
 }
 
 
+/**
+ * build pf->i_table from the id list so pst_getID() can binary search it.
+ * pst_build_id_ptr() rejects out of order ids, so the list is already
+ * sorted. If it somehow is not, leave the table out and let pst_getID()
+ * walk the list.
+ *
+ * @param pf   global pst file pointer
+ */
+static void build_id_table(pst_file *pf);
+static void build_id_table(pst_file *pf) {
+    pst_index_ll *ptr;
+    size_t n = 0;
+    DEBUG_ENT("build_id_table");
+    if (pf->i_table) free(pf->i_table);
+    pf->i_table = NULL;
+    pf->i_count = 0;
+    for (ptr = pf->i_head; ptr; ptr = ptr->next) n++;
+    if (!n) {
+        DEBUG_RET();
+        return;
+    }
+    pf->i_table = (pst_index_ll**) xmalloc(n * sizeof(pst_index_ll*));
+    n = 0;
+    for (ptr = pf->i_head; ptr; ptr = ptr->next) {
+        if (n && (pf->i_table[n-1]->id > ptr->id)) {
+            DEBUG_WARN(("id %#"PRIx64" is out of order, id lookups will be linear\n", ptr->id));
+            free(pf->i_table);
+            pf->i_table = NULL;
+            DEBUG_RET();
+            return;
+        }
+        pf->i_table[n++] = ptr;
+    }
+    pf->i_count = n;
+    DEBUG_RET();
+}
+
+
 int pst_load_index (pst_file *pf) {
     int  x;
     DEBUG_ENT("pst_load_index");
@@ -468,6 +636,7 @@ int pst_load_index (pst_file *pf) {
 
     x = pst_build_id_ptr(pf, pf->index1, 0, pf->index1_back, 0, UINT64_MAX);
     DEBUG_INDEX(("build id ptr returns %i\n", x));
+    build_id_table(pf);
 
     x = pst_build_desc_ptr(pf, pf->index2, 0, pf->index2_back, (uint64_t)0x21, UINT64_MAX);
     DEBUG_INDEX(("build desc ptr returns %i\n", x));
@@ -1609,8 +1778,8 @@ pst_num_array * pst_parse_block(pst_file *pf, uint64_t block_id, pst_index2_ll *
                 }
                 if (table_rec.ref_type == (uint16_t)0x1f) {
                     // there is more to do for the type 0x1f unicode strings
-                    static vbuf *strbuf = NULL;
-                    static vbuf *unibuf = NULL;
+                    static PST_THREAD_LOCAL vbuf *strbuf = NULL;
+                    static PST_THREAD_LOCAL vbuf *unibuf = NULL;
                     if (!strbuf) strbuf=vballoc((size_t)1024);
                     if (!unibuf) unibuf=vballoc((size_t)1024);
 
@@ -3550,6 +3719,7 @@ void pst_free_id2(pst_index2_ll * head) {
     DEBUG_ENT("pst_free_id2");
     while (head) {
         t = head->next;
+        if (head->sorted) free(head->sorted);
         free (head);
         head = t;
     }
@@ -3606,9 +3776,56 @@ void pst_free_xattrib(pst_x_attrib_ll *x) {
 }
 
 
+typedef struct pst_id2_sort {
+    pst_index2_ll *node;
+    size_t pos;
+} pst_id2_sort;
+
+
+static int pst_id2_sort_cmp(const void *a, const void *b);
+static int pst_id2_sort_cmp(const void *a, const void *b) {
+    const pst_id2_sort *x = (const pst_id2_sort*)a;
+    const pst_id2_sort *y = (const pst_id2_sort*)b;
+    if (x->node->id2 != y->node->id2) return (x->node->id2 < y->node->id2) ? -1 : 1;
+    if (x->pos != y->pos) return (x->pos < y->pos) ? -1 : 1;
+    return 0;
+}
+
+
+/**
+ * attach a sorted lookup table to the head of a finished id2 list.
+ * Only the first node for each id2 goes in the table, since that is
+ * the one a walk of the list would find.
+ *
+ * @param head  head of the list built by pst_build_id2()
+ */
+static void build_id2_table(pst_index2_ll *head);
+static void build_id2_table(pst_index2_ll *head) {
+    pst_index2_ll *ptr;
+    pst_id2_sort *s;
+    size_t i, n = 0;
+    for (ptr = head; ptr; ptr = ptr->next) n++;
+    if (n < PST_ID2_TABLE_MIN) return;
+    s = (pst_id2_sort*) xmalloc(n * sizeof(pst_id2_sort));
+    for (i = 0, ptr = head; ptr; ptr = ptr->next, i++) {
+        s[i].node = ptr;
+        s[i].pos  = i;
+    }
+    qsort(s, n, sizeof(pst_id2_sort), pst_id2_sort_cmp);
+    head->sorted = (pst_index2_ll**) xmalloc(n * sizeof(pst_index2_ll*));
+    head->count  = 0;
+    for (i = 0; i < n; i++) {
+        if (head->count && (head->sorted[head->count-1]->id2 == s[i].node->id2)) continue;
+        head->sorted[head->count++] = s[i].node;
+    }
+    free(s);
+}
+
+
 pst_index2_ll * pst_build_id2(pst_file *pf, pst_index_ll* list, pst_index2_ll* head_ptr) {
     pst_block_header block_head;
     pst_index2_ll *head = NULL, *tail = NULL;
+    int top = (head_ptr == NULL);
     uint16_t x = 0;
     char *b_ptr = NULL;
     char *buf = NULL;
@@ -3655,9 +3872,11 @@ pst_index2_ll * pst_build_id2(pst_file *pf, pst_index_ll* list, pst_index2_ll* h
                          i_ptr->id, i_ptr->offset, i_ptr->u1, i_ptr->size, i_ptr->size));
             // add it to the linked list
             i2_ptr = (pst_index2_ll*) xmalloc(sizeof(pst_index2_ll));
-            i2_ptr->id2  = id2_rec.id2;
-            i2_ptr->id   = i_ptr;
-            i2_ptr->next = NULL;
+            i2_ptr->id2    = id2_rec.id2;
+            i2_ptr->id     = i_ptr;
+            i2_ptr->next   = NULL;
+            i2_ptr->sorted = NULL;
+            i2_ptr->count  = 0;
             if (!head) head = i2_ptr;
             if (tail)  tail->next = i2_ptr;
             tail = i2_ptr;
@@ -3688,6 +3907,7 @@ pst_index2_ll * pst_build_id2(pst_file *pf, pst_index_ll* list, pst_index2_ll* h
         x++;
     }
     if (buf) free (buf);
+    if (top && head) build_id2_table(head);
     DEBUG_RET();
     return head;
 }
@@ -3991,9 +4211,21 @@ pst_index_ll* pst_getID(pst_file* pf, uint64_t id) {
     id -= (id & 1);
 
     DEBUG_INDEX(("Trying to find %#"PRIx64"\n", id));
-    ptr = pf->i_head;
-    while (ptr && (ptr->id != id)) {
-        ptr = ptr->next;
+    if (pf->i_table) {
+        // lower bound, so duplicates resolve to the first one in the list
+        size_t lo = 0, hi = pf->i_count, mid;
+        while (lo < hi) {
+            mid = lo + (hi - lo) / 2;
+            if (pf->i_table[mid]->id < id) lo = mid + 1;
+            else                            hi = mid;
+        }
+        ptr = ((lo < pf->i_count) && (pf->i_table[lo]->id == id)) ? pf->i_table[lo] : NULL;
+    }
+    else {
+        ptr = pf->i_head;
+        while (ptr && (ptr->id != id)) {
+            ptr = ptr->next;
+        }
     }
     if (ptr) {DEBUG_INDEX(("Found Value %#"PRIx64"\n", id));            }
     else     {DEBUG_INDEX(("ERROR: Value %#"PRIx64" not found\n", id)); }
@@ -4005,6 +4237,20 @@ pst_index_ll* pst_getID(pst_file* pf, uint64_t id) {
 pst_index_ll * pst_getID2(pst_index2_ll *ptr, uint64_t id) {
     DEBUG_ENT("pst_getID2");
     DEBUG_INDEX(("Head = %p id = %#"PRIx64"\n", ptr, id));
+    if (ptr && ptr->sorted) {
+        size_t lo = 0, hi = ptr->count, mid;
+        pst_index2_ll **sorted = ptr->sorted;
+        ptr = NULL;
+        while (lo < hi) {
+            mid = lo + (hi - lo) / 2;
+            if      (sorted[mid]->id2 < id) lo = mid + 1;
+            else if (sorted[mid]->id2 > id) hi = mid;
+            else {
+                ptr = sorted[mid];
+                break;
+            }
+        }
+    }
     while (ptr && (ptr->id2 != id)) {
         ptr = ptr->next;
     }
@@ -4031,6 +4277,14 @@ pst_index_ll * pst_getID2(pst_index2_ll *ptr, uint64_t id) {
 pst_desc_ll* pst_getDptr(pst_file *pf, uint64_t id) {
     pst_desc_ll *ptr = pf->d_head;
     DEBUG_ENT("pst_getDptr");
+    if (pf->d_table) {
+        // every node in the tree went through record_descriptor()
+        size_t mask = pf->d_table_size - 1;
+        size_t i = PST_ID_HASH(id) & mask;
+        while ((ptr = pf->d_table[i]) && (ptr->id != id)) i = (i + 1) & mask;
+        DEBUG_RET();
+        return ptr;
+    }
     while (ptr && (ptr->id != id)) {
         //DEBUG_INDEX(("Looking for %#"PRIx64" at node %#"PRIx64" with parent %#"PRIx64"\n", id, ptr->id, ptr->parent_id));
         if (ptr->child) {
@@ -4084,17 +4338,109 @@ void pst_printID2ptr(pst_index2_ll *ptr) {
 
 
 /**
- * Read a block of data from file into memory
- * @param pf     PST file
- * @param offset offset in the pst file of the data
- * @param size   size of the block to be read
+ * find a block in the block cache and make it the most recently used.
+ *
+ * @param pf     PST file structure
+ * @param offset offset of the block in the pst file
+ * @param size   size of the block
+ * @param id     id the block was decrypted with, 0 for raw data
+ * @return       the cache entry, or NULL if the block is not cached
+ */
+static pst_block_cache* pst_cache_find(pst_file *pf, off_t offset, size_t size, uint64_t id);
+static pst_block_cache* pst_cache_find(pst_file *pf, off_t offset, size_t size, uint64_t id) {
+    pst_block_cache *e;
+    if (!pf->cache_hash) return NULL;
+    e = pf->cache_hash[PST_ID_HASH(offset) & (PST_CACHE_HASH-1)];
+    while (e && ((e->offset != offset) || (e->size != size) || (e->id != id))) e = e->hnext;
+    if (e && (e != pf->cache_head)) {
+        // move to the front of the lru list
+        e->prev->next = e->next;
+        if (e->next) e->next->prev = e->prev; else pf->cache_tail = e->prev;
+        e->prev = NULL;
+        e->next = pf->cache_head;
+        pf->cache_head->prev = e;
+        pf->cache_head = e;
+    }
+    return e;
+}
+
+
+static void pst_cache_remove(pst_file *pf, pst_block_cache *e);
+static void pst_cache_remove(pst_file *pf, pst_block_cache *e) {
+    pst_block_cache **h = &(pf->cache_hash[PST_ID_HASH(e->offset) & (PST_CACHE_HASH-1)]);
+    while (*h != e) h = &((*h)->hnext);
+    *h = e->hnext;
+    if (e->prev) e->prev->next = e->next; else pf->cache_head = e->next;
+    if (e->next) e->next->prev = e->prev; else pf->cache_tail = e->prev;
+    pf->cache_size -= e->size;
+    free(e->data);
+    free(e);
+}
+
+
+/**
+ * add a copy of a block to the block cache, dropping least recently
+ * used blocks to make room. Blocks bigger than a sixteenth of the cache
+ * are not kept.
+ *
+ * @param pf     PST file structure
+ * @param offset offset of the block in the pst file
+ * @param size   size of the block
+ * @param id     id the block was decrypted with, 0 for raw data
+ * @param data   contents of the block
+ */
+static void pst_cache_add(pst_file *pf, off_t offset, size_t size, uint64_t id, char *data);
+static void pst_cache_add(pst_file *pf, off_t offset, size_t size, uint64_t id, char *data) {
+    pst_block_cache *e, **h;
+    if (!size || (size > pf->cache_max / 16)) return;
+    if (!pf->cache_hash) {
+        pf->cache_hash = (pst_block_cache**) xmalloc(PST_CACHE_HASH * sizeof(pst_block_cache*));
+        memset(pf->cache_hash, 0, PST_CACHE_HASH * sizeof(pst_block_cache*));
+    }
+    while (pf->cache_tail && (pf->cache_size + size > pf->cache_max)) {
+        pst_cache_remove(pf, pf->cache_tail);
+    }
+    e = (pst_block_cache*) xmalloc(sizeof(pst_block_cache));
+    e->offset = offset;
+    e->size   = size;
+    e->id     = id;
+    e->data   = (char*) xmalloc(size);
+    memcpy(e->data, data, size);
+    h = &(pf->cache_hash[PST_ID_HASH(offset) & (PST_CACHE_HASH-1)]);
+    e->hnext  = *h;
+    *h        = e;
+    e->prev   = NULL;
+    e->next   = pf->cache_head;
+    if (pf->cache_head) pf->cache_head->prev = e; else pf->cache_tail = e;
+    pf->cache_head = e;
+    pf->cache_size += size;
+}
+
+
+static void pst_cache_free(pst_file *pf) {
+    while (pf->cache_head) pst_cache_remove(pf, pf->cache_head);
+    if (pf->cache_hash) free(pf->cache_hash);
+    pf->cache_hash = NULL;
+}
+
+
+/**
+ * Read a block from the pst file through the block cache, decrypting
+ * it if asked to. Decrypted blocks are cached separately from raw ones.
+ *
+ * @param pf     PST file structure
+ * @param offset offset of the block in the pst file
+ * @param size   size of the block
  * @param buf    reference to pointer to buffer. If this pointer
                  is non-NULL, it will first be free()d
+ * @param id     id to decrypt the block with, 0 to return raw data
  * @return       size of block read into memory
  */
-size_t pst_read_block_size(pst_file *pf, off_t offset, size_t size, char **buf) {
+static size_t pst_read_block(pst_file *pf, off_t offset, size_t size, char **buf, uint64_t id);
+static size_t pst_read_block(pst_file *pf, off_t offset, size_t size, char **buf, uint64_t id) {
     size_t rsize;
-    DEBUG_ENT("pst_read_block_size");
+    pst_block_cache *e;
+    DEBUG_ENT("pst_read_block");
     DEBUG_READ(("Reading block from %#"PRIx64", %x bytes\n", offset, size));
 
     if (*buf) {
@@ -4103,7 +4449,16 @@ size_t pst_read_block_size(pst_file *pf, off_t offset, size_t size, char **buf)
     }
     *buf = (char*) xmalloc(size);
 
+    if ((e = pst_cache_find(pf, offset, size, id))) {
+        memcpy(*buf, e->data, size);
+        pf->cache_hits++;
+        DEBUG_RET();
+        return size;
+    }
+    pf->cache_misses++;
+
     rsize = pst_getAtPos(pf, offset, *buf, size);
+    if (id) (void)pst_decrypt(id, *buf, rsize, pf->encryption);
     if (rsize != size) {
         DEBUG_WARN(("Didn't read all the data. fread returned less [%i instead of %i]\n", rsize, size));
         if (feof(pf->fp)) {
@@ -4114,15 +4469,36 @@ size_t pst_read_block_size(pst_file *pf, off_t offset, size_t size, char **buf)
             DEBUG_WARN(("I can't tell why it failed\n"));
         }
     }
+    else {
+        pst_cache_add(pf, offset, size, id, *buf);
+    }
 
     DEBUG_RET();
     return rsize;
 }
 
 
+/**
+ * Read a block of data from file into memory
+ * @param pf     PST file
+ * @param offset offset in the pst file of the data
+ * @param size   size of the block to be read
+ * @param buf    reference to pointer to buffer. If this pointer
+                 is non-NULL, it will first be free()d
+ * @return       size of block read into memory
+ */
+size_t pst_read_block_size(pst_file *pf, off_t offset, size_t size, char **buf) {
+    size_t rsize;
+    DEBUG_ENT("pst_read_block_size");
+    rsize = pst_read_block(pf, offset, size, buf, 0);
+    DEBUG_RET();
+    return rsize;
+}
+
+
 int pst_decrypt(uint64_t id, char *buf, size_t size, unsigned char type) {
     size_t x = 0;
-    unsigned char y;
+    unsigned char *p = (unsigned char*)buf;
     DEBUG_ENT("pst_decrypt");
     if (!buf) {
         DEBUG_RET();
@@ -4131,31 +4507,54 @@ int pst_decrypt(uint64_t id, char *buf, size_t size, unsigned char type) {
 
     if (type == PST_COMP_ENCRYPT) {
         x = 0;
+        // transpose from encrypt array, eight bytes at a time
+        while (x + 8 <= size) {
+            p[x]   = comp_enc[p[x]];
+            p[x+1] = comp_enc[p[x+1]];
+            p[x+2] = comp_enc[p[x+2]];
+            p[x+3] = comp_enc[p[x+3]];
+            p[x+4] = comp_enc[p[x+4]];
+            p[x+5] = comp_enc[p[x+5]];
+            p[x+6] = comp_enc[p[x+6]];
+            p[x+7] = comp_enc[p[x+7]];
+            x += 8;
+        }
         while (x < size) {
-            y = (unsigned char)(buf[x]);
-            buf[x] = (char)comp_enc[y]; // transpose from encrypt array
+            p[x] = comp_enc[p[x]];
             x++;
         }
 
     } else if (type == PST_ENCRYPT) {
         // The following code was based on the information at
         // http://www.passcape.com/outlook_passwords.htm
+        // Each byte goes through comp_high1, comp_high2 and comp_enc with the
+        // salt added and removed in between. The high salt byte only changes
+        // every 256 bytes, so comp_strong holds the three lookups folded
+        // together for each high byte and only the low byte is applied here.
         uint16_t salt = (uint16_t) (((id & 0x00000000ffff0000) >> 16) ^ (id & 0x000000000000ffff));
+        pst_decrypt_init();
         x = 0;
         while (x < size) {
-            uint8_t losalt = (salt & 0x00ff);
-            uint8_t hisalt = (salt & 0xff00) >> 8;
-            y = (unsigned char)buf[x];
-            y += losalt;
-            y = comp_high1[y];
-            y += hisalt;
-            y = comp_high2[y];
-            y -= hisalt;
-            y = comp_enc[y];
-            y -= losalt;
-            buf[x] = (char)y;
-            x++;
-            salt++;
+            const unsigned char *t = comp_strong[(salt & 0xff00) >> 8];
+            unsigned char losalt = (unsigned char)(salt & 0x00ff);
+            size_t run = 256 - losalt;      // bytes until the high byte changes
+            size_t end;
+            if (run > size - x) run = size - x;
+            end = x + run;
+            salt = (uint16_t)(salt + run);
+            while (x + 4 <= end) {
+                p[x]   = (unsigned char)(t[(unsigned char)(p[x]   + losalt)]     -  losalt);
+                p[x+1] = (unsigned char)(t[(unsigned char)(p[x+1] + losalt + 1)] - (losalt + 1));
+                p[x+2] = (unsigned char)(t[(unsigned char)(p[x+2] + losalt + 2)] - (losalt + 2));
+                p[x+3] = (unsigned char)(t[(unsigned char)(p[x+3] + losalt + 3)] - (losalt + 3));
+                x += 4;
+                losalt += 4;
+            }
+            while (x < end) {
+                p[x] = (unsigned char)(t[(unsigned char)(p[x] + losalt)] - losalt);
+                x++;
+                losalt++;
+            }
         }
 
     } else {
@@ -4258,9 +4657,18 @@ size_t pst_ff_getIDblock_dec(pst_file *pf, uint64_t id, char **buf) {
     int noenc = (int)(id & 2);   // disable encryption
     DEBUG_ENT("pst_ff_getIDblock_dec");
     DEBUG_INDEX(("for id %#x\n", id));
-    r = pst_ff_getIDblock(pf, id, buf);
     if ((pf->encryption) && !(noenc)) {
-        (void)pst_decrypt(id, *buf, r, pf->encryption);
+        // let the block cache keep the decrypted data
+        pst_index_ll *rec = pst_getID(pf, id);
+        if (!rec) {
+            DEBUG_INDEX(("Cannot find ID %#"PRIx64"\n", id));
+            DEBUG_RET();
+            return 0;
+        }
+        r = pst_read_block(pf, rec->offset, rec->size, buf, id);
+    }
+    else {
+        r = pst_ff_getIDblock(pf, id, buf);
     }
     DEBUG_HEXDUMPC(*buf, r, 16);
     DEBUG_RET();
@@ -183,6 +183,10 @@ typedef struct pst_index2_tree {
     uint64_t id2;
     pst_index_ll *id;
     struct pst_index2_tree * next;
+    // only set on the head of a long list, the first node for each
+    // id2 sorted by id2 so pst_getID2() can binary search
+    struct pst_index2_tree ** sorted;
+    size_t count;
 } pst_index2_ll;
 
 
@@ -485,12 +489,39 @@ typedef struct pst_block_recorder {
 } pst_block_recorder;
 
 
+typedef struct pst_block_cache {
+    struct pst_block_cache     *prev;   // lru list, most recently used first
+    struct pst_block_cache     *next;
+    struct pst_block_cache     *hnext;  // hash chain
+    off_t                       offset;
+    size_t                      size;
+    uint64_t                    id;     // id the data was decrypted with, 0 if raw
+    char                       *data;
+} pst_block_cache;
+
+
 typedef struct pst_file {
     pst_index_ll *i_head, *i_tail;
     pst_desc_ll  *d_head, *d_tail;
     pst_x_attrib_ll *x_head;
     pst_block_recorder *block_head;
 
+    // i_head as an array sorted by id, for pst_getID()
+    pst_index_ll **i_table;
+    size_t i_count;
+    // open addressed hash of every descriptor by id, for pst_getDptr()
+    pst_desc_ll **d_table;
+    size_t d_table_size;
+    size_t d_count;
+    // lru cache of blocks read from the file, set cache_max
+    // to 0 after pst_open() to disable it
+    pst_block_cache **cache_hash;
+    pst_block_cache *cache_head, *cache_tail;
+    size_t cache_size;
+    size_t cache_max;
+    uint64_t cache_hits;
+    uint64_t cache_misses;
+
     //set this to 0 to read 32-bit pst files (pre Outlook 2003)
     //set this to 1 to read 64-bit pst files (Outlook 2003 and later)
     int do_read64;
@@ -560,6 +591,8 @@ typedef struct pst_subblocks {
 // prototypes
 int            pst_open(pst_file *pf, char *name);
 int            pst_close(pst_file *pf);
+int            pst_open_handle(pst_file *pf, pst_file *handle, char *name);
+int            pst_close_handle(pst_file *handle);
 pst_desc_ll *  pst_getTopOfFolders(pst_file *pf, pst_item *root);
 size_t         pst_attach_to_mem(pst_file *pf, pst_item_attach *attach, char **b);
 size_t         pst_attach_to_file(pst_file *pf, pst_item_attach *attach, FILE* fp);
@@ -40,12 +40,22 @@ typedef struct _lzfuheader {
 } lzfuheader;
 
 
+/**
+ * decompress a compressed RTF body.
+ *
+ * The dictionary is the initial dictionary followed by everything
+ * decoded so far, of which the last 4096 bytes are kept in a ring. We
+ * decode straight into the output buffer and read back references from
+ * there, so they are bulk copies without any wrap around of indexes.
+ * Only the first 4096 bytes of output can reach back into the initial
+ * dictionary.
+ */
 char* lzfu_decompress(char* rtfcomp, uint32_t compsize, size_t *size) {
-	unsigned char dict[4096];       // the dictionary buffer
-	unsigned int dict_length = 0;   // the dictionary pointer
 	lzfuheader lzfuhdr;             // the header of the lzfu block
 	unsigned char flags;            // 8 bits of flags (1=2byte block pointer into the dict, 0=1 byte literal)
 	unsigned char flag_mask;        // look at one flag bit each time thru the loop
+	unsigned char *in = (unsigned char*)rtfcomp;
+	unsigned char *out;
 	uint32_t i;
 	char    *out_buf;
 	uint32_t out_ptr  = 0;
@@ -53,73 +63,64 @@ char* lzfu_decompress(char* rtfcomp, uint32_t compsize, size_t *size) {
 	uint32_t in_ptr;
 	uint32_t in_size;
 
-	memcpy(dict, LZFU_INITDICT, LZFU_INITLENGTH);
-    memset(dict + LZFU_INITLENGTH, 0, sizeof(dict) - LZFU_INITLENGTH);
-	dict_length = LZFU_INITLENGTH;
-
 	memcpy(&lzfuhdr, rtfcomp, sizeof(lzfuhdr));
 	LE32_CPU(lzfuhdr.cbSize);
 	LE32_CPU(lzfuhdr.cbRawSize);
 	LE32_CPU(lzfuhdr.dwMagic);
 	LE32_CPU(lzfuhdr.dwCRC);
-	//printf("total size: %d\n", lzfuhdr.cbSize+4);
-	//printf("raw size  : %d\n", lzfuhdr.cbRawSize);
-	//printf("compressed: %s\n", (lzfuhdr.dwMagic == LZFU_COMPRESSED ? "yes" : "no"));
-	//printf("CRC       : %#x\n", lzfuhdr.dwCRC);
-	//printf("\n");
 	out_size = lzfuhdr.cbRawSize;
 	out_buf  = (char*)xmalloc(out_size);
+	out      = (unsigned char*)out_buf;
 	in_ptr	 = sizeof(lzfuhdr);
 	// Make sure to correct lzfuhdr.cbSize with 4 bytes before comparing
 	// to compsize
 	in_size  = (lzfuhdr.cbSize + 4 < compsize) ? lzfuhdr.cbSize + 4 : compsize;
-	while (in_ptr < in_size) {
-		flags = (unsigned char)(rtfcomp[in_ptr++]);
-		flag_mask = 1;
-		while (flag_mask) {
-			if (flag_mask & flags) {
-				// two bytes available?
-				if (in_ptr+1 < in_size) {
-					// read 2 bytes from input
-					unsigned short int blkhdr, offset, length;
-					memcpy(&blkhdr, rtfcomp+in_ptr, 2);
-					LE16_CPU(blkhdr);
-					in_ptr += 2;
-					/* swap the upper and lower bytes of blkhdr */
-					blkhdr = (((blkhdr&0xFF00)>>8)+
-							  ((blkhdr&0x00FF)<<8));
-					/* the offset is the first 12 bits of the 16 bit value */
-					offset = (blkhdr&0xFFF0)>>4;
-					/* the length of the dict entry are the last 4 bits */
-					length = (blkhdr&0x000F)+2;
-					// add the value we are about to print to the dictionary
+
+	// Once the output is full nothing else that is decoded is kept, so
+	// we can stop there.
+	while (in_ptr < in_size && out_ptr < out_size) {
+		flags = in[in_ptr++];
+		for (flag_mask = 1; flag_mask && out_ptr < out_size; flag_mask <<= 1) {
+			if (!(flag_mask & flags)) {
+				// one byte available?
+				if (in_ptr < in_size) out[out_ptr++] = in[in_ptr++];
+			} else if (in_ptr+1 < in_size) {
+				// the first 12 bits are the offset into the ring and the
+				// last 4 bits the length of the dict entry. The distance
+				// back from the current position is what we need.
+				unsigned int offset   = (in[in_ptr] << 4) | (in[in_ptr+1] >> 4);
+				unsigned int length   = (in[in_ptr+1] & 0x0F) + 2;
+				unsigned int distance = (out_ptr + LZFU_INITLENGTH - offset) & 0xFFF;
+				in_ptr += 2;
+
+				// whatever we decode past the end of the output is thrown away
+				if (length > out_size - out_ptr) length = out_size - out_ptr;
+
+				if (distance == 0) {
+					// the reference version zeros the next dictionary
+					// entry after every byte, so a pointer to the current
+					// position reads back zeros
+					memset(out + out_ptr, 0, length);
+				} else if (distance <= out_ptr) {
+					unsigned char *from = out + out_ptr - distance;
+					unsigned char *to   = out + out_ptr;
+					if (distance >= length) memcpy(to, from, length);
+					// a run which repeats the last distance bytes
+					else for (i=0; i < length; i++) to[i] = from[i];
+				} else {
+					// this reaches back past the start of the output, into the
+					// initial dictionary or the zeros after it
 					for (i=0; i < length; i++) {
-						unsigned char c1;
-						c1 = dict[(offset+i)%4096];
-						dict[dict_length] = c1;
-						dict_length = (dict_length+1) % 4096;
-						if (out_ptr < out_size) out_buf[out_ptr++] = (char)c1;
-						// required for dictionary wrap around
-						// otherwise 0 byte values are referenced incorrectly
-						dict[dict_length] = 0;
+						int pos = (int)(out_ptr + i) + LZFU_INITLENGTH - (int)distance;
+						if (pos >= LZFU_INITLENGTH) out[out_ptr+i] = out[pos - LZFU_INITLENGTH];
+						else if (pos >= 0) out[out_ptr+i] = LZFU_INITDICT[pos];
+						else out[out_ptr+i] = 0;
 					}
 				}
-			} else {
-				// one byte available?
-				if (in_ptr < in_size) {
-					// uncompressed chunk (single byte)
-					char c1 = rtfcomp[in_ptr++];
-					dict[dict_length] = c1;
-					dict_length = (dict_length+1)%4096;
-					if (out_ptr < out_size) out_buf[out_ptr++] = (char)c1;
-					// required for dictionary wrap around
-					// otherwise 0 byte values are referenced incorrect
-					dict[dict_length] = 0;
-				}
+				out_ptr += length;
 			}
-			flag_mask <<= 1;
 		}
 	}
-    *size = out_ptr;
+	*size = out_ptr;
 	return out_buf;
 }
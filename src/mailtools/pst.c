@@ -20,7 +20,9 @@ the c layer. */
 #include "libpst.h"
 #include "structmember.h"
 #include "timeconv.h"
+#include "vbuf.h"
 #include "time.h"
+#include <pthread.h>
 
 void *g_context;
 
@@ -33,8 +35,18 @@ typedef struct {
   pst_file *pst;
   pst_item *item;
   pst_desc_ll *ptr;
+
+  // The PstFile we came from, keeps pst alive. NULL for the root
+  // item which the PstFile itself holds.
+  PyObject *file;
 } PstItem;
 
+static void PstItem_dealloc(PstItem *self) {
+  if(self->item) pst_freeItem(self->item);
+  Py_XDECREF(self->file);
+  self->ob_type->tp_free((PyObject*)self);
+};
+
 PyObject *PstItem_str(PstItem *self, PyObject *args) {
   PyObject *result=NULL;
 
@@ -267,7 +279,7 @@ PyObject *PstItem_Properties(PstItem *self, PyObject *args) {
 	  size = pst_attach_to_mem(self->pst, attachment, &buff);
 	  body = PyString_FromStringAndSize(buff, size);
 
-	  //if(buff) talloc_free(buff);
+	  if(buff) free(buff);
 	};
 	SET_ITEM(attach_dict, "filename1", "%s", attachment->filename1);
 	SET_ITEM(attach_dict, "filename2", "%s", attachment->filename2);
@@ -378,7 +390,7 @@ static PyTypeObject PstItemType = {
     "pst.PstItem",             /* tp_name */
     sizeof(PstItem),           /* tp_basicsize */
     0,                         /* tp_itemsize */
-    0,                         /* tp_dealloc */
+    (destructor)PstItem_dealloc, /* tp_dealloc */
     0,                         /* tp_print */
     0,                         /* tp_getattr */
     0,                         /* tp_setattr */
@@ -420,9 +432,15 @@ typedef struct {
   pst_file pst;
   // That is the root item
   PstItem *root;
+
+  // Needed to open more handles for extract()
+  char *filename;
 } PstFile;
 
 static void PstFile_dealloc(PstFile *self) {
+  // The root item refers to the pst file so it goes first
+  Py_XDECREF(self->root);
+
   // Close the pst file.
   pst_close(&self->pst);
 
@@ -440,6 +458,7 @@ static int PstFile_init(PstFile *self, PyObject *args) {
   // All libpst allocations occur with this context:
   self->context = talloc_named_const(NULL, 0, "main context");
   g_context = self->context;
+  self->filename = talloc_strdup(self->context, filename);
 
   // Try to open the file:
   if(pst_open(&self->pst, filename) < 0) {
@@ -460,6 +479,7 @@ static int PstFile_init(PstFile *self, PyObject *args) {
   } else {
     self->root = PyObject_New(PstItem, &PstItemType);
     self->root->pst = &self->pst;
+    self->root->file = NULL;
     self->root->item = pst_parse_item(&self->pst, self->pst.d_head);
     self->root->ptr = pst_getTopOfFolders(&self->pst, self->root->item);
   };
@@ -484,6 +504,8 @@ static PyObject *PstFile_get_item_by_id(PstFile *self, PyObject *args) {
   if(item) {
     item->ptr = ptr;
     item->pst = &self->pst;
+    item->file = (PyObject *)self;
+    Py_INCREF(self);
     item->item = pst_parse_item(&self->pst, ptr);
   };
 
@@ -516,8 +538,11 @@ static PyObject *PstFile_listitems(PstFile *self, PyObject *args) {
     new_item->pst = &self->pst;
     new_item->item = pst_parse_item(&self->pst, ptr);
     new_item->ptr = ptr;
+    new_item->file = (PyObject *)self;
+    Py_INCREF(self);
 
     PyList_Append(result, (PyObject *)new_item);
+    Py_DECREF(new_item);
 
     ptr = ptr->next;
   };
@@ -529,11 +554,497 @@ static PyObject *PstFile_listitems(PstFile *self, PyObject *args) {
   return NULL;
 };
 
+/** An iterator over the descriptor tree below an item.
+
+Items are visited depth first (a folder comes before its contents)
+and each one is only parsed when the iterator reaches it, so memory
+use does not grow with the size of the mailbox. Each pst_item is
+freed as soon as python drops the PstItem it was returned in.
+*/
+typedef struct {
+  PyObject_HEAD
+  PstFile *file;
+
+  // We do not go above this node
+  pst_desc_ll *root;
+
+  // The next node to visit, NULL when we are done
+  pst_desc_ll *next;
+
+  // The last node we returned an item for
+  pst_desc_ll *last;
+
+  // A frozenset of descriptor ids to leave out along with
+  // everything below them, or NULL.
+  PyObject *skip;
+} PstIterator;
+
+/** Returns the node after ptr in a depth first walk below
+    self->root. If descend is 0 the children of ptr are not visited.
+*/
+static pst_desc_ll *PstIterator_advance(PstIterator *self, pst_desc_ll *ptr,
+					int descend) {
+  if(descend && ptr->child) return ptr->child;
+
+  while(ptr && ptr != self->root) {
+    if(ptr->next) return ptr->next;
+    ptr = ptr->parent;
+  };
+
+  return NULL;
+};
+
+static int PstIterator_skipped(PstIterator *self, pst_desc_ll *ptr) {
+  PyObject *id;
+  int result;
+
+  if(!self->skip) return 0;
+
+  id = PyLong_FromUnsignedLongLong(ptr->id);
+  if(!id) return -1;
+
+  result = PySet_Contains(self->skip, id);
+  Py_DECREF(id);
+
+  return result;
+};
+
+static void PstIterator_dealloc(PstIterator *self) {
+  Py_XDECREF(self->skip);
+  Py_XDECREF(self->file);
+  self->ob_type->tp_free((PyObject*)self);
+};
+
+static PyObject *PstIterator_iternext(PstIterator *self) {
+  while(self->next) {
+    pst_desc_ll *ptr = self->next;
+    pst_item *item;
+    PstItem *result;
+    int skipped = PstIterator_skipped(self, ptr);
+
+    if(skipped < 0) return NULL;
+    self->next = PstIterator_advance(self, ptr, !skipped);
+    if(skipped) continue;
+
+    // Descriptors which do not parse are not returned, but we still
+    // walk below them.
+    item = pst_parse_item(&self->file->pst, ptr);
+    if(!item) continue;
+
+    result = PyObject_New(PstItem, &PstItemType);
+    if(!result) {
+      pst_freeItem(item);
+      return NULL;
+    };
+
+    result->pst = &self->file->pst;
+    result->item = item;
+    result->ptr = ptr;
+    result->file = (PyObject *)self->file;
+    Py_INCREF(self->file);
+
+    self->last = ptr;
+    return (PyObject *)result;
+  };
+
+  // Finished
+  return NULL;
+};
+
+static PyObject *PstIterator_position(PstIterator *self, PyObject *args) {
+  if(!self->last) Py_RETURN_NONE;
+
+  return PyLong_FromUnsignedLongLong(self->last->id);
+};
+
+static PyMethodDef PstIterator_methods[] = {
+  {"position", (PyCFunction)PstIterator_position, METH_VARARGS,
+   "Returns the descriptor id of the last item returned (or None). Pass "
+   "this as resume to iteritems() to carry on from the same place later."},
+  { NULL }
+};
+
+static PyTypeObject PstIteratorType = {
+    PyObject_HEAD_INIT(NULL)
+    0,                         /* ob_size */
+    "pst.PstIterator",         /* tp_name */
+    sizeof(PstIterator),       /* tp_basicsize */
+    0,                         /* tp_itemsize */
+    (destructor)PstIterator_dealloc, /* tp_dealloc */
+    0,                         /* tp_print */
+    0,                         /* tp_getattr */
+    0,                         /* tp_setattr */
+    0,                         /* tp_compare */
+    0,                         /* tp_repr */
+    0,                         /* tp_as_number */
+    0,                         /* tp_as_sequence */
+    0,                         /* tp_as_mapping */
+    0,                         /* tp_hash */
+    0,                         /* tp_call */
+    0,                         /* tp_str */
+    0,                         /* tp_getattro */
+    0,                         /* tp_setattro */
+    0,                         /* tp_as_buffer */
+    Py_TPFLAGS_DEFAULT,        /* tp_flags */
+    "Iterates over the items below a folder",   /* tp_doc */
+    0,	                       /* tp_traverse */
+    0,                         /* tp_clear */
+    0,                         /* tp_richcompare */
+    0,                         /* tp_weaklistoffset */
+    PyObject_SelfIter,         /* tp_iter */
+    (iternextfunc)PstIterator_iternext, /* tp_iternext */
+    PstIterator_methods,       /* tp_methods */
+    0,                         /* tp_members */
+    0,                         /* tp_getset */
+    0,                         /* tp_base */
+    0,                         /* tp_dict */
+    0,                         /* tp_descr_get */
+    0,                         /* tp_descr_set */
+    0,                         /* tp_dictoffset */
+    0,                         /* tp_init */
+    0,                         /* tp_alloc */
+    0,                         /* tp_new */
+};
+
+static PyObject *PstFile_iteritems(PstFile *self, PyObject *args, PyObject *kwds) {
+  static char *kwlist[] = {"root", "skip", "resume", NULL};
+  PstItem *item=self->root;
+  PyObject *skip=Py_None;
+  PyObject *resume=Py_None;
+  PstIterator *iter;
+
+  if(!PyArg_ParseTupleAndKeywords(args, kwds, "|OOO", kwlist,
+				  &item, &skip, &resume))
+    return NULL;
+
+  if((PyObject *)item == Py_None) {
+    item = self->root;
+  } else if(item->ob_type != &PstItemType)
+    return PyErr_Format(PyExc_RuntimeError, "Expected a PstType object - try calling iteritems with no args");
+
+  if(!item || !item->ptr)
+    return PyErr_Format(PyExc_RuntimeError, "This item has no descriptor to iterate over");
+
+  iter = PyObject_New(PstIterator, &PstIteratorType);
+  if(!iter) return NULL;
+
+  iter->file = self;
+  Py_INCREF(self);
+  iter->root = item->ptr;
+  iter->next = item->ptr->child;
+  iter->last = NULL;
+  iter->skip = NULL;
+
+  if(skip != Py_None) {
+    iter->skip = PyFrozenSet_New(skip);
+    if(!iter->skip) goto error;
+  };
+
+  // Carry on after the item with this descriptor id
+  if(resume != Py_None) {
+    unsigned long long id = PyInt_Check(resume) ? (unsigned long long)PyInt_AsLong(resume) :
+      PyLong_AsUnsignedLongLong(resume);
+    pst_desc_ll *ptr, *p;
+
+    if(PyErr_Occurred()) goto error;
+
+    ptr = pst_getDptr(&self->pst, id);
+    for(p=ptr; p && p != iter->root; p=p->parent);
+    if(!ptr || !p || ptr == iter->root) {
+      PyErr_Format(PyExc_KeyError, "Descriptor %llu is not below this item", id);
+      goto error;
+    };
+
+    iter->last = ptr;
+    iter->next = PstIterator_advance(iter, ptr, 1);
+  };
+
+  return (PyObject *)iter;
+
+ error:
+  Py_DECREF(iter);
+  return NULL;
+};
+
+/* The most threads extract() will use */
+#define PST_EXTRACT_MAX_THREADS 32
+#define PST_EXTRACT_THREADS 4
+
+/* A file written by extract() */
+struct extract_file {
+  uint64_t id;
+  char *name;
+  char *path;
+};
+
+/* The descriptors to be extracted, shared by all threads */
+struct extract_batch {
+  pst_desc_ll **ptrs;
+  int count;
+  int next;               // next entry of ptrs to be extracted
+  pst_file *pst;
+  char *filename;
+  char *outdir;
+  pthread_mutex_t lock;
+};
+
+struct extract_thread {
+  struct extract_batch *batch;
+  pthread_t thread;
+
+  // The files written by this thread
+  struct extract_file *files;
+  int count;
+  int size;
+
+  // errno if this thread could not open its handle on the file
+  int error;
+};
+
+/* Writes size bytes from data to a new file called name in outdir,
+   or streams the attachment attach there if data is NULL. Adds it to
+   the thread's list of files. */
+static void extract_write(struct extract_thread *t, pst_file *pst, uint64_t id,
+			  char *name, char *suffix, char *data, size_t size,
+			  pst_item_attach *attach) {
+  struct extract_file *file;
+  char *path, *p;
+  FILE *fp;
+  int len = strlen(t->batch->outdir) + strlen(suffix) + 32;
+
+  path = (char *)malloc(len);
+  if(!path) return;
+  snprintf(path, len, "%s/%llu%s", t->batch->outdir, (unsigned long long)id, suffix);
+
+  // Attachment names come from the file and may not be safe as is
+  for(p=path + strlen(t->batch->outdir) + 1; *p; p++)
+    if(*p == '/' || *p == '\\') *p = '_';
+
+  fp = fopen(path, "wb");
+  if(!fp) {
+    free(path);
+    return;
+  };
+
+  if(data) fwrite(data, 1, size, fp);
+  else pst_attach_to_file(pst, attach, fp);
+  fclose(fp);
+
+  if(t->count >= t->size) {
+    struct extract_file *files;
+
+    t->size = t->size ? t->size * 2 : 64;
+    files = (struct extract_file *)realloc(t->files, t->size * sizeof(*files));
+    if(!files) {
+      free(path);
+      return;
+    };
+    t->files = files;
+  };
+
+  file = &t->files[t->count++];
+  file->id = id;
+  file->name = strdup(name);
+  file->path = path;
+};
+
+/* Parses items from the batch and writes out their bodies and
+   attachments until there are none left. Each thread reads through its
+   own handle on the pst file. */
+static void *extract_worker(void *data) {
+  struct extract_thread *t = (struct extract_thread *)data;
+  struct extract_batch *batch = t->batch;
+  pst_file pst;
+
+  if(pst_open_handle(batch->pst, &pst, batch->filename) < 0) {
+    t->error = errno ? errno : EIO;
+    return NULL;
+  };
+
+  unicode_init();
+
+  while(1) {
+    pst_desc_ll *ptr;
+    pst_item *item;
+
+    pthread_mutex_lock(&batch->lock);
+    if(batch->next >= batch->count) {
+      pthread_mutex_unlock(&batch->lock);
+      break;
+    };
+    ptr = batch->ptrs[batch->next++];
+    pthread_mutex_unlock(&batch->lock);
+
+    item = pst_parse_item(&pst, ptr);
+    if(!item) continue;
+
+    if(item->email) {
+      pst_item_attach *attach;
+      char suffix[64];
+      int i=0;
+
+      if(item->email->body)
+	extract_write(t, &pst, ptr->id, "body", ".txt", item->email->body,
+		      strlen(item->email->body), NULL);
+
+      if(item->email->htmlbody)
+	extract_write(t, &pst, ptr->id, "htmlbody", ".html", item->email->htmlbody,
+		      strlen(item->email->htmlbody), NULL);
+
+      for(attach=item->attach; attach; attach=attach->next, i++) {
+	char *name = attach->filename2 ? attach->filename2 : attach->filename1;
+
+	if(!attach->data && attach->id_val == (uint64_t)-1) continue;
+
+	snprintf(suffix, sizeof(suffix), "-%d-%s", i, name ? name : "attachment");
+	extract_write(t, &pst, ptr->id, name ? name : "", suffix, attach->data,
+		      attach->size, attach);
+      };
+    };
+
+    pst_freeItem(item);
+  };
+
+  unicode_close();
+  pst_close_handle(&pst);
+
+  return NULL;
+};
+
+static PyObject *PstFile_extract(PstFile *self, PyObject *args, PyObject *kwds) {
+  static char *kwlist[] = {"outdir", "root", "threads", NULL};
+  PstItem *item=self->root;
+  char *outdir;
+  int threads=PST_EXTRACT_THREADS;
+  struct extract_thread thread[PST_EXTRACT_MAX_THREADS];
+  struct extract_batch batch;
+  pst_desc_ll *ptr;
+  PyObject *result;
+  int i, j, size=0, started=0;
+
+  if(!PyArg_ParseTupleAndKeywords(args, kwds, "s|Oi", kwlist,
+				  &outdir, &item, &threads))
+    return NULL;
+
+  if((PyObject *)item == Py_None) {
+    item = self->root;
+  } else if(item->ob_type != &PstItemType)
+    return PyErr_Format(PyExc_RuntimeError, "Expected a PstType object - try calling extract with no root");
+
+  if(!item || !item->ptr)
+    return PyErr_Format(PyExc_RuntimeError, "This item has no descriptor to extract");
+
+  if(threads < 1) threads = 1;
+  if(threads > PST_EXTRACT_MAX_THREADS) threads = PST_EXTRACT_MAX_THREADS;
+
+  // Collect every descriptor below the root. These are only pointers
+  // into the tree, the items are parsed by the threads.
+  batch.ptrs = NULL;
+  batch.count = 0;
+  ptr = item->ptr->child;
+  while(ptr) {
+    if(batch.count >= size) {
+      pst_desc_ll **ptrs;
+
+      size = size ? size * 2 : 1024;
+      ptrs = (pst_desc_ll **)realloc(batch.ptrs, size * sizeof(*ptrs));
+      if(!ptrs) {
+	free(batch.ptrs);
+	return PyErr_NoMemory();
+      };
+      batch.ptrs = ptrs;
+    };
+    batch.ptrs[batch.count++] = ptr;
+
+    if(ptr->child) {
+      ptr = ptr->child;
+      continue;
+    };
+
+    while(ptr && ptr != item->ptr && !ptr->next) ptr = ptr->parent;
+    if(!ptr || ptr == item->ptr) break;
+    ptr = ptr->next;
+  };
+
+  batch.next = 0;
+  batch.pst = &self->pst;
+  batch.filename = self->filename;
+  batch.outdir = outdir;
+  pthread_mutex_init(&batch.lock, NULL);
+
+  if(threads > batch.count) threads = batch.count;
+  if(threads < 1) threads = 1;
+
+  memset(thread, 0, sizeof(thread));
+  for(i=0; i<threads; i++)
+    thread[i].batch = &batch;
+
+  // Nothing below needs python
+  Py_BEGIN_ALLOW_THREADS
+  for(i=0; i<threads; i++) {
+    if(pthread_create(&thread[i].thread, NULL, extract_worker, &thread[i]) != 0)
+      break;
+    started++;
+  };
+
+  // if no thread could be started we do the work ourselves
+  if(started == 0)
+    extract_worker(&thread[0]);
+
+  for(i=0; i<started; i++)
+    pthread_join(thread[i].thread, NULL);
+  Py_END_ALLOW_THREADS
+
+  pthread_mutex_destroy(&batch.lock);
+  free(batch.ptrs);
+
+  // Return a list of (descriptor id, name, path) for each file written
+  result = PyList_New(0);
+  for(i=0; i<threads; i++) {
+    if(thread[i].error && result) {
+      errno = thread[i].error;
+      PyErr_SetFromErrnoWithFilename(PyExc_IOError, self->filename);
+      Py_CLEAR(result);
+    };
+
+    for(j=0; j<thread[i].count; j++) {
+      struct extract_file *file = &thread[i].files[j];
+
+      if(result) {
+	PyObject *tmp = Py_BuildValue("Kss", (unsigned PY_LONG_LONG)file->id,
+				      file->name ? file->name : "", file->path);
+
+	if(!tmp || PyList_Append(result, tmp) < 0) {
+	  Py_CLEAR(result);
+	};
+	Py_XDECREF(tmp);
+      };
+
+      free(file->name);
+      free(file->path);
+    };
+    free(thread[i].files);
+  };
+
+  return result;
+};
+
 static PyMethodDef PstFile_methods[] = {
   {"get_item", (PyCFunction)PstFile_get_item_by_id, METH_VARARGS,
    "Gets the specified item by id"},
   {"listitems", (PyCFunction)PstFile_listitems, METH_VARARGS,
    "return a tuple of lists of tuples (dirs, nondirs) of all the items in this folder. Takes a single item ID "},
+  {"iteritems", (PyCFunction)PstFile_iteritems, METH_VARARGS|METH_KEYWORDS,
+   "iteritems(root=None, skip=None, resume=None)\n"
+   "Returns an iterator over every item below root (the top of the folders by "
+   "default), parsing each one as it is reached. skip is a sequence of "
+   "descriptor ids to leave out along with everything below them. resume is "
+   "the descriptor id of an item already processed, iteration carries on after it."},
+  {"extract", (PyCFunction)PstFile_extract, METH_VARARGS|METH_KEYWORDS,
+   "extract(outdir, root=None, threads=4)\n"
+   "Writes the bodies and attachments of every message below root into outdir, "
+   "parsing items on several threads. Returns a list of (descriptor id, name, path) "
+   "for the files written."},
   { NULL }
 };
 
@@ -604,5 +1115,10 @@ PyMODINIT_FUNC initpst(void) {
 
     Py_INCREF(&PstItemType);
 
+    if (PyType_Ready(&PstIteratorType) < 0)
+        return;
+
+    Py_INCREF(&PstIteratorType);
+
     PyModule_AddObject(m, "PstFile", (PyObject *)&PstFileType);
 }
@@ -33,6 +33,7 @@ void      process(pst_item *outeritem, pst_desc_ll *d_ptr);
 void      write_email_body(FILE *f, char *body);
 char*     removeCR (char *c);
 int       usage();
+int       benchmark(char *fname);
 int       version();
 char*     mk_kmail_dir(char*);
 int       close_kmail_dir();
@@ -77,6 +78,13 @@ char*  kmail_chdir = NULL;
 // Decrypt the whole file (even the parts that aren't encrypted) and ralph it to stdout
 #define MODE_DECSPEW 4
 
+// Time pst_decrypt() over the start of the file and print the throughput
+#define MODE_BENCHMARK 5
+
+// how much of the file the benchmark reads, and the size of each decrypt call
+#define BENCHMARK_SIZE  (64*1024*1024)
+#define BENCHMARK_BLOCK 8192
+
 
 // Output Normal just prints the standard information about what is going on
 #define OUTPUT_NORMAL 0
@@ -228,8 +236,11 @@ int main(int argc, char** argv) {
     prog_name = argv[0];
 
     // command-line option handling
-    while ((c = getopt(argc, argv, "bCc:Dd:hko:qrSMVw"))!= -1) {
+    while ((c = getopt(argc, argv, "BbCc:Dd:hko:qrSMVw"))!= -1) {
         switch (c) {
+        case 'B':
+            mode = MODE_BENCHMARK;
+            break;
         case 'b':
             save_rtf_body = 0;
             break;
@@ -328,6 +339,12 @@ int main(int argc, char** argv) {
         return 0;
     }
 
+    if (mode == MODE_BENCHMARK) {
+        x = benchmark(fname);
+        DEBUG_RET();
+        return x;
+    }
+
     if (output_mode != OUTPUT_QUIET) printf("Opening PST file and indexes...\n");
 
     RET_DERROR(pst_open(&pstfile, fname), 1, ("Error opening File\n"));
@@ -421,6 +438,7 @@ int usage() {
     printf("Usage: %s [OPTIONS] {PST FILENAME}\n", prog_name);
     printf("OPTIONS:\n");
     printf("\t-V\t- Version. Display program version\n");
+    printf("\t-B\t- Benchmark. Print the decryption speed over the first 64MB of the file\n");
     printf("\t-C\t- Decrypt (compressible encryption) the entire file and output on stdout (not typically useful)\n");
     printf("\t-D\t- Include deleted items in output\n");
     printf("\t-M\t- MH. Write emails in the MH format\n");
@@ -439,6 +457,53 @@ int usage() {
 }
 
 
+int benchmark(char *fname) {
+    FILE   *fp;
+    char   *buf;
+    size_t  size, x;
+    int     type, round;
+    clock_t start;
+    double  secs;
+    DEBUG_ENT("benchmark");
+    if (NULL == (fp = fopen(fname, "rb"))) {
+        fprintf(stderr, "Couldn't open file %s\n", fname);
+        DEBUG_RET();
+        return 1;
+    }
+    buf  = (char*) xmalloc(BENCHMARK_SIZE);
+    size = fread(buf, 1, BENCHMARK_SIZE, fp);
+    fclose(fp);
+    if (!size) {
+        fprintf(stderr, "Couldn't read from %s\n", fname);
+        free(buf);
+        DEBUG_RET();
+        return 1;
+    }
+
+    for (type = PST_COMP_ENCRYPT; type <= PST_ENCRYPT; type++) {
+        // decrypt block sized pieces the way pst_ff_getIDblock_dec() does,
+        // repeating until enough time has passed to measure. The data is
+        // just decrypted again each round, it does not matter what it holds.
+        round = 0;
+        start = clock();
+        do {
+            for (x = 0; x < size; x += BENCHMARK_BLOCK) {
+                size_t n = (size - x < BENCHMARK_BLOCK) ? size - x : BENCHMARK_BLOCK;
+                (void)pst_decrypt((uint64_t)(x / 2 + 4), buf + x, n, (unsigned char)type);
+            }
+            round++;
+            secs = (double)(clock() - start) / CLOCKS_PER_SEC;
+        } while (secs < 1.0);
+        printf("%s encryption: %.1f MB/s (%i x %lu bytes)\n",
+               (type == PST_COMP_ENCRYPT) ? "compressible" : "strong",
+               (double)size * round / secs / (1024 * 1024), round, (unsigned long)size);
+    }
+    free(buf);
+    DEBUG_RET();
+    return 0;
+}
+
+
 int version() {
     DEBUG_ENT("version");
     printf("ReadPST / LibPST v%s\n", VERSION);
@@ -56,10 +56,10 @@ int find_nl(vstr * vs)
 //  UTF8 <-> UTF16 <-> ISO8859 Character set conversion functions and (ack) their globals
 
 //TODO: the following should not be
-char *wwbuf = NULL;
-size_t nwwbuf = 0;
-static int unicode_up = 0;
-iconv_t i16to8, i8to16, i8859_1to8, i8toi8859_1;
+PST_THREAD_LOCAL char *wwbuf = NULL;
+PST_THREAD_LOCAL size_t nwwbuf = 0;
+static PST_THREAD_LOCAL int unicode_up = 0;
+PST_THREAD_LOCAL iconv_t i16to8, i8to16, i8859_1to8, i8toi8859_1;
 
 
 void unicode_init()
@@ -109,7 +109,7 @@ void unicode_close()
 
 int utf16_is_terminated(char *str, int length)
 {
-    VSTR_STATIC(errbuf, 100);
+    static PST_THREAD_LOCAL vstr *errbuf = NULL;
     int len = -1;
     int i;
     for (i = 0; i < length; i += 2) {
@@ -119,6 +119,8 @@ int utf16_is_terminated(char *str, int length)
     }
 
     if (-1 == len) {
+        if (!errbuf)
+            errbuf = vsalloc(100);
         vshexdump(errbuf, str, 0, length, 1);
         WARN(("String is not zero terminated (probably broken data from registry) %s.", errbuf->b));
     }
@@ -132,12 +134,16 @@ int vb_utf16to8(vbuf * dest, char *buf, int len)
     size_t inbytesleft = len;
     char *inbuf = buf;
     size_t icresult = (size_t)-1;
-    VBUF_STATIC(dumpster, 100);
+    static PST_THREAD_LOCAL vbuf *dumpster = NULL;
 
     size_t outbytesleft = 0;
     char *outbuf = NULL;
 
-    ASSERT(unicode_up, "vb_utf16to8() called before unicode started.");
+    // the iconv handles are per thread, so open them on first use
+    if (!unicode_up)
+        unicode_init();
+    if (!dumpster)
+        dumpster = vballoc(100);
 
     if (2 > dest->blen)
         vbresize(dest, 2);
@@ -223,6 +229,9 @@ int vb_utf8to16T(vbuf * bout, char *cin, int inlen)
     size_t outbytesleft = 0;
     char *outbuf = NULL;
 
+    if (!unicode_up)
+        unicode_init();
+
     if (2 > bout->blen)
         vbresize(bout, 2);
     bout->dlen = 0;
@@ -83,8 +83,20 @@ class FilesystemLoader(Scanner.GenScanFactory):
             size = size, target = fd.urn,
             status=status)
 
-        for block in skfd.blocks():
-            map.write_from(fd.urn, block * block_size, block_size)
+        ## Add one map point per extent rather than per block. Sparse
+        ## runs have no disk address so they are skipped, but the
+        ## extents after them must still land at their file offset.
+        try:
+            for offset, disk_offset, length, flags in skfd.runs():
+                if flags & sk.RUN_SPARSE:
+                    map.readptr += length
+                    continue
+
+                map.write_from(fd.urn, disk_offset, length)
+        except IOError:
+            ## Resident or compressed data is not mapped straight to disk
+            for block in skfd.blocks():
+                map.write_from(fd.urn, block * block_size, block_size)
 
         ## update the size of the map
         map.size.set(size)
@@ -232,9 +232,9 @@ void* lru_cache_find(lru_cache* ht, const void* index,
   }
   
   if(e)
-  { /* Need to move this element up to the newest slot. */
+  { /* Need to move this element up to the newest slot (the tail). */
     list_del(&e->list);
-    list_add(&e->list, &ht->sorted.list);
+    list_add_tail(&e->list, &ht->sorted.list);
   };
 
   if(e != NULL)
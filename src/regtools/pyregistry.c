@@ -1,15 +1,54 @@
 #include <Python.h>
 #include <regfi.h>
+#include "talloc.h"
+
+/* How many keys RegistryWalker returns from each call to next() by
+   default.
+*/
+#define PYREGISTRY_BATCH 1000
 
 typedef struct {
   PyObject_HEAD
   REGF_FILE *registry;
   PyObject *fd;
+
+  // The contents of fd when it has no file descriptor of its own
+  PyObject *data;
 } PyRegistry;
 
+static PyTypeObject PyRegistryType;
+
+/* A depth first walk over the keys of a registry, built on a
+   REGFI_ITERATOR.  Each call to next() walks up to batch keys and
+   returns them as a list of (path, mtime, values) tuples, so the
+   caller only goes through the interpreter once per batch.
+*/
+typedef struct {
+  PyObject_HEAD
+  PyRegistry *registry;
+  REGFI_ITERATOR *iter;
+
+  int batch;
+
+  // How far below the starting key the iterator currently is
+  int depth;
+
+  // The path of the starting key
+  char *prefix;
+
+  // Set when the current key has not been returned yet
+  int emit;
+  int done;
+} RegistryWalker;
+
+static PyTypeObject RegistryWalkerType;
+
 static int PyRegistry_init(PyRegistry *self, PyObject *args, PyObject *kwds) {
   static char *kwlist[] = {"fd", NULL};
   PyObject *fd;
+  PyObject *fileno;
+  PyObject *result;
+  int fdno;
 
   if(!PyArg_ParseTupleAndKeywords(args, kwds, "O", kwlist, &fd))
     return -1;
@@ -19,21 +58,121 @@ static int PyRegistry_init(PyRegistry *self, PyObject *args, PyObject *kwds) {
   self->fd = fd;
 
   //Create a new registry file object
-  
+  if(PyString_Check(fd)) {
+    self->registry = regfi_open(NULL, PyString_AsString(fd));
+    if(!self->registry) {
+      PyErr_Format(PyExc_IOError, "Unable to open registry %s",
+		   PyString_AsString(fd));
+      return -1;
+    };
+
+    return 0;
+  };
+
+  /* File like objects without a real file descriptor (e.g. pyflag
+     IO sources) are read into memory and parsed from there.
+  */
+  if(!PyInt_Check(fd) && !PyObject_HasAttrString(fd, "fileno")) {
+    result = PyObject_CallMethod(fd, "seek", "i", 0);
+    if(!result) return -1;
+    Py_DECREF(result);
+
+    self->data = PyObject_CallMethod(fd, "read", NULL);
+    if(!self->data) return -1;
+
+    if(!PyString_Check(self->data)) {
+      PyErr_Format(PyExc_TypeError, "read() must return a string");
+      return -1;
+    };
+
+    self->registry = regfi_open_buffer(NULL, (uint8 *)PyString_AS_STRING(self->data),
+				       PyString_GET_SIZE(self->data));
+    if(!self->registry) {
+      PyErr_Format(PyExc_IOError, "Unable to parse registry");
+      return -1;
+    };
+
+    return 0;
+  };
+
+  // Anything else must have a real file descriptor behind it
+  if(PyInt_Check(fd)) {
+    fdno = PyInt_AsLong(fd);
+  } else {
+    fileno = PyObject_CallMethod(fd, "fileno", NULL);
+    if(!fileno) return -1;
+
+    fdno = PyInt_AsLong(fileno);
+    Py_DECREF(fileno);
+    if(fdno == -1 && PyErr_Occurred()) return -1;
+  };
+
+  // The registry closes its fd when it is freed, so give it its own
+  fdno = dup(fdno);
+  if(fdno < 0) {
+    PyErr_SetFromErrno(PyExc_IOError);
+    return -1;
+  };
+
+  self->registry = regfi_open_fd(NULL, fdno);
+  if(!self->registry) {
+    close(fdno);
+    PyErr_Format(PyExc_IOError, "Unable to parse registry");
+    return -1;
+  };
 
   return 0;
 };
 
 static void
 PyRegistry_dealloc(PyRegistry *self) {
-  talloc_free(self->registry);
-  Py_DECREF(self->fd);
+  if(self->registry)
+    talloc_free(self->registry);
+
+  Py_XDECREF(self->fd);
+  Py_XDECREF(self->data);
   self->ob_type->tp_free((PyObject*)self);
 }
 
+static PyObject *PyRegistry_walk(PyRegistry *self, PyObject *args, PyObject *kwds) {
+  static char *kwlist[] = {"path", "batch", NULL};
+  char *path = NULL;
+  int batch = PYREGISTRY_BATCH;
+
+  if(!PyArg_ParseTupleAndKeywords(args, kwds, "|zi", kwlist, &path, &batch))
+    return NULL;
+
+  if(path)
+    return PyObject_CallFunction((PyObject *)&RegistryWalkerType, "Osi",
+				 self, path, batch);
+
+  return PyObject_CallFunction((PyObject *)&RegistryWalkerType, "Ozi",
+			       self, NULL, batch);
+};
+
+static PyObject *PyRegistry_cache_stats(PyRegistry *self, PyObject *args) {
+  REGF_FILE *f = self->registry;
+
+  if(!f) {
+    PyErr_Format(PyExc_RuntimeError, "Registry is not open");
+    return NULL;
+  };
+
+  return Py_BuildValue("{s(II)s(II)s(II)}",
+		       "hbin", f->hbin_stats.lookups, f->hbin_stats.hits,
+		       "nk", f->nk_stats.lookups, f->nk_stats.hits,
+		       "sk", f->sk_stats.lookups, f->sk_stats.hits);
+};
 
 static PyMethodDef PyRegistry_methods[] = {
-  
+  {"walk", (PyCFunction)PyRegistry_walk, METH_VARARGS|METH_KEYWORDS,
+   "walk(path=None, batch=1000)\n"
+   "Walks all the keys under path (the root key by default) depth first.\n"
+   "Returns an iterator which yields lists of up to batch\n"
+   "(path, mtime, values) tuples, where values is a list of\n"
+   "(name, type, data) tuples."},
+  {"cache_stats", (PyCFunction)PyRegistry_cache_stats, METH_NOARGS,
+   "Returns a dict of (lookups, hits) for the hbin, nk and sk caches."},
   { NULL }
 };
 
@@ -79,6 +218,256 @@ static PyTypeObject PyRegistryType = {
     0,                         /* tp_new */
 };
 
+static int RegistryWalker_init(RegistryWalker *self, PyObject *args, PyObject *kwds) {
+  static char *kwlist[] = {"registry", "path", "batch", NULL};
+  PyRegistry *registry;
+  char *path = NULL;
+  char *path_copy, *element, *state;
+  const char *elements[REGF_MAX_DEPTH+1];
+  const REGFI_ITER_POSITION *pos;
+  void_stack_iterator *stack;
+  int i=0;
+
+  self->batch = PYREGISTRY_BATCH;
+  if(!PyArg_ParseTupleAndKeywords(args, kwds, "O!|zi", kwlist,
+				  &PyRegistryType, &registry, &path, &self->batch))
+    return -1;
+
+  if(self->batch <= 0)
+    self->batch = PYREGISTRY_BATCH;
+
+  if(!registry->registry) {
+    PyErr_Format(PyExc_RuntimeError, "Registry is not open");
+    return -1;
+  };
+
+  // The iterator lives in the registry's talloc context so we need
+  // to keep it alive:
+  Py_INCREF(registry);
+  self->registry = registry;
+
+  self->iter = regfi_iterator_new(registry->registry);
+  if(!self->iter) {
+    PyErr_Format(PyExc_IOError, "Unable to find the root key");
+    return -1;
+  };
+
+  self->prefix = talloc_strdup(self->iter, "");
+
+  // Move the iterator to the starting key
+  if(path) {
+    path_copy = talloc_strdup(self->iter, path);
+    for(element = strtok_r(path_copy, "/\\", &state);
+	element;
+	element = strtok_r(NULL, "/\\", &state)) {
+      if(i == REGF_MAX_DEPTH) {
+	PyErr_Format(PyExc_KeyError, "Key %s is too deep", path);
+	return -1;
+      };
+      elements[i++] = element;
+    };
+    elements[i] = NULL;
+
+    if(!regfi_iterator_walk_path(self->iter, elements)) {
+      PyErr_Format(PyExc_KeyError, "Key %s not found", path);
+      return -1;
+    };
+
+    /* Subkeys are matched without regard to case, so the prefix is
+       built from the names of the keys we found rather than from the
+       path we were given. The bottom of the stack is the root key. */
+    if(i > 0) {
+      stack = void_stack_iterator_new(path_copy, self->iter->key_positions);
+      void_stack_iterator_next(stack);
+      while((pos = void_stack_iterator_next(stack)))
+	self->prefix = talloc_asprintf_append(self->prefix, "/%s", pos->nk->keyname);
+
+      self->prefix = talloc_asprintf_append(self->prefix, "/%s",
+					    self->iter->cur_key->keyname);
+    };
+  };
+
+  self->emit = 1;
+  return 0;
+};
+
+static void RegistryWalker_dealloc(RegistryWalker *self) {
+  if(self->iter)
+    talloc_free(self->iter);
+
+  Py_XDECREF(self->registry);
+  self->ob_type->tp_free((PyObject*)self);
+};
+
+static PyObject *RegistryWalker_iter(PyObject *self) {
+  Py_INCREF(self);
+  return self;
+};
+
+/* Builds the (path, mtime, values) tuple for the iterator's current
+   key */
+static PyObject *RegistryWalker_key(RegistryWalker *self) {
+  REGFI_ITERATOR *iter = self->iter;
+  const REGF_NK_REC *nk = iter->cur_key;
+  const REGF_VK_REC *vk;
+  const REGFI_ITER_POSITION *pos;
+  void_stack_iterator *stack;
+  char *path;
+  PyObject *values, *value, *result;
+  int i;
+
+  // Positions below the starting key are the last depth elements on
+  // the stack:
+  path = talloc_strdup(iter, self->prefix);
+  if(self->depth > 0) {
+    stack = void_stack_iterator_new(path, iter->key_positions);
+    for(i=void_stack_size(iter->key_positions) - self->depth; i>0; i--)
+      void_stack_iterator_next(stack);
+
+    // Skip the starting key itself
+    void_stack_iterator_next(stack);
+    while((pos = void_stack_iterator_next(stack)))
+      path = talloc_asprintf_append(path, "/%s", pos->nk->keyname);
+
+    path = talloc_asprintf_append(path, "/%s", nk->keyname);
+  } else if(!*path) {
+    path = talloc_asprintf_append(path, "/");
+  };
+
+  values = PyList_New(0);
+  if(!values) goto error;
+
+  if(nk->values) {
+    for(i=0; i<nk->num_values; i++) {
+      vk = nk->values[i];
+      if(!vk) continue;
+
+      value = Py_BuildValue("(sIs#)", vk->valuename ? vk->valuename : "",
+			    vk->type, vk->data ? (char *)vk->data : "",
+			    vk->data ? vk->data_size : 0);
+      if(!value) goto error;
+
+      PyList_Append(values, value);
+      Py_DECREF(value);
+    };
+  };
+
+  result = Py_BuildValue("(slN)", path, (long)nt_time_to_unix(&nk->mtime), values);
+  talloc_free(path);
+  return result;
+
+ error:
+  Py_XDECREF(values);
+  talloc_free(path);
+  return NULL;
+};
+
+static PyObject *RegistryWalker_iternext(RegistryWalker *self) {
+  REGFI_ITERATOR *iter = self->iter;
+  PyObject *result;
+  PyObject *key;
+
+  // Walkers made directly through __new__ were never initialised
+  if(!iter)
+    return PyErr_Format(PyExc_RuntimeError, "RegistryWalker is not initialised");
+
+  if(self->done) return NULL;
+
+  result = PyList_New(0);
+  if(!result) return NULL;
+
+  while(PyList_GET_SIZE(result) < self->batch) {
+    if(self->emit) {
+      key = RegistryWalker_key(self);
+      if(!key) goto error;
+
+      PyList_Append(result, key);
+      Py_DECREF(key);
+      self->emit = 0;
+    };
+
+    /* Go down into the next subkey if there is one.  This is what
+       reglookup does, except we check the subkey count rather than
+       loading each subkey just to find out it exists.
+    */
+    if(iter->cur_key->subkeys && iter->cur_subkey < iter->cur_key->num_subkeys) {
+      if(regfi_iterator_down(iter)) {
+	self->depth++;
+	self->emit = 1;
+      } else {
+	// This subkey is corrupt - skip it
+	iter->cur_subkey++;
+      };
+
+      // Otherwise we are done with this sub-tree
+    } else if(self->depth > 0) {
+      if(!regfi_iterator_up(iter)) {
+	PyErr_Format(PyExc_RuntimeError, "Could not traverse iterator upward");
+	goto error;
+      };
+
+      self->depth--;
+      iter->cur_subkey++;
+    } else {
+      self->done = 1;
+      break;
+    };
+  };
+
+  if(PyList_GET_SIZE(result) == 0) {
+    Py_DECREF(result);
+    return NULL;
+  };
+
+  return result;
+
+ error:
+  Py_DECREF(result);
+  return NULL;
+};
+
+static PyTypeObject RegistryWalkerType = {
+    PyObject_HEAD_INIT(NULL)
+    0,                         /* ob_size */
+    "pyregistry.RegistryWalker",             /* tp_name */
+    sizeof(RegistryWalker),          /* tp_basicsize */
+    0,                         /* tp_itemsize */
+    (destructor)RegistryWalker_dealloc, /* tp_dealloc */
+    0,                         /* tp_print */
+    0,        /* tp_getattr */
+    0,                         /* tp_setattr */
+    0,                         /* tp_compare */
+    0,                         /* tp_repr */
+    0,                         /* tp_as_number */
+    0,                         /* tp_as_sequence */
+    0,                         /* tp_as_mapping */
+    0,                         /* tp_hash */
+    0,                         /* tp_call */
+    0,                         /* tp_str */
+    0,                         /* tp_getattro */
+    0,                         /* tp_setattro */
+    0,                         /* tp_as_buffer */
+    Py_TPFLAGS_DEFAULT,        /* tp_flags */
+    "Iterates over batches of registry keys",         /* tp_doc */
+    0,	                       /* tp_traverse */
+    0,                         /* tp_clear */
+    0,                         /* tp_richcompare */
+    0,                         /* tp_weaklistoffset */
+    (getiterfunc)RegistryWalker_iter, /* tp_iter */
+    (iternextfunc)RegistryWalker_iternext, /* tp_iternext */
+    0,                         /* tp_methods */
+    0,                         /* tp_members */
+    0,                         /* tp_getset */
+    0,                         /* tp_base */
+    0,                         /* tp_dict */
+    0,                         /* tp_descr_get */
+    0,                         /* tp_descr_set */
+    0,                         /* tp_dictoffset */
+    (initproc)RegistryWalker_init, /* tp_init */
+    0,                         /* tp_alloc */
+    0,                         /* tp_new */
+};
+
 static PyMethodDef pyregistryMethods[] = {
   {NULL, NULL, 0, NULL}
 };
@@ -98,8 +487,15 @@ PyMODINIT_FUNC initpyregistry(void) {
     if (PyType_Ready(&PyRegistryType) < 0)
         return;
 
+    RegistryWalkerType.tp_new = PyType_GenericNew;
+    if (PyType_Ready(&RegistryWalkerType) < 0)
+        return;
+
     Py_INCREF(&PyRegistryType);
+    Py_INCREF(&RegistryWalkerType);
 
-    PyModule_AddObject(g_module_reference, 
+    PyModule_AddObject(g_module_reference,
 		       "PyRegistry", (PyObject *)&PyRegistryType);
+    PyModule_AddObject(g_module_reference,
+		       "RegistryWalker", (PyObject *)&RegistryWalkerType);
 }
@@ -52,9 +52,9 @@ static bool range_list_insert(range_list* rl, range_list_element* elem, uint32_t
 
   if(rl->size == rl->elem_alloced)
   {
-    tmp = (range_list_element**)realloc(rl->elements, 
-					(rl->elem_alloced+RANGE_LIST_ALLOC_SIZE)
-					* sizeof(range_list_element*));
+    tmp = (range_list_element**)talloc_realloc_size(rl, rl->elements, 
+						    (rl->elem_alloced+RANGE_LIST_ALLOC_SIZE)
+						    * sizeof(range_list_element*));
     if(tmp == NULL)
       return false;
     rl->elements = tmp;
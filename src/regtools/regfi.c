@@ -310,23 +310,34 @@ uint32 regfi_read(int fd, uint8* buf, uint32* length)
 
 
 /*****************************************************************************
- *
+ * Returns a pointer to length bytes of the hive at offset, or NULL if
+ * they would run past the end of the file.
  *****************************************************************************/
-bool regfi_parse_cell(int fd, uint32 offset, uint8* hdr, uint32 hdr_len,
-		      uint32* cell_length, bool* unalloc)
+static const uint8* regfi_ptr(REGF_FILE* file, uint32 offset, uint32 length)
 {
-  uint32 length;
-  int32 raw_length;
-  uint8 tmp[4];
+  if((offset > file->file_length) || (length > file->file_length - offset))
+    return NULL;
 
-  if(lseek(fd, offset, SEEK_SET) == -1)
-    return false;
+  return file->buffer + offset;
+}
 
-  length = 4;
-  if((regfi_read(fd, tmp, &length) != 0) || length != 4)
-    return false;
-  raw_length = IVALS(tmp, 0);
 
+/*****************************************************************************
+ * Parses the length of the cell at offset.  Returns a pointer to the 
+ * start of the record (just past the length), with at least hdr_len 
+ * bytes of it inside the file, or NULL on failure.
+ *****************************************************************************/
+const uint8* regfi_parse_cell(REGF_FILE* file, uint32 offset, uint32 hdr_len,
+			      uint32* cell_length, bool* unalloc)
+{
+  const uint8* cell;
+  int32 raw_length;
+
+  cell = regfi_ptr(file, offset, hdr_len+4);
+  if(cell == NULL)
+    return NULL;
+
+  raw_length = IVALS(cell, 0);
   if(raw_length < 0)
   {
     (*cell_length) = raw_length*(-1);
@@ -339,16 +350,9 @@ bool regfi_parse_cell(int fd, uint32 offset, uint8* hdr, uint32 hdr_len,
   }
 
   if(*cell_length - 4 < hdr_len)
-    return false;
-
-  if(hdr_len > 0)
-  {
-    length = hdr_len;
-    if((regfi_read(fd, hdr, &length) != 0) || length != hdr_len)
-      return false;
-  }
+    return NULL;
 
-  return true;
+  return cell + 4;
 }
 
 
@@ -376,7 +380,22 @@ static bool regfi_offset_in_hbin(REGF_HBIN* hbin, uint32 offset)
  *******************************************************************/
 REGF_HBIN* regfi_lookup_hbin(REGF_FILE* file, uint32 offset)
 {
-  return (REGF_HBIN*)range_list_find_data(file->hbins, offset+REGF_BLOCKSIZE);
+  REGF_HBIN* hbin = file->last_hbin;
+  uint32 file_off = offset+REGF_BLOCKSIZE;
+
+  file->hbin_stats.lookups++;
+  if(hbin && (file_off >= hbin->file_off)
+     && (file_off - hbin->file_off < hbin->block_size))
+  {
+    file->hbin_stats.hits++;
+    return hbin;
+  }
+
+  hbin = (REGF_HBIN*)range_list_find_data(file->hbins, file_off);
+  if(hbin)
+    file->last_hbin = hbin;
+
+  return hbin;
 }
 
 
@@ -389,12 +408,13 @@ REGF_HASH_LIST* regfi_load_hashlist(void *ctx, REGF_FILE* file, uint32 offset,
 {
   REGF_HASH_LIST* ret_val;
   uint32 i, cell_length, length;
-  uint8* hashes;
-  uint8 buf[REGFI_HASH_LIST_MIN_LENGTH];
+  const uint8* hashes;
+  const uint8* buf;
   bool unalloc;
 
-  if(!regfi_parse_cell(file->fd, offset, buf, REGFI_HASH_LIST_MIN_LENGTH, 
-		       &cell_length, &unalloc))
+  buf = regfi_parse_cell(file, offset, REGFI_HASH_LIST_MIN_LENGTH, 
+			 &cell_length, &unalloc);
+  if(buf == NULL)
     return NULL;
 
   ret_val = talloc(file, REGF_HASH_LIST);
@@ -448,13 +468,9 @@ REGF_HASH_LIST* regfi_load_hashlist(void *ctx, REGF_FILE* file, uint32 offset,
   if(ret_val->hashes == NULL)
     goto error;
 
-  hashes = (uint8*)talloc_size(ret_val, length);
+  hashes = regfi_ptr(file, offset+4+REGFI_HASH_LIST_MIN_LENGTH, length);
   if(hashes == NULL) goto error;
 
-  if(regfi_read(file->fd, hashes, &length) != 0
-     || length != sizeof(REGF_HASH_LIST_ELEM)*ret_val->num_keys)
-    goto error;
-
   for (i=0; i < ret_val->num_keys; i++)
   {
     ret_val->hashes[i].nk_off = IVAL(hashes, i*sizeof(REGF_HASH_LIST_ELEM));
@@ -474,14 +490,16 @@ REGF_HASH_LIST* regfi_load_hashlist(void *ctx, REGF_FILE* file, uint32 offset,
 REGF_SK_REC* regfi_parse_sk(void *ctx, REGF_FILE* file, uint32 offset, uint32 max_size, bool strict)
 {
   REGF_SK_REC* ret_val;
-  uint32 cell_length, length;
+  uint32 cell_length;
   prs_struct *ps;
-  uint8 sk_header[REGFI_SK_MIN_LENGTH];
+  const uint8* sk_header;
+  const uint8* desc;
   bool unalloc = false;
 
 
-  if(!regfi_parse_cell(file->fd, offset, sk_header, REGFI_SK_MIN_LENGTH,
-		       &cell_length, &unalloc))
+  sk_header = regfi_parse_cell(file, offset, REGFI_SK_MIN_LENGTH,
+			       &cell_length, &unalloc);
+  if(sk_header == NULL)
     return NULL;
    
   if(sk_header[0] != 's' || sk_header[1] != 'k')
@@ -523,10 +541,10 @@ REGF_SK_REC* regfi_parse_sk(void *ctx, REGF_FILE* file, uint32 offset, uint32 ma
   if(!ps)
     goto error;
 
-  length = ret_val->desc_size;
-  if(regfi_read(file->fd, (uint8*)ps->data_p, &length) != 0 
-     || length != ret_val->desc_size)
+  desc = regfi_ptr(file, offset+4+REGFI_SK_MIN_LENGTH, ret_val->desc_size);
+  if(desc == NULL)
     goto error;
+  memcpy(ps->data_p, desc, ret_val->desc_size);
 
   if (!sec_io_desc("sec_desc", &ret_val->sec_desc, ps, 0))
     goto error;
@@ -542,10 +560,11 @@ uint32* regfi_parse_valuelist(void *ctx, REGF_FILE* file, uint32 offset,
 			      uint32 num_values, bool strict)
 {
   uint32* ret_val;
-  uint32 i, cell_length, length, read_len;
+  uint32 i, cell_length;
+  const uint8* offsets;
   bool unalloc;
 
-  if(!regfi_parse_cell(file->fd, offset, NULL, 0, &cell_length, &unalloc))
+  if(regfi_parse_cell(file, offset, 0, &cell_length, &unalloc) == NULL)
     return NULL;
 
   if(cell_length != (cell_length & 0xFFFFFFF8))
@@ -557,19 +576,18 @@ uint32* regfi_parse_valuelist(void *ctx, REGF_FILE* file, uint32 offset,
   if((num_values * sizeof(uint32)) > cell_length-sizeof(uint32))
     return NULL;
 
-  read_len = num_values*sizeof(uint32);
-  ret_val = talloc_array(ctx, uint32, read_len);
+  offsets = regfi_ptr(file, offset+4, num_values*sizeof(uint32));
+  if(offsets == NULL)
+    return NULL;
+
+  ret_val = talloc_array(ctx, uint32, num_values);
   if(ret_val == NULL)
     return NULL;
 
-  length = read_len;
-  if((regfi_read(file->fd, (uint8*)ret_val, &length) != 0) || length != read_len)
-    goto error;
-  
   for(i=0; i < num_values; i++)
   {
     /* Fix endianness */
-    ret_val[i] = IVAL(&ret_val[i], 0);
+    ret_val[i] = IVAL(offsets, i*sizeof(uint32));
 
     /* Validate the first num_values values to ensure they make sense */
     if(strict)
@@ -643,10 +661,9 @@ REGF_VK_REC** regfi_load_valuelist(void *ctx, REGF_FILE* file, uint32 offset,
 
 
 /*******************************************************************
- * XXX: Need to add full key caching using a 
- *      custom cache structure.
+ * Parses the key at offset along with its value list and subkey list.
  *******************************************************************/
-REGF_NK_REC* regfi_load_key(void *ctx, REGF_FILE* file, uint32 offset, bool strict)
+static REGF_NK_REC* regfi_parse_key(void *ctx, REGF_FILE* file, uint32 offset, bool strict)
 {
   REGF_HBIN* hbin;
   REGF_HBIN* sub_hbin;
@@ -719,25 +736,120 @@ REGF_NK_REC* regfi_load_key(void *ctx, REGF_FILE* file, uint32 offset, bool stri
 }
 
 
+/*******************************************************************
+ * Keys in file->nk_recs are shared.  Each caller of regfi_load_key
+ * gets its own copy of the REGF_NK_REC, but the name, values and
+ * subkeys point into the cached key.  The cached key is only freed 
+ * once it has been evicted and the last copy of it has been freed.
+ *******************************************************************/
+typedef struct
+{
+  REGF_NK_REC* nk;
+  uint32 refs;      /* copies of nk which are still around */
+  bool cached;
+} REGFI_NK_ENTRY;
+
+typedef struct
+{
+  REGFI_NK_ENTRY* entry;
+} REGFI_NK_REF;
+
+
+static int regfi_nk_entry_destructor(REGFI_NK_ENTRY* entry)
+{
+  /* Evicted (or the file is being closed) while copies are still in
+   * use.  The last copy frees the entry.
+   */
+  entry->cached = false;
+  if(entry->refs > 0)
+    return -1;
+
+  return 0;
+}
+
+
+static int regfi_nk_ref_destructor(REGFI_NK_REF* ref)
+{
+  REGFI_NK_ENTRY* entry = ref->entry;
+
+  entry->refs--;
+  if(!entry->cached && entry->refs == 0)
+    talloc_free(entry);
+
+  return 0;
+}
+
+
+/*******************************************************************
+ * Strictly loaded keys come from file->nk_recs.  The key returned 
+ * belongs to ctx, but its name, values and subkeys are shared with
+ * the cache, so they must not be modified.
+ *******************************************************************/
+REGF_NK_REC* regfi_load_key(void *ctx, REGF_FILE* file, uint32 offset, bool strict)
+{
+  REGFI_NK_ENTRY* entry;
+  REGFI_NK_REF* ref;
+  REGF_NK_REC* nk;
+
+  if(!strict)
+    return regfi_parse_key(ctx, file, offset, strict);
+
+  file->nk_stats.lookups++;
+  entry = (REGFI_NK_ENTRY*)lru_cache_find(file->nk_recs, &offset, 4);
+  if(entry != NULL)
+    file->nk_stats.hits++;
+  else
+  {
+    entry = talloc(file->nk_recs, REGFI_NK_ENTRY);
+    if(entry == NULL)
+      return NULL;
+
+    entry->nk = regfi_parse_key(entry, file, offset, strict);
+    entry->refs = 0;
+    entry->cached = true;
+    if(entry->nk == NULL || !lru_cache_update(file->nk_recs, &offset, 4, entry))
+    {
+      talloc_free(entry);
+      return NULL;
+    }
+    talloc_set_destructor(entry, regfi_nk_entry_destructor);
+  }
+
+  nk = talloc(ctx, REGF_NK_REC);
+  if(nk == NULL)
+    return NULL;
+  memcpy(nk, entry->nk, sizeof(REGF_NK_REC));
+
+  ref = talloc(nk, REGFI_NK_REF);
+  if(ref == NULL)
+  {
+    talloc_free(nk);
+    return NULL;
+  }
+  ref->entry = entry;
+  entry->refs++;
+  talloc_set_destructor(ref, regfi_nk_ref_destructor);
+
+  return nk;
+}
+
+
 /******************************************************************************
 
  ******************************************************************************/
 static bool regfi_find_root_nk(void *ctx, REGF_FILE* file, uint32 offset, uint32 hbin_size,
 			       uint32* root_offset)
 {
-  uint8 tmp[4];
+  const uint8* tmp;
   int32 record_size;
-  uint32 length, hbin_offset = 0;
+  uint32 hbin_offset = 0;
   REGF_NK_REC* nk = NULL;
   bool found = false;
 
   for(record_size=0; !found && (hbin_offset < hbin_size); )
   {
-    if(lseek(file->fd, offset+hbin_offset, SEEK_SET) == -1)
-      return false;
-    
-    length = 4;
-    if((regfi_read(file->fd, tmp, &length) != 0) || length != 4)
+    tmp = regfi_ptr(file, offset+hbin_offset, 4);
+    if(tmp == NULL)
       return false;
     record_size = IVALS(tmp, 0);
 
@@ -770,10 +882,7 @@ static bool regfi_find_root_nk(void *ctx, REGF_FILE* file, uint32 offset, uint32
 REGF_FILE* regfi_open(void *ctx, const char* filename)
 {
   REGF_FILE* rb;
-  REGF_HBIN* hbin = NULL;
-  uint32 hbin_off;
   int fd;
-  bool rla;
 
   /* open an existing file */
   if ((fd = open(filename, O_RDONLY)) == -1) 
@@ -781,31 +890,122 @@ REGF_FILE* regfi_open(void *ctx, const char* filename)
     /* DEBUG(0,("regfi_open: failure to open %s (%s)\n", filename, strerror(errno)));*/
     return NULL;
   }
-  
+
+  rb = regfi_open_fd(ctx, fd);
+  if(rb == NULL)
+    close(fd);
+
+  return rb;
+}
+
+
+/*******************************************************************
+ * Same as regfi_open, but for a file descriptor the caller has
+ * already opened.  On success the REGF_FILE owns fd and closes it
+ * when it gets freed.  On failure fd is left open.
+ *
+ * Hives are small, so the whole file is mapped (or read in if it
+ * can't be mapped) and all cells are parsed out of memory.
+ *******************************************************************/
+REGF_FILE* regfi_open_fd(void *ctx, int fd)
+{
+  REGF_FILE* rb;
+  struct stat sbuf;
+  uint8* buffer;
+  uint32 file_length, length;
+  bool mapped = true;
+
+  /* Determine file length.  Must be at least big enough 
+   * for the header and one hbin. 
+   */
+  if (fstat(fd, &sbuf) == -1)
+    return NULL;
+  file_length = sbuf.st_size;
+  if(file_length < REGF_BLOCKSIZE+REGF_ALLOC_BLOCK)
+    return NULL;
+
+  buffer = mmap(NULL, file_length, PROT_READ, MAP_PRIVATE, fd, 0);
+  if(buffer == MAP_FAILED)
+  {
+    mapped = false;
+    buffer = talloc_size(NULL, file_length);
+    if(buffer == NULL)
+      return NULL;
+
+    length = file_length;
+    if(lseek(fd, 0, SEEK_SET) == -1
+       || regfi_read(fd, buffer, &length) != 0 || length != file_length)
+    {
+      talloc_free(buffer);
+      return NULL;
+    }
+  }
+
+  rb = regfi_open_buffer(ctx, buffer, file_length);
+  if(rb == NULL)
+  {
+    if(mapped)
+      munmap(buffer, file_length);
+    else
+      talloc_free(buffer);
+    return NULL;
+  }
+
+  rb->fd = fd;
+  rb->mapped = mapped;
+  if(!mapped)
+    talloc_steal(rb, buffer);
+
+  return rb;
+}
+
+
+/*******************************************************************
+ * Parses a hive which is already in memory.  buffer is not copied and
+ * must stay valid for as long as the REGF_FILE is in use.
+ *******************************************************************/
+REGF_FILE* regfi_open_buffer(void *ctx, const uint8* buffer, uint32 length)
+{
+  REGF_FILE* rb;
+  REGF_HBIN* hbin = NULL;
+  uint32 hbin_off, secret;
+  bool rla;
+
   /* read in an existing file */
-  if ((rb = regfi_parse_regf(ctx, fd, true)) == NULL) 
+  if ((rb = regfi_parse_regf(ctx, buffer, length, true)) == NULL) 
   {
     /* DEBUG(0,("regfi_open: Failed to read initial REGF block\n"));*/
-    close(fd);
     return NULL;
   }
   
   rb->hbins = range_list_new(rb);
   if(rb->hbins == NULL)
   {
-    close(fd);
     talloc_free(rb);
     return NULL;
   }
   
+  /* This secret isn't very secret, but we don't need a good one.  This 
+   * secret is just designed to prevent someone from trying to blow our
+   * caching and make things slow.
+   */
+  secret = 0x15DEAD05^time(NULL)^(getpid()<<16)^(getppid()<<8);
+  rb->nk_recs = lru_cache_create(rb, REGFI_NK_CACHE_SIZE, secret, true);
+  rb->sk_recs = lru_cache_create(rb, REGFI_SK_CACHE_SIZE, secret, true);
+  if(rb->nk_recs == NULL || rb->sk_recs == NULL)
+  {
+    talloc_free(rb);
+    return NULL;
+  }
+
   rla = true;
   hbin_off = REGF_BLOCKSIZE;
-  hbin = regfi_parse_hbin(ctx, rb, hbin_off, true);
+  hbin = regfi_parse_hbin(rb, rb, hbin_off, true);
   while(hbin && rla)
   {
     hbin_off = hbin->file_off + hbin->block_size;
     rla = range_list_add(rb->hbins, hbin->file_off, hbin->block_size, hbin);
-    hbin = regfi_parse_hbin(ctx, rb, hbin_off, true);
+    hbin = regfi_parse_hbin(rb, rb, hbin_off, true);
   }
 
   /* Make sure that fd is automatically closed when rb gets freed */
@@ -819,10 +1019,12 @@ REGF_FILE* regfi_open(void *ctx, const char* filename)
  *******************************************************************/
 int regfi_close( REGF_FILE *file )
 {
-  int fd;
+  if(file->mapped)
+    munmap((void*)file->buffer, file->file_length);
+
+  if(file->fd >= 0)
+    close(file->fd);
 
-  fd = file->fd;
-  close(fd);
   return 0;
 }
 
@@ -884,14 +1086,6 @@ REGFI_ITERATOR* regfi_iterator_new(REGF_FILE* fh)
   if(ret_val->key_positions == NULL)
     goto error;
 
-  /* This secret isn't very secret, but we don't need a good one.  This 
-   * secret is just designed to prevent someone from trying to blow our
-   * caching and make things slow.
-   */
-  ret_val->sk_recs = lru_cache_create(ret_val, 127, 0x15DEAD05^time(NULL)
-				      ^(getpid()<<16)^(getppid()<<8),
-				      true);
-
   ret_val->f = fh;
   ret_val->cur_key = root;
   ret_val->cur_subkey = 0;
@@ -1050,25 +1244,31 @@ const REGF_SK_REC* regfi_iterator_cur_sk(REGFI_ITERATOR* i)
   if(i->cur_key == NULL)
     return NULL;
   
+  if(i->cur_key->sk_off == REGF_OFFSET_NONE)
+    return NULL;
+
   /* First look if we have already parsed it */
-  if((i->cur_key->sk_off!=REGF_OFFSET_NONE)
-     && !(ret_val =(REGF_SK_REC*)lru_cache_find(i->sk_recs, 
-						&i->cur_key->sk_off, 4)))
+  i->f->sk_stats.lookups++;
+  ret_val = (REGF_SK_REC*)lru_cache_find(i->f->sk_recs, 
+					 &i->cur_key->sk_off, 4);
+  if(ret_val != NULL)
   {
-    hbin = regfi_lookup_hbin(i->f, i->cur_key->sk_off);
+    i->f->sk_stats.hits++;
+    return ret_val;
+  }
 
-    if(hbin == NULL)
-      return NULL;
+  hbin = regfi_lookup_hbin(i->f, i->cur_key->sk_off);
+  if(hbin == NULL)
+    return NULL;
 
-    off = i->cur_key->sk_off + REGF_BLOCKSIZE;
-    max_length = hbin->block_size + hbin->file_off - off;
-    ret_val = regfi_parse_sk(i, i->f, off, max_length, true);
-    if(ret_val == NULL)
-      return NULL;
+  off = i->cur_key->sk_off + REGF_BLOCKSIZE;
+  max_length = hbin->block_size + hbin->file_off - off;
+  ret_val = regfi_parse_sk(i->f->sk_recs, i->f, off, max_length, true);
+  if(ret_val == NULL)
+    return NULL;
 
-    ret_val->sk_off = i->cur_key->sk_off;
-    lru_cache_update(i->sk_recs, &i->cur_key->sk_off, 4, ret_val);
-  }
+  ret_val->sk_off = i->cur_key->sk_off;
+  lru_cache_update(i->f->sk_recs, &i->cur_key->sk_off, 4, ret_val);
 
   return ret_val;
 }
@@ -1189,7 +1389,7 @@ const REGF_VK_REC* regfi_iterator_next_value(REGFI_ITERATOR* i)
  * Computes the checksum of the registry file header.
  * buffer must be at least the size of an regf header (4096 bytes).
  *******************************************************************/
-static uint32 regfi_compute_header_checksum(uint8* buffer)
+static uint32 regfi_compute_header_checksum(const uint8* buffer)
 {
   uint32 checksum, x;
   int i;
@@ -1210,34 +1410,24 @@ static uint32 regfi_compute_header_checksum(uint8* buffer)
 /*******************************************************************
  * XXX: Add way to return more detailed error information.
  *******************************************************************/
-REGF_FILE* regfi_parse_regf(void *ctx, int fd, bool strict)
+REGF_FILE* regfi_parse_regf(void *ctx, const uint8* buffer, 
+			    uint32 file_length, bool strict)
 {
-  uint8 file_header[REGF_BLOCKSIZE];
-  uint32 length;
-  uint32 file_length;
-  struct stat sbuf;
+  const uint8* file_header = buffer;
   REGF_FILE* ret_val;
 
-  /* Determine file length.  Must be at least big enough 
-   * for the header and one hbin. 
-   */
-  if (fstat(fd, &sbuf) == -1)
-    return NULL;
-  file_length = sbuf.st_size;
+  /* Must be at least big enough for the header and one hbin. */
   if(file_length < REGF_BLOCKSIZE+REGF_ALLOC_BLOCK)
     return NULL;
 
-  ret_val = talloc(ctx, REGF_FILE);
+  ret_val = talloc_zero(ctx, REGF_FILE);
   if(ret_val == NULL)
     return NULL;
 
-  ret_val->fd = fd;
+  ret_val->fd = -1;
   ret_val->file_length = file_length;
-
-  length = REGF_BLOCKSIZE;
-  if((regfi_read(fd, file_header, &length)) != 0 
-     || length != REGF_BLOCKSIZE)
-    goto error;
+  ret_val->buffer = buffer;
+  ret_val->mapped = false;
 
   ret_val->checksum = IVAL(file_header, 0x1FC);
   ret_val->computed_checksum = regfi_compute_header_checksum(file_header);
@@ -1281,22 +1471,13 @@ REGF_FILE* regfi_parse_regf(void *ctx, int fd, bool strict)
 REGF_HBIN* regfi_parse_hbin(void *ctx, REGF_FILE* file, uint32 offset, bool strict)
 {
   REGF_HBIN *hbin;
-  uint8 hbin_header[HBIN_HEADER_REC_SIZE];
-  uint32 length;
+  const uint8* hbin_header;
   
   if(offset >= file->file_length)
     return NULL;
 
-  if(lseek(file->fd, offset, SEEK_SET) == -1)
-    return NULL;
-
-  length = HBIN_HEADER_REC_SIZE;
-  if((regfi_read(file->fd, hbin_header, &length) != 0) 
-     || length != HBIN_HEADER_REC_SIZE)
-    return NULL;
-
-
-  if(lseek(file->fd, offset, SEEK_SET) == -1)
+  hbin_header = regfi_ptr(file, offset, HBIN_HEADER_REC_SIZE);
+  if(hbin_header == NULL)
     return NULL;
 
   hbin = talloc(ctx, REGF_HBIN);
@@ -1335,14 +1516,16 @@ REGF_HBIN* regfi_parse_hbin(void *ctx, REGF_FILE* file, uint32 offset, bool stri
 REGF_NK_REC* regfi_parse_nk(void *ctx, REGF_FILE* file, uint32 offset, 
 			    uint32 max_size, bool strict)
 {
-  uint8 nk_header[REGFI_NK_MIN_LENGTH];
+  const uint8* nk_header;
+  const uint8* name;
   REGF_NK_REC* ret_val;
   uint32 length;
   uint32 cell_length;
   bool unalloc = false;
 
-  if(!regfi_parse_cell(file->fd, offset, nk_header, REGFI_NK_MIN_LENGTH,
-		       &cell_length, &unalloc))
+  nk_header = regfi_parse_cell(file, offset, REGFI_NK_MIN_LENGTH,
+			       &cell_length, &unalloc);
+  if(nk_header == NULL)
      return NULL;
  
   /* A bit of validation before bothering to allocate memory */
@@ -1428,16 +1611,16 @@ REGF_NK_REC* regfi_parse_nk(void *ctx, REGF_FILE* file, uint32 offset,
       ret_val->cell_size = length;
   }
   
-  ret_val->keyname = talloc_array(ret_val, char, ret_val->name_length+1);
-  if(ret_val->keyname == NULL)
+  /* The name follows straight after the header */
+  name = regfi_ptr(file, offset+4+REGFI_NK_MIN_LENGTH, ret_val->name_length);
+  if(name == NULL)
     goto error;
 
-  /* Don't need to seek, should be at the right offset */
-  length = ret_val->name_length;
-  if((regfi_read(file->fd, (uint8*)ret_val->keyname, &length) != 0)
-     || length != ret_val->name_length)
+  ret_val->keyname = talloc_array(ret_val, char, ret_val->name_length+1);
+  if(ret_val->keyname == NULL)
     goto error;
 
+  memcpy(ret_val->keyname, name, ret_val->name_length);
   ret_val->keyname[ret_val->name_length] = '\0';
 
   return ret_val;
@@ -1455,12 +1638,14 @@ REGF_VK_REC* regfi_parse_vk(void *ctx, REGF_FILE* file, uint32 offset,
 			    uint32 max_size, bool strict)
 {
   REGF_VK_REC* ret_val;
-  uint8 vk_header[REGFI_VK_MIN_LENGTH];
-  uint32 raw_data_size, length, cell_length;
+  const uint8* vk_header;
+  const uint8* name;
+  uint32 raw_data_size, cell_length;
   bool unalloc = false;
 
-  if(!regfi_parse_cell(file->fd, offset, vk_header, REGFI_VK_MIN_LENGTH,
-		       &cell_length, &unalloc))
+  vk_header = regfi_parse_cell(file, offset, REGFI_VK_MIN_LENGTH,
+			       &cell_length, &unalloc);
+  if(vk_header == NULL)
     return NULL;
 
   ret_val = talloc(ctx, REGF_VK_REC);
@@ -1505,15 +1690,15 @@ REGF_VK_REC* regfi_parse_vk(void *ctx, REGF_FILE* file, uint32 offset,
     if(cell_length < ret_val->name_length + REGFI_VK_MIN_LENGTH + 4)
       cell_length+=8;
 
+    name = regfi_ptr(file, offset+4+REGFI_VK_MIN_LENGTH, ret_val->name_length);
+    if(name == NULL)
+      goto error;
+
     ret_val->valuename = talloc_array(ret_val, char, ret_val->name_length+1);
     if(ret_val->valuename == NULL)
       goto error;
 
-    length = ret_val->name_length;
-    if((regfi_read(file->fd, (uint8*)ret_val->valuename, &length) != 0)
-       || length != ret_val->name_length)
-      goto error;
-    
+    memcpy(ret_val->valuename, name, ret_val->name_length);
     ret_val->valuename[ret_val->name_length] = '\0';
   }
   else
@@ -1547,7 +1732,8 @@ REGF_VK_REC* regfi_parse_vk(void *ctx, REGF_FILE* file, uint32 offset,
 uint8* regfi_parse_data(void *ctx, REGF_FILE* file, uint32 offset, uint32 length, bool strict)
 {
   uint8* ret_val=NULL;
-  uint32 read_length, cell_length;
+  const uint8* data;
+  uint32 cell_length;
   uint8 i;
   bool unalloc;
 
@@ -1568,8 +1754,7 @@ uint8* regfi_parse_data(void *ctx, REGF_FILE* file, uint32 offset, uint32 length
   }
   else
   {
-    if(!regfi_parse_cell(file->fd, offset, NULL, 0,
-			 &cell_length, &unalloc))
+    if(regfi_parse_cell(file, offset, 0, &cell_length, &unalloc) == NULL)
       goto error;
 
     if((cell_length & 0xFFFFFFF8) != cell_length)
@@ -1589,14 +1774,15 @@ uint8* regfi_parse_data(void *ctx, REGF_FILE* file, uint32 offset, uint32 length
     /* XXX: There is currently no check to ensure the data 
      *      cell doesn't cross HBIN boundary.
      */
+    data = regfi_ptr(file, offset+4, length);
+    if(data == NULL)
+      goto error;
+
     ret_val = talloc_array(ctx, uint8, length);
     if(!ret_val)
       return NULL;
 
-    read_length = length;
-    if((regfi_read(file->fd, ret_val, &read_length) != 0) 
-       || read_length != length)
-      goto error;
+    memcpy(ret_val, data, length);
   }
 
   return ret_val;
@@ -1630,8 +1816,8 @@ range_list* regfi_parse_unalloc_cells(REGF_FILE* file)
     curr_off = HBIN_HEADER_REC_SIZE;
     while(curr_off < hbin->block_size)
     {
-      if(!regfi_parse_cell(file->fd, hbin->file_off+curr_off, NULL, 0,
-			   &cell_len, &is_unalloc))
+      if(regfi_parse_cell(file, hbin->file_off+curr_off, 0,
+			  &cell_len, &is_unalloc) == NULL)
 	break;
       
       if((cell_len == 0) || ((cell_len & 0xFFFFFFF8) != cell_len))
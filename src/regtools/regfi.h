@@ -44,6 +44,7 @@
 #include <sys/types.h>
 #include <unistd.h>
 #include <assert.h>
+#include <sys/mman.h>
 
 #include "smb_deps.h"
 #include "void_stack.h"
@@ -75,6 +76,10 @@
 #define REGF_ALLOC_BLOCK	   0x1000 /* Minimum allocation unit for HBINs */
 #define REGF_MAX_DEPTH		   512
 
+/* Number of parsed records kept in each REGF_FILE's caches */
+#define REGFI_NK_CACHE_SIZE        1024
+#define REGFI_SK_CACHE_SIZE        127
+
 /* header sizes for various records */
 #define REGF_MAGIC_SIZE		   4
 #define HBIN_MAGIC_SIZE		   4
@@ -248,6 +253,14 @@ typedef struct
 
 
 
+/* Lookup and hit counts for one of a REGF_FILE's caches */
+typedef struct
+{
+  uint32 lookups;
+  uint32 hits;
+} REGFI_CACHE_STATS;
+
+
 /* REGF block */
 typedef struct 
 {
@@ -255,11 +268,32 @@ typedef struct
   int fd;	  /* file descriptor */
   /* For sanity checking (not part of the registry header) */
   uint32 file_length;
+  /* The whole file.  Cells are parsed straight out of this buffer
+   * rather than read(2) from fd a few bytes at a time.
+   */
+  const uint8* buffer;
+  bool mapped;    /* buffer was mmap(2)ed and must be unmapped */
   void* mem_ctx;  /* memory context for run-time file access information */
 
   /* Experimental hbin lists */
   range_list* hbins;
 
+  /* Cells tend to be close to the last one parsed, so the hbin found
+   * by the last regfi_lookup_hbin is checked before the range list.
+   */
+  REGF_HBIN* last_hbin;
+
+  /* Parsed NK and SK records, keyed by virtual offset.  Keys from 
+   * regfi_load_key share their names, values and subkeys with the 
+   * records in here.
+   */
+  lru_cache* nk_recs;
+  lru_cache* sk_recs;
+
+  REGFI_CACHE_STATS hbin_stats;
+  REGFI_CACHE_STATS nk_stats;
+  REGFI_CACHE_STATS sk_stats;
+
   /* file format information */  
   uint8  magic[REGF_MAGIC_SIZE];/* "regf" */
   NTTIME mtime;
@@ -289,7 +323,6 @@ typedef struct
 {
   REGF_FILE* f;
   void_stack* key_positions;
-  lru_cache* sk_recs;
   REGF_NK_REC* cur_key;
   REGF_NK_REC* cur_subkey_p;
   uint32 cur_subkey;
@@ -319,6 +352,9 @@ char*                 regfi_get_owner(SEC_DESC* sec_desc);
 char*                 regfi_get_group(SEC_DESC* sec_desc);
 
 REGF_FILE*            regfi_open(void *ctx, const char* filename);
+REGF_FILE*            regfi_open_fd(void *ctx, int fd);
+REGF_FILE*            regfi_open_buffer(void *ctx, const uint8* buffer, 
+					uint32 length);
 int                   regfi_close(REGF_FILE* r);
 
 REGFI_ITERATOR*       regfi_iterator_new(REGF_FILE* fh);
@@ -349,7 +385,8 @@ const REGF_VK_REC*    regfi_iterator_next_value(REGFI_ITERATOR* i);
 /************************************/
 /*  Low-layer data structure access */
 /************************************/
-REGF_FILE*            regfi_parse_regf(void *ctx, int fd, bool strict);
+REGF_FILE*            regfi_parse_regf(void *ctx, const uint8* buffer, 
+				       uint32 file_length, bool strict);
 REGF_HBIN*            regfi_parse_hbin(void *ctx, REGF_FILE* file, uint32 offset, 
 				       bool strict);
 
@@ -404,7 +441,7 @@ range_list* regfi_parse_unalloc_cells(REGF_FILE* file);
 
 REGF_HBIN* regfi_lookup_hbin(REGF_FILE* file, uint32 offset);
 
-bool regfi_parse_cell(int fd, uint32 offset, uint8* hdr, uint32 hdr_len,
-		      uint32* cell_length, bool* unalloc);
+const uint8* regfi_parse_cell(REGF_FILE* file, uint32 offset, uint32 hdr_len,
+			      uint32* cell_length, bool* unalloc);
 
 #endif	/* _REGFI_H */
@@ -231,7 +231,7 @@ int printCell(REGF_FILE* f, uint32 offset)
   uint32 cell_length;
   bool unalloc;
 
-  if(!regfi_parse_cell(f->fd, offset, NULL, 0, &cell_length, &unalloc))
+  if(regfi_parse_cell(f, offset, 0, &cell_length, &unalloc) == NULL)
     return 1;
 
   quoted_buf = getQuotedData(f->fd, offset, cell_length);
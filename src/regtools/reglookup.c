@@ -434,6 +434,14 @@ int retrievePath(REGFI_ITERATOR* iter, const char** path)
 }
 
 
+void printCacheStats(const char* name, const REGFI_CACHE_STATS* stats)
+{
+  fprintf(stderr, "VERBOSE: %s cache: %u lookups, %u hits (%.1f%%)\n",
+	  name, stats->lookups, stats->hits, 
+	  stats->lookups ? 100.0*stats->hits/stats->lookups : 0.0);
+}
+
+
 static void usage(void)
 {
   fprintf(stderr, "Usage: reglookup [-v] [-s]"
@@ -557,6 +565,13 @@ int main(int argc, char** argv)
   else
     printKeyTree(iter);
 
+  if(print_verbose)
+  {
+    printCacheStats("hbin", &f->hbin_stats);
+    printCacheStats("key", &f->nk_stats);
+    printCacheStats("security descriptor", &f->sk_stats);
+  }
+
   talloc_free(iter);
   regfi_close(f);
 
@@ -0,0 +1,143 @@
+/* Checks hash database lookups through the binary index (.bidx), and
+ * that a corrupt or truncated binary index is ignored in favour of the
+ * text index instead of being read out of bounds.
+ *
+ * Build against the sleuthkit library, e.g.:
+ *   gcc -I../src/include -I../src/filesystems/sleuthkit/sleuthkit-2.52 \
+ *       -o hdbtest hdbtest.c \
+ *       ../src/filesystems/sleuthkit/sleuthkit-2.52/tsk/.libs/libtsk-pf.a \
+ *       ../src/lib/.libs/liboo.a
+ *
+ * usage: hdbtest tmpdir
+ */
+#include "tsk/libtsk.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define COUNT 5000
+
+static uint8_t hashes[COUNT][16];
+
+/* Makes up COUNT md5 values. They only need to be spread out. */
+static void make_hashes(void) {
+  uint32_t x = 0x12345678;
+  int i, j;
+
+  for(i=0; i<COUNT; i++) {
+    for(j=0; j<16; j++) {
+      x = x * 1103515245 + 12345;
+      hashes[i][j] = (uint8_t)(x >> 16);
+    }
+  }
+}
+
+static TSK_WALK_RET_ENUM found(TSK_HDB_INFO *hdb, const char *hash,
+                               const char *name, void *ptr) {
+  (*(int *)ptr)++;
+  return TSK_WALK_CONT;
+}
+
+/* Every hash in the database must be found, and by name */
+static int check(char *db, char *what) {
+  TSK_HDB_INFO *hdb = tsk_hdb_open(db, TSK_HDB_OPEN_NONE);
+  uint8_t missing[16];
+  int i, n;
+
+  if(!hdb) {
+    tsk_error_print(stderr);
+    return 1;
+  }
+
+  for(i=0; i<COUNT; i++) {
+    n = 0;
+    if(tsk_hdb_lookup_raw(hdb, hashes[i], 16, TSK_HDB_FLAG_EXT, found, &n) != 1 ||
+       n != 1) {
+      fprintf(stderr, "%s: hash %d not found\n", what, i);
+      return 1;
+    }
+  }
+
+  memset(missing, 0xab, sizeof(missing));
+  if(tsk_hdb_lookup_raw(hdb, missing, 16, TSK_HDB_FLAG_QUICK, NULL, NULL) != 0) {
+    fprintf(stderr, "%s: found a hash which is not there\n", what);
+    return 1;
+  }
+
+  tsk_hdb_close(hdb);
+  printf("%s: ok\n", what);
+  return 0;
+}
+
+/* Overwrites len bytes at offset in the file */
+static int patch(char *filename, long offset, void *data, size_t len) {
+  FILE *fp = fopen(filename, "r+b");
+
+  if(!fp || fseek(fp, offset, SEEK_SET) || fwrite(data, 1, len, fp) != len) {
+    perror(filename);
+    return 1;
+  }
+  fclose(fp);
+  return 0;
+}
+
+int main(int argc, char **argv) {
+  char db[1024], bidx[1024];
+  TSK_HDB_INFO *hdb;
+  FILE *fp;
+  int i, j;
+  uint8_t bad[8];
+
+  if(argc < 2) {
+    fprintf(stderr, "usage: %s tmpdir\n", argv[0]);
+    return 1;
+  }
+
+  make_hashes();
+  snprintf(db, sizeof(db), "%s/hdbtest.md5", argv[1]);
+  snprintf(bidx, sizeof(bidx), "%s-md5.bidx", db);
+
+  fp = fopen(db, "w");
+  if(!fp) {
+    perror(db);
+    return 1;
+  }
+  for(i=0; i<COUNT; i++) {
+    for(j=0; j<16; j++)
+      fprintf(fp, "%02x", hashes[i][j]);
+    fprintf(fp, "  file%d\n", i);
+  }
+  fclose(fp);
+
+  hdb = tsk_hdb_open(db, TSK_HDB_OPEN_NONE);
+  if(!hdb || hdb->makeindex(hdb, TSK_HDB_DBTYPE_MD5SUM_STR)) {
+    tsk_error_print(stderr);
+    return 1;
+  }
+  tsk_hdb_close(hdb);
+
+  if(access(bidx, R_OK)) {
+    perror(bidx);
+    return 1;
+  }
+
+  if(check(db, "binary index"))
+    return 1;
+
+  /* A bucket which points past the end of the hashes. The header (24
+   * bytes) and the file size are still good. */
+  memset(bad, 0xff, sizeof(bad));
+  bad[7] = 0x7f;
+  if(patch(bidx, 24 + (((uint32_t)hashes[0][0] << 8 | hashes[0][1]) + 1) * 8,
+           bad, sizeof(bad)) ||
+     check(db, "corrupt prefix table"))
+    return 1;
+
+  /* A truncated index */
+  if(truncate(bidx, 4096) || check(db, "truncated index"))
+    return 1;
+
+  unlink(bidx);
+  return 0;
+}
@@ -0,0 +1,197 @@
+/* Checks lzfu_decompress() against the original byte at a time
+ * decoder on random streams, and compares their speed.
+ *
+ * Build against the mailtools sources, e.g.:
+ *   gcc -I../src/include -I../src/mailtools -o lzfutest lzfutest.c \
+ *       ../src/mailtools/{lzfu,libpst,debug,libstrfunc,timeconv,vbuf}.c \
+ *       ../src/lib/.libs/liboo.a
+ *
+ * usage: lzfutest [streams]
+ */
+#include "define.h"
+#include "libpst.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "lzfu.h"
+
+// these are private to lzfu.c
+#define LZFU_INITDICT	"{\\rtf1\\ansi\\mac\\deff0\\deftab720{\\fonttbl;}" \
+						"{\\f0\\fnil \\froman \\fswiss \\fmodern \\fscrip" \
+						"t \\fdecor MS Sans SerifSymbolArialTimes Ne" \
+						"w RomanCourier{\\colortbl\\red0\\green0\\blue0" \
+						"\r\n\\par \\pard\\plain\\f0\\fs20\\b\\i\\u\\tab" \
+						"\\tx"
+#define LZFU_INITLENGTH 207
+
+typedef struct _lzfuheader {
+	uint32_t cbSize;
+	uint32_t cbRawSize;
+	uint32_t dwMagic;
+	uint32_t dwCRC;
+} lzfuheader;
+
+
+/**
+ * The original byte at a time decoder, which zeros the next dictionary
+ * entry after each byte. lzfu_decompress() must give the same output.
+ */
+static char* lzfu_decompress_ref(char* rtfcomp, uint32_t compsize, size_t *size) {
+	unsigned char dict[4096];       // the dictionary buffer
+	unsigned int dict_length = 0;   // the dictionary pointer
+	lzfuheader lzfuhdr;             // the header of the lzfu block
+	unsigned char flags;            // 8 bits of flags (1=2byte block pointer into the dict, 0=1 byte literal)
+	unsigned char flag_mask;        // look at one flag bit each time thru the loop
+	uint32_t i;
+	char    *out_buf;
+	uint32_t out_ptr  = 0;
+	uint32_t out_size;
+	uint32_t in_ptr;
+	uint32_t in_size;
+
+	memcpy(dict, LZFU_INITDICT, LZFU_INITLENGTH);
+    memset(dict + LZFU_INITLENGTH, 0, sizeof(dict) - LZFU_INITLENGTH);
+	dict_length = LZFU_INITLENGTH;
+
+	memcpy(&lzfuhdr, rtfcomp, sizeof(lzfuhdr));
+	LE32_CPU(lzfuhdr.cbSize);
+	LE32_CPU(lzfuhdr.cbRawSize);
+	LE32_CPU(lzfuhdr.dwMagic);
+	LE32_CPU(lzfuhdr.dwCRC);
+	//printf("total size: %d\n", lzfuhdr.cbSize+4);
+	//printf("raw size  : %d\n", lzfuhdr.cbRawSize);
+	//printf("compressed: %s\n", (lzfuhdr.dwMagic == LZFU_COMPRESSED ? "yes" : "no"));
+	//printf("CRC       : %#x\n", lzfuhdr.dwCRC);
+	//printf("\n");
+	out_size = lzfuhdr.cbRawSize;
+	out_buf  = (char*)xmalloc(out_size);
+	in_ptr	 = sizeof(lzfuhdr);
+	// Make sure to correct lzfuhdr.cbSize with 4 bytes before comparing
+	// to compsize
+	in_size  = (lzfuhdr.cbSize + 4 < compsize) ? lzfuhdr.cbSize + 4 : compsize;
+	while (in_ptr < in_size) {
+		flags = (unsigned char)(rtfcomp[in_ptr++]);
+		flag_mask = 1;
+		while (flag_mask) {
+			if (flag_mask & flags) {
+				// two bytes available?
+				if (in_ptr+1 < in_size) {
+					// read 2 bytes from input
+					unsigned short int blkhdr, offset, length;
+					memcpy(&blkhdr, rtfcomp+in_ptr, 2);
+					LE16_CPU(blkhdr);
+					in_ptr += 2;
+					/* swap the upper and lower bytes of blkhdr */
+					blkhdr = (((blkhdr&0xFF00)>>8)+
+							  ((blkhdr&0x00FF)<<8));
+					/* the offset is the first 12 bits of the 16 bit value */
+					offset = (blkhdr&0xFFF0)>>4;
+					/* the length of the dict entry are the last 4 bits */
+					length = (blkhdr&0x000F)+2;
+					// add the value we are about to print to the dictionary
+					for (i=0; i < length; i++) {
+						unsigned char c1;
+						c1 = dict[(offset+i)%4096];
+						dict[dict_length] = c1;
+						dict_length = (dict_length+1) % 4096;
+						if (out_ptr < out_size) out_buf[out_ptr++] = (char)c1;
+						// required for dictionary wrap around
+						// otherwise 0 byte values are referenced incorrectly
+						dict[dict_length] = 0;
+					}
+				}
+			} else {
+				// one byte available?
+				if (in_ptr < in_size) {
+					// uncompressed chunk (single byte)
+					char c1 = rtfcomp[in_ptr++];
+					dict[dict_length] = c1;
+					dict_length = (dict_length+1)%4096;
+					if (out_ptr < out_size) out_buf[out_ptr++] = (char)c1;
+					// required for dictionary wrap around
+					// otherwise 0 byte values are referenced incorrect
+					dict[dict_length] = 0;
+				}
+			}
+			flag_mask <<= 1;
+		}
+	}
+    *size = out_ptr;
+	return out_buf;
+}
+
+/* Makes a stream with a random body. Even streams are biased towards
+ * back references so that runs and dictionary wrap around get tested. */
+static char *make_stream(int k, uint32_t *len) {
+    uint32_t clen = 16 + rand() % 6000, raw = rand() % 20000, cb, x;
+    char *c = (char*)xmalloc(clen);
+
+    for (x = 16; x < clen; x++) {
+        int r = rand();
+        c[x] = (k & 1) ? r : ((r & 3) == 0 ? 0xff : r >> 8);
+    }
+
+    // cbSize is sometimes a little off from the real length
+    cb = clen - 4 + (rand() % 3 - 1) * (rand() % 10);
+    memcpy(c, &cb, 4);
+    memcpy(c + 4, &raw, 4);
+    memset(c + 8, 0, 8);
+    LE32_CPU(*(uint32_t*)c);
+    LE32_CPU(*(uint32_t*)(c + 4));
+
+    *len = clen;
+    return c;
+}
+
+
+int main(int argc, char **argv) {
+    int n = (argc > 1) ? atoi(argv[1]) : 100000;
+    int k, dec, round, bad = 0;
+    char **corpus;
+    uint32_t *sizes;
+    size_t s1, s2, total = 0;
+    clock_t start;
+    double secs;
+
+    srand(1);
+    corpus = (char**)xmalloc(n * sizeof(char*));
+    sizes  = (uint32_t*)xmalloc(n * sizeof(uint32_t));
+
+    for (k = 0; k < n; k++) {
+        char *a, *b;
+
+        corpus[k] = make_stream(k, &sizes[k]);
+        a = lzfu_decompress(corpus[k], sizes[k], &s1);
+        b = lzfu_decompress_ref(corpus[k], sizes[k], &s2);
+        if (s1 != s2 || memcmp(a, b, s1)) {
+            if (bad++ < 5) printf("stream %d differs: %lu and %lu bytes\n", k,
+                                  (unsigned long)s1, (unsigned long)s2);
+        }
+        total += s2;
+        free(a);
+        free(b);
+    }
+    printf("%d streams, %lu bytes decompressed, %d differ\n", n, (unsigned long)total, bad);
+
+    for (dec = 0; dec < 2; dec++) {
+        round = 0;
+        start = clock();
+        do {
+            for (k = 0; k < n; k++)
+                free(dec ? lzfu_decompress_ref(corpus[k], sizes[k], &s1)
+                         : lzfu_decompress(corpus[k], sizes[k], &s1));
+            round++;
+            secs = (double)(clock() - start) / CLOCKS_PER_SEC;
+        } while (secs < 1.0);
+        printf("%s: %.1f MB/s\n", dec ? "lzfu_decompress_ref" : "lzfu_decompress",
+               (double)total * round / secs / (1024 * 1024));
+    }
+
+    for (k = 0; k < n; k++) free(corpus[k]);
+    free(corpus);
+    free(sizes);
+    return bad ? 1 : 0;
+}
@@ -0,0 +1,64 @@
+#!/usr/bin/env python
+""" Checks PstFile.extract() on several threads against a single
+threaded run, and that items can be read from a thread which did not
+open the file.
+
+usage: psttest.py file.pst
+"""
+import sys, os, shutil, tempfile, threading
+import pst
+
+if len(sys.argv) < 2:
+    print "usage: %s file.pst" % sys.argv[0]
+    sys.exit(1)
+
+filename = sys.argv[1]
+tmp = tempfile.mkdtemp()
+
+def extract(threads):
+    outdir = os.path.join(tmp, "%s" % threads)
+    os.mkdir(outdir)
+    f = pst.PstFile(filename)
+    result = {}
+    for id, name, path in f.extract(outdir, threads=threads):
+        result[(id, name, os.path.basename(path))] = open(path, 'rb').read()
+
+    return result
+
+try:
+    ## The threads must write out exactly what a single thread does
+    single = extract(1)
+    for threads in (2, 4, 8):
+        assert extract(threads) == single, "%s threads differ" % threads
+
+    print "extracted %s files" % len(single)
+
+    ## Items are decoded on a thread which never called pst_open
+    f = pst.PstFile(filename)
+    count = []
+    def walk():
+        count.append(len([ x for x in f.iteritems() ]))
+
+    t = threading.Thread(target=walk)
+    t.start()
+    t.join()
+    assert count, "iteritems failed on another thread"
+    print "iterated %s items on another thread" % count[0]
+
+    ## The workers open their own handles on the file - if they can
+    ## not we must get an error rather than a partial result
+    copy = os.path.join(tmp, "copy.pst")
+    shutil.copyfile(filename, copy)
+    f = pst.PstFile(copy)
+    os.unlink(copy)
+    outdir = os.path.join(tmp, "missing")
+    os.mkdir(outdir)
+    try:
+        f.extract(outdir, threads=4)
+        assert False, "extract did not report the missing file"
+    except IOError, e:
+        print "Got expected error: %s" % e
+
+    print "ok"
+finally:
+    shutil.rmtree(tmp, True)
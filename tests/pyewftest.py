@@ -0,0 +1,96 @@
+#!/usr/bin/env python
+""" Checks that sk reads an EWF image through its C level reader the
+same way as through the python file interface, that those reads do not
+move the python file position, and that a closed image fails reads
+instead of using freed memory. Large reads on an image opened with
+threads > 1 must match plain reads, also when the image is closed from
+another thread in the middle of one.
+
+usage: pyewftest.py image.E01 [image.E02 ...]
+"""
+import sys, threading, time
+import pyewf, sk
+
+if len(sys.argv) < 2:
+    print "usage: %s image.E01 [image.E02 ...]" % sys.argv[0]
+    sys.exit(1)
+
+class PythonReader:
+    """ Hides the C level reader so sk has to call read and seek """
+    def __init__(self, fd):
+        self.fd = fd
+
+    def seek(self, offset, whence=0):
+        self.fd.seek(offset, whence)
+
+    def tell(self):
+        return self.fd.tell()
+
+    def read(self, length):
+        return self.fd.read(length)
+
+def listing(fs):
+    result = {}
+    for (root_inode, root), dirs, files in fs.walk('/', inodes=True):
+        for inode, name in files:
+            inode = str(inode)
+            result["%s/%s" % (root, name)] = (inode, fs.open(inode=inode).read())
+
+    return result
+
+img = pyewf.open(sys.argv[1:])
+img.seek(12345)
+fs = sk.skfs(img, cache=0)
+files = listing(fs)
+
+## sk has read all over the image, python reads carry on from 12345
+other = pyewf.open(sys.argv[1:])
+other.seek(12345)
+assert img.tell() == 12345
+assert img.read(4096) == other.read(4096), "C level reads moved the file position"
+
+assert files, "No files found"
+assert files == listing(sk.skfs(PythonReader(pyewf.open(sys.argv[1:])), cache=0)), \
+       "The C level reader differs from the python interface"
+
+## The filesystem still holds the reader after the image is closed
+img.close()
+for path, (inode, data) in files.items():
+    try:
+        fs.open(inode=inode).read()
+    except IOError, e:
+        break
+else:
+    assert False, "Reads through a closed image did not fail"
+
+try:
+    img.read(1)
+    assert False, "read on a closed image did not fail"
+except IOError, e:
+    pass
+
+## Reads which are large enough go through the worker threads
+data = pyewf.open(sys.argv[1:]).read()
+threaded = pyewf.open(sys.argv[1:], threads=4)
+for offset, length in ((0, len(data)), (12345, 1000000), (0, 1 << 20),
+                       (len(data) - 300000, 300000)):
+    threaded.seek(offset)
+    assert threaded.read(length) == data[offset:offset+length], \
+           "Threaded read of %s bytes at %s differs" % (length, offset)
+    assert threaded.tell() == offset + length
+
+def reader():
+    try:
+        while 1:
+            threaded.seek(0)
+            threaded.read()
+    except IOError, e:
+        pass
+
+t = threading.Thread(target=reader)
+t.start()
+time.sleep(0.1)
+threaded.close()
+t.join()
+
+print "ok: %s files" % len(files)
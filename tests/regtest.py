@@ -0,0 +1,78 @@
+#!/usr/bin/env python
+""" Checks the native key walker in pyregistry. The batch size and the
+way the hive is opened must not change what is walked, a subtree walk
+must match the full walk whichever case its path is given in, and
+walkers which were never attached to a registry must raise instead of
+crashing.
+
+usage: regtest.py hive
+"""
+import sys, StringIO
+import pyregistry
+
+if len(sys.argv) < 2:
+    print "usage: %s hive" % sys.argv[0]
+    sys.exit(1)
+
+hive = sys.argv[1]
+
+def walk(src, path=None, batch=1000):
+    result = []
+    for keys in pyregistry.PyRegistry(src).walk(path, batch):
+        assert 0 < len(keys) <= batch, "Bad batch size %s" % len(keys)
+        result.extend(keys)
+
+    return result
+
+full = walk(hive)
+assert full and full[0][0] == '/', "The walk does not start at the root"
+
+sources = [ open(hive, 'rb'), StringIO.StringIO(open(hive, 'rb').read()) ]
+for src in [hive] + sources:
+    for batch in (1, 7, 1000):
+        if hasattr(src, 'seek'): src.seek(0)
+        assert walk(src, batch=batch) == full, "%r with batch %s differs" % (src, batch)
+
+## Walk the first key with children on its own
+for i in range(1, len(full) - 1):
+    if full[i+1][0].startswith(full[i][0] + "/"):
+        path = full[i][0]
+        break
+else:
+    path = full[1][0]
+
+expected = [ k for k in full if k[0] == path or k[0].startswith(path + "/") ]
+assert walk(hive, path[1:]) == expected, "Walk of %s differs" % path
+
+## Keys are found without regard to case, paths keep the hive's names
+assert walk(hive, path[1:].swapcase()) == expected, "Walk of %s differs" % path.swapcase()
+
+try:
+    walk(hive, "a/" * 1000)
+    assert False, "A path deeper than the registry allows did not raise"
+except KeyError, e:
+    pass
+
+try:
+    walk(hive, "No/Such/Key")
+    assert False, "Missing key did not raise"
+except KeyError, e:
+    pass
+
+## Walkers made directly
+walker = pyregistry.RegistryWalker
+try:
+    walker.__new__(walker).next()
+    assert False, "Uninitialised walker did not raise"
+except RuntimeError, e:
+    pass
+
+try:
+    walker(object())
+    assert False, "A walker on a non registry object did not raise"
+except TypeError, e:
+    pass
+
+assert walk(hive) == [ k for keys in walker(pyregistry.PyRegistry(hive)) for k in keys ]
+
+print "ok: %s keys" % len(full)
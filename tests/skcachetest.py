@@ -0,0 +1,55 @@
+#!/usr/bin/env python
+""" Reads a filesystem through a file like object which can not tell
+its size, and checks that the page cache gives the same results as an
+uncached read of the plain file. A filesystem which is never closed
+must still release its image when it goes away.
+
+usage: skcachetest.py image
+"""
+import sys
+import sk
+
+if len(sys.argv) < 2:
+    print "usage: %s image" % sys.argv[0]
+    sys.exit(1)
+
+class UnknownSize:
+    """ A file like object which can not seek relative to its end, so
+    sk does not know the size of the image """
+    def __init__(self, filename):
+        self.fd = open(filename, 'rb')
+
+    def seek(self, offset, whence=0):
+        if whence == 2:
+            raise IOError("Can not seek from the end")
+        self.fd.seek(offset, whence)
+
+    def tell(self):
+        return self.fd.tell()
+
+    def read(self, length):
+        return self.fd.read(length)
+
+def listing(fs):
+    result = {}
+    for (root_inode, root), dirs, files in fs.walk('/', inodes=True):
+        for inode, name in files:
+            fd = fs.open(inode=str(inode))
+            result["%s/%s" % (root, name)] = fd.read()
+
+    return result
+
+expected = listing(sk.skfs(open(sys.argv[1], 'rb'), cache=0))
+got = listing(sk.skfs(UnknownSize(sys.argv[1])))
+
+assert expected, "No files found in %s" % sys.argv[1]
+assert got == expected, "Cached read of an image of unknown size differs"
+
+fd = open(sys.argv[1], 'rb')
+refs = sys.getrefcount(fd)
+fs = sk.skfs(fd)
+listing(fs)
+del fs
+assert sys.getrefcount(fd) == refs, "The image was not released"
+
+print "ok: %s files" % len(got)
@@ -0,0 +1,68 @@
+#!/usr/bin/env python
+""" Checks the batched skfs.iwalk iterator: batch sizes and threads
+must not change the result, a walk can be resumed from next_inum, and
+bad or closed filesystems raise instead of crashing.
+
+usage: skiwalktest.py image
+"""
+import sys
+import sk
+
+if len(sys.argv) < 2:
+    print "usage: %s image" % sys.argv[0]
+    sys.exit(1)
+
+fs = sk.skfs(open(sys.argv[1], 'rb'))
+
+for args in [ dict(), dict(alloc=1, unalloc=0), dict(alloc=1, unalloc=1) ]:
+    full = [ str(i) for i in fs.iwalk(batch=1000000, **args) ]
+    assert full or not args, "No inodes found with %s" % args
+
+    for batch in (1, 7, 1000):
+        for threads in (1, 4):
+            got = [ str(i) for i in fs.iwalk(batch=batch, threads=threads, **args) ]
+            assert got == full, "batch %s, threads %s differ with %s" % (batch, threads, args)
+
+    ## Stop half way and resume from where we were
+    it = fs.iwalk(batch=5, **args)
+    first = []
+    for i in it:
+        first.append(str(i))
+        if len(first) > len(full) / 2:
+            break
+
+    rest = [ str(i) for i in fs.iwalk(inode=it.next_inum, batch=5, **args) ]
+    assert first + rest == full, "Resumed walk differs with %s" % args
+
+iwalkiter = type(fs.iwalk())
+
+## A walker made directly is not attached to any filesystem
+try:
+    iwalkiter.__new__(iwalkiter).next()
+    assert False, "Uninitialised walker did not raise"
+except RuntimeError, e:
+    pass
+
+try:
+    iwalkiter(filesystem=object())
+    assert False, "A walker on a non skfs object did not raise"
+except TypeError, e:
+    pass
+
+## The thread filesystems were opened on the image of fs and must
+## stay valid after it is closed
+it = fs.iwalk(batch=5, alloc=1, threads=4)
+it.next()
+fs.close()
+
+for f in (lambda: iwalkiter(filesystem=fs), lambda: [ x for x in it ]):
+    try:
+        f()
+        assert False, "Walking a closed filesystem did not raise"
+    except IOError, e:
+        pass
+
+## This closes the thread filesystems and releases the image
+del it
+
+print "ok: %s inodes" % len(full)
@@ -0,0 +1,47 @@
+#!/usr/bin/env python
+""" Checks the paths sk finds for inodes (through the inode map, or
+ntfs_find_file on NTFS) against the paths seen by walking the
+filesystem. An inode with several names (hard links) may come back
+under any of them.
+
+usage: skpathtest.py image
+"""
+import sys
+import sk
+
+if len(sys.argv) < 2:
+    print "usage: %s image" % sys.argv[0]
+    sys.exit(1)
+
+fs = sk.skfs(open(sys.argv[1], 'rb'))
+
+## Every name the walk finds for each inode
+expected = {}
+directories = []
+for (root_inode, root), dirs, files in fs.walk('/', inodes=True):
+    for inode, name in dirs:
+        inode = int(str(inode).split('-')[0])
+        if inode not in expected:
+            directories.append(inode)
+
+    for inode, name in dirs + files:
+        inode = int(str(inode).split('-')[0])
+        expected.setdefault(inode, []).append(root.rstrip('/') + '/' + name)
+
+assert expected, "No files found in %s" % sys.argv[1]
+
+## A fresh filesystem has to build its map on the first lookup
+fs = sk.skfs(open(sys.argv[1], 'rb'))
+for inode, paths in expected.items():
+    got = fs.path(inode)
+    assert got in paths, "Inode %s: got %r, expected one of %r" % (inode, got, paths)
+
+assert fs.path(fs.root_inum) == '/'
+
+## walk(inode=) starts from the path of the inode
+assert directories, "No directories found in %s" % sys.argv[1]
+for inode in directories[:10]:
+    (root_inode, root), dirs, files = fs.walk(inode=inode, inodes=True).next()
+    assert root in expected[inode], "walk(inode=%s) started at %r" % (inode, root)
+
+print "ok: %s paths" % len(expected)